@@ -0,0 +1,543 @@
+﻿#include "BytecodeFile.h"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <limits>
+
+#include "Compiler.h"
+#include "GarbageCollector.h"
+#include "Obj.h"
+#include "OpCode.h"
+#include "ValueFormatter.h"
+#include "VirtualMachine.h"
+
+static_assert(std::endian::native == std::endian::little, "Bytecode files are little-endian.");
+
+bool BytecodeFile::Write(ObjHandle script)
+{
+    m_Bytes.clear();
+    m_Funs.clear();
+    m_Strings.clear();
+    m_StringIndices.clear();
+    m_FunIndices.clear();
+    m_FunCount = 0;
+    m_Error.clear();
+    if (!WriteFun(script, 0))
+        return false;
+
+    Header header = {
+        .Version = VERSION,
+        .OpCodeCount = (u32)OpCode::OpReturn + 1, .IntrinsicCount = (u32)Intrinsic::Count,
+        .StringCount = (u32)m_Strings.size(), .FunCount = m_FunCount};
+    std::memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+    Append(m_Bytes, header);
+    // strings go first, so that all of them are interned by the time reader meets a constant
+    for (ObjHandle string : m_Strings)
+    {
+        const std::string& text = string.As<StringObj>().String;
+        Append(m_Bytes, (u32)text.size());
+        m_Bytes.append(text);
+    }
+    m_Bytes.append(m_Funs);
+    return true;
+}
+
+bool BytecodeFile::IsBytecode(std::string_view data)
+{
+    return data.size() >= sizeof(MAGIC) && std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) == 0;
+}
+
+u64 BytecodeFile::GetBuildId()
+{
+    return (u64)VERSION << 48 | (u64)Compiler::VERSION << 32 | ((u64)OpCode::OpReturn + 1) << 16 | (u64)Intrinsic::Count;
+}
+
+bool BytecodeFile::Read(std::string_view data, VirtualMachine* vm, ObjHandle& script)
+{
+    m_Data = data;
+    m_Position = 0;
+    m_LoadedStrings.clear();
+    m_LoadedFuns.clear();
+    m_Error.clear();
+
+    Header header;
+    if (!IsBytecode(data) || !Take(header))
+        return ReadError("not a bytecode file");
+    if (header.Version != VERSION || header.OpCodeCount != (u32)OpCode::OpReturn + 1 ||
+        header.IntrinsicCount != (u32)Intrinsic::Count)
+        return ReadError("compiled by another version of vm, the script has to be recompiled");
+    // every string takes at least its length, and every function at least its header
+    if (header.StringCount > (m_Data.size() - m_Position) / sizeof(u32) || header.FunCount == 0 ||
+        header.FunCount > (m_Data.size() - m_Position) / sizeof(FunHeader))
+        return ReadError("invalid table sizes");
+
+    // nothing is reachable from the roots until the script is complete
+    GarbageCollector::Suspend();
+    bool isOk = true;
+    m_LoadedStrings.reserve(header.StringCount);
+    for (u32 i = 0; i < header.StringCount && isOk; i++)
+    {
+        u32 length;
+        isOk = Take(length) && length <= m_Data.size() - m_Position;
+        if (isOk)
+        {
+            m_LoadedStrings.push_back(vm->AddString(std::string{m_Data.substr(m_Position, length)}));
+            m_Position += length;
+        }
+        else
+        {
+            ReadError("invalid string");
+        }
+    }
+    m_LoadedFuns.reserve(header.FunCount);
+    for (u32 i = 0; i < header.FunCount && isOk; i++)
+    {
+        ObjHandle fun;
+        isOk = ReadFun(fun);
+        if (isOk)
+            m_LoadedFuns.push_back(fun);
+    }
+    GarbageCollector::Resume();
+    if (isOk && m_Position != m_Data.size())
+        isOk = ReadError("unexpected data after the script");
+    if (isOk)
+        script = m_LoadedFuns.back();
+    m_LoadedStrings.clear();
+    m_LoadedFuns.clear();
+    return isOk;
+}
+
+bool BytecodeFile::WriteFun(ObjHandle fun, u32 depth)
+{
+    if (depth > MAX_DEPTH)
+    {
+        m_Error = "Functions are nested too deeply to be written to bytecode";
+        return false;
+    }
+    const FunObj& funObj = fun.As<FunObj>();
+    const Chunk& chunk = funObj.Chunk;
+    // nested functions go before the one, that refers to them
+    for (Value val : chunk.m_Values)
+    {
+        if (!val.HasType<ObjHandle>()) continue;
+        ObjHandle nested = val.As<ObjHandle>();
+        if (nested.HasType<FunObj>() && !m_FunIndices.contains(nested) && !WriteFun(nested, depth + 1))
+            return false;
+    }
+
+    FunHeader header = {
+        .NameLength = (u32)chunk.m_Name.size(), .Arity = funObj.Arity, .UpvalueCount = funObj.UpvalueCount,
+        .CodeLength = (u32)chunk.m_Code.size(),
+        .ConstantCount = (u32)chunk.m_Values.size(), .LineCount = (u32)chunk.m_Lines.size()};
+    Append(m_Funs, header);
+    m_Funs.append(chunk.m_Name);
+    m_Funs.append(reinterpret_cast<const char*>(chunk.m_Code.data()), chunk.m_Code.size());
+    for (Value val : chunk.m_Values)
+    {
+        u64 payload = 0;
+        ConstantTag tag;
+        if (val.HasType<void*>())
+        {
+            tag = ConstantTag::Nil;
+        }
+        else if (val.HasType<bool>())
+        {
+            tag = val.As<bool>() ? ConstantTag::True : ConstantTag::False;
+        }
+        else if (val.HasType<i32>())
+        {
+            tag = ConstantTag::Int;
+            payload = (u32)val.As<i32>();
+        }
+        else if (val.HasType<f64>())
+        {
+            tag = ConstantTag::F64;
+            payload = std::bit_cast<u64>(val.As<f64>());
+        }
+        else if (val.As<ObjHandle>().HasType<StringObj>())
+        {
+            tag = ConstantTag::String;
+            payload = AddString(val.As<ObjHandle>());
+        }
+        else if (val.As<ObjHandle>().HasType<FunObj>())
+        {
+            tag = ConstantTag::Fun;
+            payload = m_FunIndices.at(val.As<ObjHandle>());
+        }
+        else
+        {
+            m_Error = std::format("Constant {} of {} cannot be written to bytecode", val, chunk.m_Name);
+            return false;
+        }
+        Append(m_Funs, payload);
+        Append(m_Funs, tag);
+    }
+    for (const RunLengthLines& lines : chunk.m_Lines)
+    {
+        Append(m_Funs, lines.Count);
+        Append(m_Funs, lines.Line);
+    }
+    m_FunIndices.emplace(fun, m_FunCount++);
+    return true;
+}
+
+u32 BytecodeFile::AddString(ObjHandle string)
+{
+    auto it = m_StringIndices.find(string);
+    if (it != m_StringIndices.end()) return it->second;
+    m_Strings.push_back(string);
+    m_StringIndices.emplace(string, (u32)m_Strings.size() - 1);
+    return (u32)m_Strings.size() - 1;
+}
+
+template <typename T>
+void BytecodeFile::Append(std::string& bytes, const T& val)
+{
+    bytes.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template <typename T>
+bool BytecodeFile::Take(T& val)
+{
+    if (m_Data.size() - m_Position < sizeof(T))
+        return false;
+    std::memcpy(&val, m_Data.data() + m_Position, sizeof(T));
+    m_Position += sizeof(T);
+    return true;
+}
+
+bool BytecodeFile::ReadFun(ObjHandle& fun)
+{
+    FunHeader header;
+    if (!Take(header))
+        return ReadError("invalid function header");
+    usize remaining = m_Data.size() - m_Position;
+    usize constantSize = sizeof(u64) + sizeof(ConstantTag);
+    usize linesSize = 2 * sizeof(u32);
+    if (header.Arity > 255 || header.UpvalueCount > 255 ||
+        (u64)header.NameLength + header.CodeLength + (u64)header.ConstantCount * constantSize +
+        (u64)header.LineCount * linesSize > remaining)
+        return ReadError("invalid function header");
+
+    fun = ObjRegistry::Create<FunObj>();
+    FunObj& funObj = fun.As<FunObj>();
+    funObj.Arity = header.Arity;
+    funObj.UpvalueCount = (u8)header.UpvalueCount;
+    Chunk& chunk = funObj.Chunk;
+    chunk.m_Name.assign(m_Data.substr(m_Position, header.NameLength));
+    m_Position += header.NameLength;
+    const u8* code = reinterpret_cast<const u8*>(m_Data.data() + m_Position);
+    chunk.m_Code.assign(code, code + header.CodeLength);
+    m_Position += header.CodeLength;
+
+    chunk.m_Values.reserve(header.ConstantCount);
+    for (u32 i = 0; i < header.ConstantCount; i++)
+    {
+        u64 payload;
+        ConstantTag tag;
+        Take(payload);
+        Take(tag);
+        switch (tag)
+        {
+        case ConstantTag::Nil: chunk.m_Values.emplace_back(nullptr); break;
+        case ConstantTag::False: chunk.m_Values.emplace_back(false); break;
+        case ConstantTag::True: chunk.m_Values.emplace_back(true); break;
+        case ConstantTag::Int: chunk.m_Values.emplace_back((i32)(u32)payload); break;
+        case ConstantTag::F64:
+            {
+                // with nan boxing other nans are tagged values, so a payload could forge one
+                f64 number = std::bit_cast<f64>(payload);
+                chunk.m_Values.emplace_back(std::isnan(number) ? std::numeric_limits<f64>::quiet_NaN() : number);
+                break;
+            }
+        case ConstantTag::String:
+            if (payload >= m_LoadedStrings.size())
+                return ReadError("invalid string constant");
+            chunk.m_Values.emplace_back(m_LoadedStrings[payload]);
+            break;
+        case ConstantTag::Fun:
+            // only functions, that precede this one, can be referred to
+            if (payload >= m_LoadedFuns.size())
+                return ReadError("invalid function constant");
+            chunk.m_Values.emplace_back(m_LoadedFuns[payload]);
+            break;
+        default:
+            return ReadError("invalid constant");
+        }
+    }
+    chunk.m_Lines.reserve(header.LineCount);
+    for (u32 i = 0; i < header.LineCount; i++)
+    {
+        u32 count;
+        u32 line;
+        Take(count);
+        Take(line);
+        chunk.m_Lines.emplace_back(count, line);
+    }
+    std::string error;
+    if (!CheckCode(funObj, error))
+        return ReadError(error);
+    return true;
+}
+
+bool BytecodeFile::CheckCode(const FunObj& fun, std::string& error)
+{
+    const Chunk& chunk = fun.Chunk;
+    const std::vector<u8>& code = chunk.m_Code;
+    const std::vector<Value>& values = chunk.m_Values;
+    u32 length = (u32)code.size();
+    auto fail = [&error](std::string message) { error = std::move(message); return false; };
+    auto isString = [](Value val) { return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<StringObj>(); };
+    // `OpPopN` and `OpCollection` take their count from the stack, the compiler always pushes it right before
+    auto isCount = [](Value val) { return val.HasType<f64>() && val.As<f64>() >= 0 && val.As<f64>() <= 0xffff'ffff; };
+    struct Instruction
+    {
+        u32 Offset;
+        u32 Next;
+        // 1 and 4 byte operand, or what is implied by the preceding constant (function or count)
+        u32 Operand;
+    };
+    std::vector<Instruction> instructions;
+    // jumps may only land on the start of an instruction, which is only known once all of them are walked
+    std::vector<u32> instructionAt(length, NO_INSTRUCTION);
+    // operand of the last constant instruction, that `OpClosure` takes its function from
+    u32 lastConstant = NO_INSTRUCTION;
+    for (u32 offset = 0; offset < length;)
+    {
+        instructionAt[offset] = (u32)instructions.size();
+        OpCode opCode = static_cast<OpCode>(code[offset]);
+        u32 operandSize = 0;
+        switch (opCode)
+        {
+        case OpCode::OpConstant:
+        case OpCode::OpDefineGlobal: case OpCode::OpReadGlobal: case OpCode::OpSetGlobal:
+        case OpCode::OpReadProperty: case OpCode::OpSetProperty:
+        case OpCode::OpReadLocal: case OpCode::OpSetLocal:
+        case OpCode::OpReadUpvalue: case OpCode::OpSetUpvalue:
+        case OpCode::OpReadSubscriptN: case OpCode::OpSetSubscriptN:
+        case OpCode::OpCall: case OpCode::OpInvoke: case OpCode::OpInvokeSuper:
+            operandSize = 1;
+            break;
+        case OpCode::OpConstant32:
+        case OpCode::OpDefineGlobal32: case OpCode::OpReadGlobal32: case OpCode::OpSetGlobal32:
+        case OpCode::OpReadProperty32: case OpCode::OpSetProperty32:
+        case OpCode::OpReadLocal32: case OpCode::OpSetLocal32:
+        case OpCode::OpJump: case OpCode::OpJumpFalse: case OpCode::OpJumpTrue:
+            operandSize = 4;
+            break;
+        case OpCode::OpIntrinsic:
+            operandSize = 2;
+            break;
+        case OpCode::OpClosure:
+            if (lastConstant >= values.size() || !values[lastConstant].HasType<ObjHandle>() ||
+                !values[lastConstant].As<ObjHandle>().HasType<FunObj>())
+                return fail(std::format("closure without function at code offset {}", offset));
+            operandSize = 2 * values[lastConstant].As<ObjHandle>().As<FunObj>().UpvalueCount;
+            break;
+        default:
+            if (code[offset] > (u8)OpCode::OpReturn)
+                return fail(std::format("unknown opcode at code offset {}", offset));
+            break;
+        }
+        if (operandSize > length - offset - 1)
+            return fail(std::format("truncated instruction at code offset {}", offset));
+        u32 operand = 0;
+        if (operandSize == 1) operand = code[offset + 1];
+        else if (operandSize == 4) std::memcpy(&operand, &code[offset + 1], sizeof(u32));
+        u32 next = offset + 1 + operandSize;
+        u32 constant = lastConstant;
+        lastConstant = NO_INSTRUCTION;
+        switch (opCode)
+        {
+        case OpCode::OpConstant:
+        case OpCode::OpConstant32:
+            if (operand >= values.size())
+                return fail(std::format("invalid constant index at code offset {}", offset));
+            lastConstant = operand;
+            break;
+        case OpCode::OpDefineGlobal: case OpCode::OpReadGlobal: case OpCode::OpSetGlobal:
+        case OpCode::OpReadProperty: case OpCode::OpSetProperty:
+        case OpCode::OpDefineGlobal32: case OpCode::OpReadGlobal32: case OpCode::OpSetGlobal32:
+        case OpCode::OpReadProperty32: case OpCode::OpSetProperty32:
+            if (operand >= values.size() || !isString(values[operand]))
+                return fail(std::format("invalid name constant at code offset {}", offset));
+            break;
+        case OpCode::OpReadUpvalue: case OpCode::OpSetUpvalue:
+            if (operand >= fun.UpvalueCount)
+                return fail(std::format("invalid upvalue index at code offset {}", offset));
+            break;
+        case OpCode::OpJump: case OpCode::OpJumpFalse: case OpCode::OpJumpTrue:
+            {
+                i64 target = (i64)next + std::bit_cast<i32>(operand);
+                if (target < 0 || target >= length)
+                    return fail(std::format("invalid jump target at code offset {}", offset));
+                operand = (u32)target;
+                break;
+            }
+        case OpCode::OpIntrinsic:
+            if (code[offset + 1] >= (u8)Intrinsic::Count)
+                return fail(std::format("invalid intrinsic at code offset {}", offset));
+            operand = code[offset + 2];
+            break;
+        case OpCode::OpClosure:
+            // locals are captured by slot of this function's frame, which is checked against the stack below
+            for (u32 i = offset + 1; i < next; i += 2)
+            {
+                if (code[i] > 1 || (code[i] == 0 && code[i + 1] >= fun.UpvalueCount))
+                    return fail(std::format("invalid closure capture at code offset {}", offset));
+            }
+            operand = constant;
+            break;
+        case OpCode::OpPopN:
+        case OpCode::OpCollection:
+            if (constant == NO_INSTRUCTION || !isCount(values[constant]))
+                return fail(std::format("count is not a constant at code offset {}", offset));
+            operand = (u32)values[constant].As<f64>();
+            break;
+        default:
+            break;
+        }
+        instructions.push_back({.Offset = offset, .Next = next, .Operand = operand});
+        offset = next;
+    }
+    for (const Instruction& instruction : instructions)
+    {
+        OpCode opCode = static_cast<OpCode>(code[instruction.Offset]);
+        if (opCode != OpCode::OpJump && opCode != OpCode::OpJumpFalse && opCode != OpCode::OpJumpTrue) continue;
+        u32 target = instructionAt[instruction.Operand];
+        if (target == NO_INSTRUCTION)
+            return fail(std::format("jump into the middle of instruction to code offset {}", instruction.Operand));
+        // the count would be whatever the jump leaves on the stack
+        OpCode targetCode = static_cast<OpCode>(code[instruction.Operand]);
+        if (targetCode == OpCode::OpPopN || targetCode == OpCode::OpCollection)
+            return fail(std::format("jump between count and its instruction to code offset {}", instruction.Operand));
+    }
+    // the compiler ends every function with a return, so execution cannot run past the code
+    if (length == 0 || code[instructions.back().Offset] != (u8)OpCode::OpReturn)
+        return fail("function does not end with return");
+    // lines are looked up for every runtime error, so they have to cover all of the code
+    u64 lineCount = 0;
+    for (const RunLengthLines& line : chunk.m_Lines) lineCount += line.Count;
+    if (lineCount < length)
+        return fail("line runs do not cover the code");
+
+    // every reachable instruction is walked with the stack depth of the frame (callee slot included) before it,
+    // which has to be the same on all paths, so that locals and captures always refer to values below the top
+    // and nothing pops the frame's own slots
+    std::vector<u32> depths(instructions.size(), NO_INSTRUCTION);
+    std::vector<u32> pending = {0};
+    depths[0] = fun.Arity + 1;
+    auto reach = [&](u32 index, u32 depth)
+    {
+        if (depths[index] == NO_INSTRUCTION)
+        {
+            depths[index] = depth;
+            pending.push_back(index);
+            return true;
+        }
+        return depths[index] == depth;
+    };
+    while (!pending.empty())
+    {
+        u32 index = pending.back();
+        pending.pop_back();
+        const Instruction& instruction = instructions[index];
+        OpCode opCode = static_cast<OpCode>(code[instruction.Offset]);
+        u32 depth = depths[index];
+        u32 operand = instruction.Operand;
+        // values taken from the top of the stack and put back in their place
+        u32 popCount = 0;
+        u32 pushCount = 1;
+        switch (opCode)
+        {
+        case OpCode::OpConstant: case OpCode::OpConstant32:
+        case OpCode::OpNil: case OpCode::OpFalse: case OpCode::OpTrue:
+        case OpCode::OpReadGlobal: case OpCode::OpReadGlobal32:
+        case OpCode::OpReadUpvalue:
+            break;
+        case OpCode::OpReadLocal: case OpCode::OpReadLocal32:
+        case OpCode::OpSetLocal: case OpCode::OpSetLocal32:
+            if (operand >= depth)
+                return fail(std::format("invalid local slot at code offset {}", instruction.Offset));
+            popCount = opCode == OpCode::OpSetLocal || opCode == OpCode::OpSetLocal32 ? 1 : 0;
+            break;
+        case OpCode::OpNegate: case OpCode::OpNot: case OpCode::OpBitNot:
+        case OpCode::OpSetGlobal: case OpCode::OpSetGlobal32: case OpCode::OpSetUpvalue:
+        case OpCode::OpReadProperty: case OpCode::OpReadProperty32:
+        case OpCode::OpJumpFalse: case OpCode::OpJumpTrue:
+        case OpCode::OpCloseUpvalue:
+        case OpCode::OpClass: case OpCode::OpStruct:
+            popCount = 1;
+            break;
+        case OpCode::OpClosure:
+            for (u32 i = instruction.Offset + 1; i < instruction.Next; i += 2)
+            {
+                // the function's own slot can be captured, as it becomes the closure of recursive local function
+                if (code[i] == 1 && code[i + 1] >= depth)
+                    return fail(std::format("invalid closure capture at code offset {}", instruction.Offset));
+            }
+            popCount = 1;
+            break;
+        case OpCode::OpAdd: case OpCode::OpSubtract: case OpCode::OpMultiply: case OpCode::OpDivide:
+        case OpCode::OpModulo: case OpCode::OpIntDivide:
+        case OpCode::OpBitAnd: case OpCode::OpBitXor: case OpCode::OpShiftLeft: case OpCode::OpShiftRight:
+        case OpCode::OpEqual: case OpCode::OpLess: case OpCode::OpLequal:
+        case OpCode::OpColMultiply:
+        case OpCode::OpSetProperty: case OpCode::OpSetProperty32:
+        case OpCode::OpStructField: case OpCode::OpInherit:
+        case OpCode::OpReadSubscript:
+            popCount = 2;
+            break;
+        case OpCode::OpMethod: case OpCode::OpReadSuper:
+        case OpCode::OpSetSubscript: case OpCode::OpReadSubscriptProperty:
+            popCount = 3;
+            break;
+        case OpCode::OpSetSubscriptProperty:
+            popCount = 4;
+            break;
+        case OpCode::OpPop:
+        case OpCode::OpDefineGlobal: case OpCode::OpDefineGlobal32:
+        case OpCode::OpReturn:
+            popCount = 1;
+            pushCount = 0;
+            break;
+        case OpCode::OpPopN:
+            popCount = 1 + operand;
+            pushCount = 0;
+            break;
+        case OpCode::OpCollection:
+            popCount = 1 + operand;
+            break;
+        case OpCode::OpJump:
+            pushCount = 0;
+            break;
+        // calls leave the result in place of the callee (or receiver and method name) and arguments
+        case OpCode::OpIntrinsic:   popCount = operand; break;
+        case OpCode::OpCall:        popCount = operand + 1; break;
+        case OpCode::OpInvoke:      popCount = operand + 2; break;
+        case OpCode::OpInvokeSuper: popCount = operand + 3; break;
+        case OpCode::OpReadSubscriptN: popCount = operand + 1; break;
+        case OpCode::OpSetSubscriptN:  popCount = operand + 2; break;
+        }
+        if ((u64)popCount >= depth)
+            return fail(std::format("stack underflow at code offset {}", instruction.Offset));
+        depth = depth - popCount + pushCount;
+        if (opCode == OpCode::OpReturn) continue;
+        if (opCode == OpCode::OpJump || opCode == OpCode::OpJumpFalse || opCode == OpCode::OpJumpTrue)
+        {
+            if (!reach(instructionAt[operand], depth))
+                return fail(std::format("stack depth differs at jump target at code offset {}", instruction.Offset));
+        }
+        if (opCode != OpCode::OpJump && !reach(index + 1, depth))
+            return fail(std::format("stack depth differs after code offset {}", instruction.Offset));
+    }
+    return true;
+}
+
+bool BytecodeFile::ReadError(std::string_view message)
+{
+    m_Error = std::format("Invalid bytecode at byte {}: {}", m_Position, message);
+    return false;
+}
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Obj.h"
+#include "Types.h"
+
+class VirtualMachine;
+
+// on-disk form of compiled script: a header, the table of strings the constants refer to, and functions
+// (code, constants, line runs, arity and upvalue metadata) ordered so that each one follows all functions
+// among its constants, with the script itself last; all numbers are little-endian and fixed-width,
+// so reading it is a sequence of copies straight out of the (mapped) file;
+// the structure is validated on read, and so is every instruction's operand, jump target and the stack depth
+// it runs at (locals, upvalues and captures are in bounds), the types of values instructions find on the stack
+// (such as names under `OpInvoke` or classes under `OpMethod`) are still trusted to come from the compiler
+class BytecodeFile
+{
+public:
+    // serializes `script` and all functions reachable through its constants
+    bool Write(ObjHandle script);
+    // bytes of the last successful `Write`, valid until the next call
+    std::string_view GetBytes() const { return m_Bytes; }
+    // whether `data` starts as bytecode (as opposed to source text)
+    static bool IsBytecode(std::string_view data);
+    // identifies the bytecode format, the compiler, that made it, and the vm it is valid for (opcodes and intrinsics)
+    static u64 GetBuildId();
+    // rebuilds functions from `data`, interning strings in `vm`, gc is suspended until the script is built,
+    // the caller shall root it before allocating anything else
+    bool Read(std::string_view data, VirtualMachine* vm, ObjHandle& script);
+    const std::string& GetError() const { return m_Error; }
+    // walks the instructions of `fun`, so that none of them reads past the code, constants, upvalues or its frame,
+    // constants of `fun` shall already be loaded, as the functions of closures and counts are taken from them
+    static bool CheckCode(const FunObj& fun, std::string& error);
+private:
+    enum class ConstantTag : u8
+    {
+        Nil = 0, False, True, Int, F64, String, Fun
+    };
+    struct Header
+    {
+        char Magic[4];
+        u32 Version;
+        // bytecode is only valid for the vm with the same opcodes and intrinsics
+        u32 OpCodeCount;
+        u32 IntrinsicCount;
+        u32 StringCount;
+        u32 FunCount;
+    };
+    // followed by name, code, constants (u64 payload and tag each) and line runs
+    struct FunHeader
+    {
+        u32 NameLength;
+        u32 Arity;
+        u32 UpvalueCount;
+        u32 CodeLength;
+        u32 ConstantCount;
+        u32 LineCount;
+    };
+    bool WriteFun(ObjHandle fun, u32 depth);
+    u32 AddString(ObjHandle string);
+    template <typename T>
+    static void Append(std::string& bytes, const T& val);
+
+    template <typename T>
+    bool Take(T& val);
+    bool ReadFun(ObjHandle& fun);
+    bool ReadError(std::string_view message);
+private:
+    std::string m_Bytes;
+    // functions are written before the string table is complete, so they are collected separately
+    std::string m_Funs;
+    std::vector<ObjHandle> m_Strings;
+    std::unordered_map<ObjHandle, u32> m_StringIndices;
+    std::unordered_map<ObjHandle, u32> m_FunIndices;
+    u32 m_FunCount{0};
+
+    std::string_view m_Data;
+    usize m_Position{0};
+    std::vector<ObjHandle> m_LoadedStrings;
+    std::vector<ObjHandle> m_LoadedFuns;
+    std::string m_Error;
+
+    static constexpr char MAGIC[4] = {'\x7f', 'B', 'C', 'V'};
+    // must be bumped whenever the meaning of existing opcodes or the layout changes
+    static constexpr u32 VERSION = 2;
+    static constexpr u32 MAX_DEPTH = 1024;
+    static constexpr u32 NO_INSTRUCTION = std::numeric_limits<u32>::max();
+};
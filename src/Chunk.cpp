@@ -164,6 +164,13 @@ u32 Disassembler::DisassembleInstruction(const Chunk& chunk, u32 offset)
     case OpCode::OpSubtract:       return SimpleInstruction(chunk, InstructionInfo{"OpSubtract", instruction, offset});
     case OpCode::OpMultiply:       return SimpleInstruction(chunk, InstructionInfo{"OpMultiply", instruction, offset});
     case OpCode::OpDivide:         return SimpleInstruction(chunk, InstructionInfo{"OpDivide", instruction, offset});
+    case OpCode::OpModulo:         return SimpleInstruction(chunk, InstructionInfo{"OpModulo", instruction, offset});
+    case OpCode::OpIntDivide:      return SimpleInstruction(chunk, InstructionInfo{"OpIntDivide", instruction, offset});
+    case OpCode::OpBitAnd:         return SimpleInstruction(chunk, InstructionInfo{"OpBitAnd", instruction, offset});
+    case OpCode::OpBitXor:         return SimpleInstruction(chunk, InstructionInfo{"OpBitXor", instruction, offset});
+    case OpCode::OpBitNot:         return SimpleInstruction(chunk, InstructionInfo{"OpBitNot", instruction, offset});
+    case OpCode::OpShiftLeft:      return SimpleInstruction(chunk, InstructionInfo{"OpShiftLeft", instruction, offset});
+    case OpCode::OpShiftRight:     return SimpleInstruction(chunk, InstructionInfo{"OpShiftRight", instruction, offset});
     case OpCode::OpEqual:          return SimpleInstruction(chunk, InstructionInfo{"OpEqual", instruction, offset});
     case OpCode::OpLess:           return SimpleInstruction(chunk, InstructionInfo{"OpLess", instruction, offset});
     case OpCode::OpLequal:         return SimpleInstruction(chunk, InstructionInfo{"OpLequal", instruction, offset});
@@ -187,16 +194,23 @@ u32 Disassembler::DisassembleInstruction(const Chunk& chunk, u32 offset)
     case OpCode::OpSetProperty32:  return NameInstructionInt(chunk, InstructionInfo{"OpSetProperty32", instruction, offset});
     case OpCode::OpReadSubscript:  return SimpleInstruction(chunk, InstructionInfo{"OpReadSubscript", instruction, offset});
     case OpCode::OpSetSubscript:   return SimpleInstruction(chunk, InstructionInfo{"OpSetSubscript", instruction, offset});
+    case OpCode::OpReadSubscriptN: return ByteInstruction(chunk, InstructionInfo{"OpReadSubscriptN", instruction, offset});
+    case OpCode::OpSetSubscriptN:  return ByteInstruction(chunk, InstructionInfo{"OpSetSubscriptN", instruction, offset});
+    case OpCode::OpReadSubscriptProperty: return SimpleInstruction(chunk, InstructionInfo{"OpReadSubscriptProperty", instruction, offset});
+    case OpCode::OpSetSubscriptProperty:  return SimpleInstruction(chunk, InstructionInfo{"OpSetSubscriptProperty", instruction, offset});
     case OpCode::OpJump:           return JumpInstruction(chunk, InstructionInfo{"OpJump", instruction, offset});
     case OpCode::OpJumpFalse:      return JumpInstruction(chunk, InstructionInfo{"OpJumpFalse", instruction, offset});
     case OpCode::OpJumpTrue:       return JumpInstruction(chunk, InstructionInfo{"OpJumpTrue", instruction, offset});
     case OpCode::OpClosure:        return ClosureInstruction(chunk, InstructionInfo{"OpClosure", instruction, offset});
     case OpCode::OpCloseUpvalue:   return SimpleInstruction(chunk, InstructionInfo{"OpCloseUpvalue", instruction, offset});
     case OpCode::OpClass:          return ClassInstruction(chunk, InstructionInfo{"OpClass", instruction, offset});
+    case OpCode::OpStruct:         return ClassInstruction(chunk, InstructionInfo{"OpStruct", instruction, offset});
+    case OpCode::OpStructField:    return MethodInstruction(chunk, InstructionInfo{"OpStructField", instruction, offset});
     case OpCode::OpInherit:        return SimpleInstruction(chunk, InstructionInfo{"OpInherit", instruction, offset});
     case OpCode::OpMethod:         return MethodInstruction(chunk, InstructionInfo{"OpMethod", instruction, offset});
     case OpCode::OpReadSuper:      return MethodInstruction(chunk, InstructionInfo{"OpReadSuper", instruction, offset});
     case OpCode::OpCall:           return ByteInstruction(chunk, InstructionInfo{"OpCall", instruction, offset});
+    case OpCode::OpIntrinsic:      return IntrinsicInstruction(chunk, InstructionInfo{"OpIntrinsic", instruction, offset});
     case OpCode::OpInvoke:         return ByteInstruction(chunk, InstructionInfo{"OpInvoke", instruction, offset});
     case OpCode::OpInvokeSuper:    return ByteInstruction(chunk, InstructionInfo{"OpInvokeSuper", instruction, offset});
     case OpCode::OpCollection:     return SimpleInstruction(chunk, InstructionInfo{"OpCollection", instruction, offset});
@@ -257,6 +271,16 @@ u32 Disassembler::ByteInstruction(const Chunk& chunk, const InstructionInfo& inf
     return info.Offset + 2;
 }
 
+u32 Disassembler::IntrinsicInstruction(const Chunk& chunk, const InstructionInfo& info)
+{
+    std::cout << std::format("[0x{:02x}] {:<20} ", info.Instruction, info.OpName);
+    u8 intrinsic = chunk.m_Code[info.Offset + 1];
+    u8 argc = chunk.m_Code[info.Offset + 2];
+    std::cout << std::format("[0x{:02x}] [0x{:02x}]\n", intrinsic, argc);
+    s_State.LastOpCode = static_cast<OpCode>(info.Instruction);
+    return info.Offset + 3;
+}
+
 u32 Disassembler::IntInstruction(const Chunk& chunk, const InstructionInfo& info)
 {
     std::cout << std::format("[0x{:02x}] {:<20} ", info.Instruction, info.OpName);
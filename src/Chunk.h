@@ -15,10 +15,12 @@ struct RunLengthLines
 
 class Chunk
 {
+    friend class BytecodeFile;
     friend class Disassembler;
     friend class VirtualMachine;
     friend class Compiler;
     friend class GarbageCollector;
+    friend class HeapImage;
 public:
     Chunk(const std::string& name = "Default");
     void AddByte(u8 byte, u32 line);
@@ -71,6 +73,7 @@ private:
     static u32 NameInstructionByte(const Chunk& chunk, const InstructionInfo& info);
     static u32 NameInstructionInt(const Chunk& chunk, const InstructionInfo& info);
     static u32 ByteInstruction(const Chunk& chunk, const InstructionInfo& info);
+    static u32 IntrinsicInstruction(const Chunk& chunk, const InstructionInfo& info);
     static u32 IntInstruction(const Chunk& chunk, const InstructionInfo& info);
     static u32 JumpInstruction(const Chunk& chunk, const InstructionInfo& info);
     static u32 ClosureInstruction(const Chunk& chunk, const InstructionInfo& info);
@@ -0,0 +1,88 @@
+﻿#include "CsvIndex.h"
+
+#include <bit>
+#include <cstring>
+
+#include "Simd.h"
+
+bool CsvIndex::Build(std::string_view text, char delimiter, std::vector<u32>& indices)
+{
+    indices.clear();
+#ifdef BCVM_SIMD_X64
+    BlockMasks (*classify)(const char*, char) = Simd::HasAvx2() ? ClassifyAvx2 : ClassifySse2;
+#else
+    BlockMasks (*classify)(const char*, char) = ClassifyScalar;
+#endif
+    // all ones, if the previous block ended inside of a quoted field
+    u64 prevInQuotes = 0;
+    char tail[BLOCK_SIZE];
+    for (usize offset = 0; offset < text.size(); offset += BLOCK_SIZE)
+    {
+        const char* block = text.data() + offset;
+        u64 valid = ~0llu;
+        if (text.size() - offset < BLOCK_SIZE)
+        {
+            // delimiter can be any byte, so the padding of the last block is masked out instead
+            std::memset(tail, 0, BLOCK_SIZE);
+            std::memcpy(tail, block, text.size() - offset);
+            block = tail;
+            valid = (1llu << (text.size() - offset)) - 1;
+        }
+        BlockMasks masks = classify(block, delimiter);
+        u64 inQuotes = Simd::PrefixXor(masks.Quote & valid) ^ prevInQuotes;
+        prevInQuotes = (u64)((i64)inQuotes >> 63);
+        u64 separators = masks.Separator & ~inQuotes & valid;
+
+        usize count = indices.size();
+        indices.resize(count + std::popcount(separators));
+        for (; separators != 0; separators &= separators - 1)
+        {
+            indices[count++] = (u32)(offset + std::countr_zero(separators));
+        }
+    }
+    return prevInQuotes == 0;
+}
+
+CsvIndex::BlockMasks CsvIndex::ClassifyScalar(const char* block, char delimiter)
+{
+    BlockMasks masks = {};
+    for (u32 i = 0; i < BLOCK_SIZE; i++)
+    {
+        u64 bit = 1llu << i;
+        if (block[i] == '"') masks.Quote |= bit;
+        if (block[i] == delimiter || block[i] == '\n') masks.Separator |= bit;
+    }
+    return masks;
+}
+
+#ifdef BCVM_SIMD_X64
+
+CsvIndex::BlockMasks CsvIndex::ClassifySse2(const char* block, char delimiter)
+{
+    BlockMasks masks = {};
+    for (u32 i = 0; i < BLOCK_SIZE; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i separator = _mm_or_si128(
+            _mm_cmpeq_epi8(chunk, _mm_set1_epi8(delimiter)), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+        masks.Quote |= (u64)(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))) << i;
+        masks.Separator |= (u64)(u32)_mm_movemask_epi8(separator) << i;
+    }
+    return masks;
+}
+
+BCVM_TARGET_AVX2 CsvIndex::BlockMasks CsvIndex::ClassifyAvx2(const char* block, char delimiter)
+{
+    BlockMasks masks = {};
+    for (u32 i = 0; i < BLOCK_SIZE; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(block + i));
+        __m256i separator = _mm256_or_si256(
+            _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(delimiter)), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')));
+        masks.Quote |= (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'))) << i;
+        masks.Separator |= (u64)(u32)_mm256_movemask_epi8(separator) << i;
+    }
+    return masks;
+}
+
+#endif
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "Types.h"
+
+// positions of delimiters and line feeds, that are not inside of quoted fields, found 64 bytes at a time;
+// an escaped quote (`""`) toggles the quoted state twice, so it needs no special handling
+class CsvIndex
+{
+public:
+    // replaces contents of `indices`, `text` has to start outside of quotes;
+    // returns false if it ends inside of a quoted field
+    static bool Build(std::string_view text, char delimiter, std::vector<u32>& indices);
+private:
+    // bit `i` is set, if byte `i` of a 64 byte block belongs to the class
+    struct BlockMasks
+    {
+        u64 Quote{0};
+        // delimiters and line feeds
+        u64 Separator{0};
+    };
+    static BlockMasks ClassifyScalar(const char* block, char delimiter);
+    static BlockMasks ClassifySse2(const char* block, char delimiter);
+    static BlockMasks ClassifyAvx2(const char* block, char delimiter);
+
+    static constexpr usize BLOCK_SIZE = 64;
+};
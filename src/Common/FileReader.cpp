@@ -0,0 +1,62 @@
+﻿#include "FileReader.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+#ifdef _MSC_VER
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+FileReader::~FileReader()
+{
+    Close();
+}
+
+bool FileReader::Open(std::string_view path)
+{
+    Close();
+#ifdef _MSC_VER
+    m_Descriptor = _open(std::string{path}.c_str(), _O_RDONLY | _O_BINARY | _O_SEQUENTIAL);
+#else
+    m_Descriptor = open(std::string{path}.c_str(), O_RDONLY);
+#endif
+    return IsOpen();
+}
+
+void FileReader::OpenStdin()
+{
+    Close();
+    m_Descriptor = 0;
+    m_IsStdin = true;
+}
+
+usize FileReader::Read(char* buffer, usize size)
+{
+    if (!IsOpen()) return 0;
+#ifdef _MSC_VER
+    i64 read = _read(m_Descriptor, buffer, (u32)std::min<usize>(size, std::numeric_limits<i32>::max()));
+#else
+    i64 read = ::read(m_Descriptor, buffer, size);
+#endif
+    return read > 0 ? (usize)read : 0;
+}
+
+void FileReader::Close()
+{
+    // stdin is not ours to close
+    if (IsOpen() && !m_IsStdin)
+    {
+#ifdef _MSC_VER
+        _close(m_Descriptor);
+#else
+        close(m_Descriptor);
+#endif
+    }
+    m_Descriptor = -1;
+    m_IsStdin = false;
+}
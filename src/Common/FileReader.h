@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include <string_view>
+
+#include "Types.h"
+
+// unbuffered reads from a file or stdin, each read returns what is available at the moment
+// (a line for console input, pipe contents for pipes, and as much as asked for regular files)
+class FileReader
+{
+public:
+    FileReader() = default;
+    ~FileReader();
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+    bool Open(std::string_view path);
+    void OpenStdin();
+    // returns number of bytes read, 0 once the file is over (or on error)
+    usize Read(char* buffer, usize size);
+    void Close();
+    bool IsOpen() const { return m_Descriptor >= 0; }
+    bool IsStdin() const { return m_IsStdin; }
+private:
+    i32 m_Descriptor{-1};
+    bool m_IsStdin{false};
+};
@@ -0,0 +1,129 @@
+﻿#include "JsonIndex.h"
+
+#include <bit>
+#include <cstring>
+
+#include "Simd.h"
+
+bool JsonIndex::Build(std::string_view json, std::vector<u32>& indices)
+{
+    indices.clear();
+#ifdef BCVM_SIMD_X64
+    BlockMasks (*classify)(const char*) = Simd::HasAvx2() ? ClassifyAvx2 : ClassifySse2;
+#else
+    BlockMasks (*classify)(const char*) = ClassifyScalar;
+#endif
+    u64 prevEscaped = 0;
+    // all ones, if the previous block ended inside of a string
+    u64 prevInString = 0;
+    u64 prevScalar = 0;
+    char tail[BLOCK_SIZE];
+    for (usize offset = 0; offset < json.size(); offset += BLOCK_SIZE)
+    {
+        const char* block = json.data() + offset;
+        if (json.size() - offset < BLOCK_SIZE)
+        {
+            // the last block is padded with whitespace
+            std::memset(tail, ' ', BLOCK_SIZE);
+            std::memcpy(tail, block, json.size() - offset);
+            block = tail;
+        }
+        BlockMasks masks = classify(block);
+        u64 quote = masks.Quote & ~FindEscaped(masks.Backslash, prevEscaped);
+        // set for opening quotes and string contents, but not for closing quotes
+        u64 inString = Simd::PrefixXor(quote) ^ prevInString;
+        prevInString = (u64)((i64)inString >> 63);
+        u64 scalar = ~(masks.Operator | masks.Whitespace | quote | inString);
+        u64 scalarStart = scalar & ~(scalar << 1 | prevScalar);
+        prevScalar = scalar >> 63;
+        u64 structural = (masks.Operator & ~inString) | (quote & inString) | scalarStart;
+
+        usize count = indices.size();
+        indices.resize(count + std::popcount(structural));
+        for (; structural != 0; structural &= structural - 1)
+        {
+            indices[count++] = (u32)(offset + std::countr_zero(structural));
+        }
+    }
+    return prevInString == 0;
+}
+
+JsonIndex::BlockMasks JsonIndex::ClassifyScalar(const char* block)
+{
+    BlockMasks masks = {};
+    for (u32 i = 0; i < BLOCK_SIZE; i++)
+    {
+        u64 bit = 1llu << i;
+        switch (block[i])
+        {
+        case '\\': masks.Backslash |= bit; break;
+        case '"': masks.Quote |= bit; break;
+        case '{': case '}': case '[': case ']': case ':': case ',': masks.Operator |= bit; break;
+        case ' ': case '\t': case '\n': case '\r': masks.Whitespace |= bit; break;
+        default: break;
+        }
+    }
+    return masks;
+}
+
+u64 JsonIndex::FindEscaped(u64 backslash, u64& prevEscaped)
+{
+    // a backslash, that is escaped itself, does not escape anything
+    backslash &= ~prevEscaped;
+    u64 followsEscape = backslash << 1 | prevEscaped;
+    // runs of backslashes, that start on an odd bit, end on an even bit if they are of odd length
+    // (and the other way around), so the carry of the addition marks the byte after each run
+    constexpr u64 evenBits = 0x5555555555555555llu;
+    u64 oddSequenceStarts = backslash & ~evenBits & ~followsEscape;
+    u64 sequencesStartingOnEvenBits = oddSequenceStarts + backslash;
+    prevEscaped = sequencesStartingOnEvenBits < oddSequenceStarts ? 1 : 0;
+    u64 invertMask = sequencesStartingOnEvenBits << 1;
+    return (evenBits ^ invertMask) & followsEscape;
+}
+
+#ifdef BCVM_SIMD_X64
+
+// `{}` and `[]` differ only in bit 5, so each pair is matched with one comparison
+JsonIndex::BlockMasks JsonIndex::ClassifySse2(const char* block)
+{
+    BlockMasks masks = {};
+    for (u32 i = 0; i < BLOCK_SIZE; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))));
+        __m128i whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+        masks.Backslash |= (u64)(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))) << i;
+        masks.Quote |= (u64)(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))) << i;
+        masks.Operator |= (u64)(u32)_mm_movemask_epi8(op) << i;
+        masks.Whitespace |= (u64)(u32)_mm_movemask_epi8(whitespace) << i;
+    }
+    return masks;
+}
+
+BCVM_TARGET_AVX2 JsonIndex::BlockMasks JsonIndex::ClassifyAvx2(const char* block)
+{
+    BlockMasks masks = {};
+    for (u32 i = 0; i < BLOCK_SIZE; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(block + i));
+        __m256i lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(','))));
+        __m256i whitespace = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))));
+        masks.Backslash |= (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))) << i;
+        masks.Quote |= (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'))) << i;
+        masks.Operator |= (u64)(u32)_mm256_movemask_epi8(op) << i;
+        masks.Whitespace |= (u64)(u32)_mm256_movemask_epi8(whitespace) << i;
+    }
+    return masks;
+}
+
+#endif
@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "Types.h"
+
+// first stage of json parsing: positions of structural characters (`{}[]:,`), of opening quotes
+// and of the first bytes of other scalars, that are not inside of strings, found 64 bytes at a time
+class JsonIndex
+{
+public:
+    // replaces contents of `indices`, returns false if the last string is not terminated
+    static bool Build(std::string_view json, std::vector<u32>& indices);
+private:
+    // bit `i` is set, if byte `i` of a 64 byte block belongs to the class
+    struct BlockMasks
+    {
+        u64 Backslash{0};
+        u64 Quote{0};
+        u64 Operator{0};
+        u64 Whitespace{0};
+    };
+    static BlockMasks ClassifyScalar(const char* block);
+    static BlockMasks ClassifySse2(const char* block);
+    static BlockMasks ClassifyAvx2(const char* block);
+    // bytes, that follow an odd number of backslashes
+    static u64 FindEscaped(u64 backslash, u64& prevEscaped);
+    
+    static constexpr usize BLOCK_SIZE = 64;
+};
@@ -0,0 +1,80 @@
+﻿#include "MappedFile.h"
+
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(std::string_view path)
+{
+    Close();
+    HANDLE file = CreateFileA(std::string{path}.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    m_File = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) return false;
+    m_Size = (usize)size.QuadPart;
+    // empty files cannot be mapped, but they are perfectly fine to read
+    if (m_Size == 0) return true;
+    m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_Mapping == nullptr) return false;
+    m_Data = (const char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    return m_Data != nullptr;
+}
+
+void MappedFile::Close()
+{
+    if (m_Data) UnmapViewOfFile(m_Data);
+    if (m_Mapping) CloseHandle(m_Mapping);
+    if (m_File) CloseHandle(m_File);
+    m_Data = nullptr;
+    m_Mapping = m_File = nullptr;
+    m_Size = 0;
+}
+#else
+bool MappedFile::Open(std::string_view path)
+{
+    Close();
+    i32 file = open(std::string{path}.c_str(), O_RDONLY);
+    if (file < 0) return false;
+    struct stat info;
+    if (fstat(file, &info) != 0)
+    {
+        close(file);
+        return false;
+    }
+    m_Size = (usize)info.st_size;
+    // empty files cannot be mapped, but they are perfectly fine to read
+    void* data = m_Size == 0 ? nullptr : mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+    // the mapping keeps the file open by itself
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        m_Size = 0;
+        return false;
+    }
+    m_Data = (const char*)data;
+    if (m_Data) madvise(data, m_Size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_Data) munmap((void*)m_Data, m_Size);
+    m_Data = nullptr;
+    m_Size = 0;
+}
+#endif
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <string_view>
+
+#include "Types.h"
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    // false if the file cannot be opened or mapped
+    bool Open(std::string_view path);
+    const char* GetData() const { return m_Data; }
+    usize GetSize() const { return m_Size; }
+    std::string_view GetView() const { return {m_Data, m_Size}; }
+private:
+    void Close();
+private:
+    const char* m_Data{nullptr};
+    usize m_Size{0};
+#ifdef _WIN32
+    void* m_File{nullptr};
+    void* m_Mapping{nullptr};
+#endif
+};
@@ -0,0 +1,35 @@
+﻿#include "NumberFormat.h"
+
+#include <charconv>
+#include <cmath>
+
+u32 NumberFormat::Write(char* buffer, f64 val)
+{
+    // whole numbers skip the search for the shortest digits, unless exponent form is shorter
+    // (`to_chars` prefers it then, e.g. `1e+05` for 100000), and except for negative zero
+    if (val == std::trunc(val) && std::abs(val) < MAX_EXACT_INTEGER && (val != 0 || !std::signbit(val)))
+    {
+        i64 integer = (i64)val;
+        u64 magnitude = (u64)(integer < 0 ? -integer : integer);
+        u32 digits = 1;
+        u32 trailingZeros = 0;
+        bool isTrailing = true;
+        for (u64 rest = magnitude; rest >= 10; rest /= 10)
+        {
+            isTrailing = isTrailing && rest % 10 == 0;
+            trailingZeros += isTrailing;
+            digits++;
+        }
+        u32 significant = digits - trailingZeros;
+        // mantissa, point (if mantissa has several digits) and two-digit exponent `e+XX`
+        u32 exponentLength = significant + (significant > 1) + 4;
+        if (magnitude == 0 || digits <= exponentLength)
+            return (u32)(std::to_chars(buffer, buffer + BUFFER_SIZE, integer).ptr - buffer);
+    }
+    return (u32)(std::to_chars(buffer, buffer + BUFFER_SIZE, val).ptr - buffer);
+}
+
+u32 NumberFormat::Write(char* buffer, i32 val)
+{
+    return (u32)(std::to_chars(buffer, buffer + BUFFER_SIZE, val).ptr - buffer);
+}
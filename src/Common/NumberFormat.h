@@ -0,0 +1,18 @@
+﻿#pragma once
+
+#include "Types.h"
+
+// numbers to text into caller's buffer, same text as `std::format("{}", val)` gives
+// (shortest round-trip representation), but without temporary strings
+class NumberFormat
+{
+public:
+    // fits any f64 or i32
+    static constexpr u32 BUFFER_SIZE = 32;
+    // returns length of the text
+    static u32 Write(char* buffer, f64 val);
+    static u32 Write(char* buffer, i32 val);
+private:
+    // whole numbers below are exactly representable, and are written as integers
+    static constexpr f64 MAX_EXACT_INTEGER = 9007199254740992.0;
+};
@@ -18,6 +18,9 @@ public:
     Value& operator[](ObjHandle obj);
 
     void Set(ObjHandle obj, Value value);
+    // calls `fn(ObjHandle key, const Value& value)` for each element
+    template <typename Fn>
+    void ForEach(Fn&& fn) const;
 private:
     ObjHandle GetKey(u64 index);
     const Value& GetValue(u64 index);
@@ -69,6 +72,15 @@ inline void ObjSparseSet::Set(ObjHandle obj, Value value)
     }
 }
 
+template <typename Fn>
+void ObjSparseSet::ForEach(Fn&& fn) const
+{
+    for (u64 i = 0; i < m_Sparse.size(); i++)
+    {
+        if (m_Sparse[i] != SPARSE_NONE) fn(ObjHandle{i}, m_Dense[m_Sparse[i]]);
+    }
+}
+
 inline ObjHandle ObjSparseSet::GetKey(u64 index)
 {
     return ObjHandle{index};
@@ -0,0 +1,68 @@
+﻿#include "OutputBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+OutputBuffer::OutputBuffer()
+{
+    m_Buffer.reserve(CAPACITY);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    Flush();
+}
+
+void OutputBuffer::Write(std::string_view text)
+{
+    if (m_Buffer.size() + text.size() > CAPACITY) Flush();
+    usize from = m_Buffer.size();
+    m_Buffer.append(text);
+    Commit(from);
+}
+
+void OutputBuffer::VFormat(std::string_view format, std::format_args args)
+{
+    usize from = m_Buffer.size();
+    std::vformat_to(std::back_inserter(m_Buffer), format, args);
+    Commit(from);
+}
+
+void OutputBuffer::Flush()
+{
+    // log messages go through `std::cout`, they shall not overtake the output, nor be overtaken by it
+    std::cout.flush();
+    const char* data = m_Buffer.data();
+    usize left = m_Buffer.size();
+    while (left > 0)
+    {
+#ifdef _MSC_VER
+        i64 written = _write(1, data, (u32)std::min(left, CAPACITY));
+#else
+        i64 written = write(1, data, left);
+#endif
+        if (written <= 0) break;
+        data += written;
+        left -= (usize)written;
+    }
+    m_Buffer.clear();
+}
+
+void OutputBuffer::SetMode(Mode mode)
+{
+    m_Mode = mode;
+    if (m_Mode == Mode::Line) Flush();
+}
+
+void OutputBuffer::Commit(usize from)
+{
+    bool isLineDone = m_Mode == Mode::Line && std::memchr(m_Buffer.data() + from, '\n', m_Buffer.size() - from) != nullptr;
+    if (isLineDone || m_Buffer.size() >= CAPACITY) Flush();
+}
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <format>
+#include <string>
+#include <string_view>
+
+#include "Types.h"
+
+// program output of `print()` and friends, written to stdout in large chunks:
+// when the buffer is full, on `Flush()`, and, in line mode, once a line is complete
+class OutputBuffer
+{
+public:
+    enum class Mode { Line, Block };
+    OutputBuffer();
+    ~OutputBuffer();
+    void Write(std::string_view text);
+    void VFormat(std::string_view format, std::format_args args);
+    void Flush();
+    void SetMode(Mode mode);
+private:
+    // flushes, if the text appended since `from` requires so
+    void Commit(usize from);
+private:
+    static constexpr usize CAPACITY = 64 * 1024;
+    std::string m_Buffer;
+    Mode m_Mode{Mode::Block};
+};
@@ -1,10 +1,79 @@
 ﻿#include "Random.h"
 
-std::random_device Random::m_Device;
-std::mt19937 Random::m_Mt(Random::m_Device());
-std::uniform_real_distribution<> Random::m_UniformNormalizedReal(0.0, 1.0);
+#include <random>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+Random::Random()
+{
+    std::random_device device;
+    Seed((u64)device() << 32 | device());
+}
+
+void Random::Seed(u64 seed)
+{
+    for (auto& state : m_State) state = SplitMix64(seed);
+}
+
+u64 Random::U64()
+{
+    u64 result = Rotl(m_State[0] + m_State[3], 23) + m_State[0];
+    u64 t = m_State[1] << 17;
+    m_State[2] ^= m_State[0];
+    m_State[3] ^= m_State[1];
+    m_State[1] ^= m_State[2];
+    m_State[0] ^= m_State[3];
+    m_State[2] ^= t;
+    m_State[3] = Rotl(m_State[3], 45);
+    return result;
+}
 
 f64 Random::F64()
 {
-    return m_UniformNormalizedReal(m_Mt);
+    return (f64)(U64() >> 11) * 0x1.0p-53;
+}
+
+u64 Random::Bounded(u64 bound)
+{
+    // multiply-shift maps 64 random bits to [0, bound), the rejection removes the bias
+    u64 high;
+    u64 low = MulFull(U64(), bound, high);
+    if (low < bound)
+    {
+        u64 threshold = (0 - bound) % bound;
+        while (low < threshold) low = MulFull(U64(), bound, high);
+    }
+    return high;
+}
+
+void Random::Fill(f64* data, u32 count, f64 min, f64 max)
+{
+    f64 range = max - min;
+    for (u32 i = 0; i < count; i++) data[i] = min + range * F64();
+}
+
+u64 Random::MulFull(u64 a, u64 b, u64& high)
+{
+#ifdef _MSC_VER
+    return _umul128(a, b, &high);
+#else
+    unsigned __int128 product = (unsigned __int128)a * b;
+    high = (u64)(product >> 64);
+    return (u64)product;
+#endif
+}
+
+u64 Random::Rotl(u64 x, u32 k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+u64 Random::SplitMix64(u64& state)
+{
+    u64 z = (state += 0x9e3779b97f4a7c15llu);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9llu;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebllu;
+    return z ^ (z >> 31);
 }
@@ -1,14 +1,29 @@
 ﻿#pragma once
-#include <random>
+
+#include <array>
 
 #include "Types.h"
 
+// xoshiro256++ generator, every vm owns one, so scripts can seed it and get reproducible runs
 class Random
 {
 public:
-    static f64 F64();
+    // seeded from `std::random_device`
+    Random();
+    // state is expanded from `seed` by splitmix64, so any seed (0 included) is fine
+    void Seed(u64 seed);
+    u64 U64();
+    // uniform in [0, 1), 53 bits of precision
+    f64 F64();
+    // uniform in [0, bound), `bound` has to be positive; unbiased (Lemire's method)
+    u64 Bounded(u64 bound);
+    // fills with samples of `F64()` scaled to [min, max)
+    void Fill(f64* data, u32 count, f64 min, f64 max);
+private:
+    // 128-bit product, returns the low half
+    static u64 MulFull(u64 a, u64 b, u64& high);
+    static u64 Rotl(u64 x, u32 k);
+    static u64 SplitMix64(u64& state);
 private:
-    static std::random_device m_Device;
-    static std::mt19937 m_Mt;
-    static std::uniform_real_distribution<> m_UniformNormalizedReal;
+    std::array<u64, 4> m_State{};
 };
@@ -0,0 +1,43 @@
+﻿#include "Simd.h"
+
+#include "Core.h"
+
+#if defined(BCVM_SIMD_X64) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+bool Simd::HasAvx2()
+{
+    static const bool hasAvx2 = DetectAvx2();
+    return hasAvx2;
+}
+
+u64 Simd::PrefixXor(u64 bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+bool Simd::DetectAvx2()
+{
+#if defined(BCVM_SIMD_X64) && defined(_MSC_VER)
+    i32 info[4];
+    __cpuid(info, 1);
+    bool osUsesXSave = (info[2] & Bit(27)) != 0;
+    bool hasAvx = (info[2] & Bit(28)) != 0;
+    if (!(osUsesXSave && hasAvx)) return false;
+    // os has to save ymm registers on context switch
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & Bit(5)) != 0;
+#elif defined(BCVM_SIMD_X64)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
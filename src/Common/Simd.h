@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include "Types.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+    #define BCVM_SIMD_X64
+    #include <immintrin.h>
+#endif
+
+// msvc allows avx2 intrinsics in any function, gcc and clang need them to be enabled per function
+#if defined(BCVM_SIMD_X64) && !defined(_MSC_VER)
+    #define BCVM_TARGET_AVX2 __attribute__((target("avx2,fma,popcnt,bmi")))
+#else
+    #define BCVM_TARGET_AVX2
+#endif
+
+class Simd
+{
+public:
+    // sse2 is a part of x86_64, so only avx2 has to be checked at runtime
+    static bool HasAvx2();
+    // bit `i` is xor of bits `0..i`: turns a mask of quotes into a mask of quoted regions
+    static u64 PrefixXor(u64 bits);
+private:
+    static bool DetectAvx2();
+};
@@ -0,0 +1,130 @@
+﻿#pragma once
+
+#include <bit>
+#include <utility>
+
+#include "Types.h"
+
+// introsort, that never leaves the range, even if `less` is not a strict weak ordering
+// (comparators may come from scripts and be anything)
+class Sort
+{
+public:
+    template <typename T, typename Less>
+    static void Introsort(T* data, usize count, Less&& less);
+private:
+    static constexpr usize INSERTION_SORT_THRESHOLD = 16;
+    
+    template <typename T, typename Less>
+    static void IntrosortLoop(T* data, usize first, usize last, u32 depthLimit, Less& less);
+    // returns final position of the pivot, which is chosen as a median of three
+    template <typename T, typename Less>
+    static usize Partition(T* data, usize first, usize last, Less& less);
+    template <typename T, typename Less>
+    static void InsertionSort(T* data, usize first, usize last, Less& less);
+    template <typename T, typename Less>
+    static void HeapSort(T* data, usize first, usize last, Less& less);
+    template <typename T, typename Less>
+    static void SiftDown(T* data, usize root, usize count, Less& less);
+};
+
+template <typename T, typename Less>
+void Sort::Introsort(T* data, usize count, Less&& less)
+{
+    if (count < 2) return;
+    u32 depthLimit = 2 * (u32)std::bit_width(count);
+    IntrosortLoop(data, 0, count, depthLimit, less);
+}
+
+template <typename T, typename Less>
+void Sort::IntrosortLoop(T* data, usize first, usize last, u32 depthLimit, Less& less)
+{
+    while (last - first > INSERTION_SORT_THRESHOLD)
+    {
+        if (depthLimit == 0)
+        {
+            HeapSort(data, first, last, less);
+            return;
+        }
+        depthLimit--;
+        usize pivot = Partition(data, first, last, less);
+        // recurse into the smaller part, so the depth of recursion stays logarithmic
+        if (pivot - first < last - pivot)
+        {
+            IntrosortLoop(data, first, pivot, depthLimit, less);
+            first = pivot + 1;
+        }
+        else
+        {
+            IntrosortLoop(data, pivot + 1, last, depthLimit, less);
+            last = pivot;
+        }
+    }
+    InsertionSort(data, first, last, less);
+}
+
+template <typename T, typename Less>
+usize Sort::Partition(T* data, usize first, usize last, Less& less)
+{
+    usize mid = first + (last - first) / 2;
+    if (less(data[mid], data[first])) std::swap(data[mid], data[first]);
+    if (less(data[last - 1], data[mid])) std::swap(data[last - 1], data[mid]);
+    if (less(data[mid], data[first])) std::swap(data[mid], data[first]);
+    std::swap(data[first], data[mid]);
+
+    const T pivot = data[first];
+    usize i = first;
+    usize j = last;
+    for (;;)
+    {
+        while (less(data[++i], pivot))
+            if (i == last - 1) break;
+        while (less(pivot, data[--j]))
+            if (j == first) break;
+        if (i >= j) break;
+        std::swap(data[i], data[j]);
+    }
+    std::swap(data[first], data[j]);
+    return j;
+}
+
+template <typename T, typename Less>
+void Sort::InsertionSort(T* data, usize first, usize last, Less& less)
+{
+    for (usize i = first + 1; i < last; i++)
+    {
+        T val = data[i];
+        usize j = i;
+        for (; j > first && less(val, data[j - 1]); j--)
+            data[j] = data[j - 1];
+        data[j] = val;
+    }
+}
+
+template <typename T, typename Less>
+void Sort::HeapSort(T* data, usize first, usize last, Less& less)
+{
+    T* heap = data + first;
+    usize count = last - first;
+    for (usize i = count / 2; i > 0; i--)
+        SiftDown(heap, i - 1, count, less);
+    for (usize end = count - 1; end > 0; end--)
+    {
+        std::swap(heap[0], heap[end]);
+        SiftDown(heap, 0, end, less);
+    }
+}
+
+template <typename T, typename Less>
+void Sort::SiftDown(T* data, usize root, usize count, Less& less)
+{
+    for (;;)
+    {
+        usize child = 2 * root + 1;
+        if (child >= count) return;
+        if (child + 1 < count && less(data[child], data[child + 1])) child++;
+        if (!less(data[root], data[child])) return;
+        std::swap(data[root], data[child]);
+        root = child;
+    }
+}
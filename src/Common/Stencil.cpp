@@ -0,0 +1,47 @@
+﻿#include "Stencil.h"
+
+#include <vector>
+
+void Stencil::NeighbourSum(const f64* src, u32 srcStride, f64* dst, u32 dstStride, u32 height, u32 width)
+{
+    if (height == 0 || width == 0) return;
+    // vertical sums of 3 rows, with one wrapped column on each side
+    std::vector<f64> columns(width + 2);
+    for (u32 y = 0; y < height; y++)
+    {
+        const f64* up = src + (u64)((y + height - 1) % height) * srcStride;
+        const f64* mid = src + (u64)y * srcStride;
+        const f64* down = src + (u64)((y + 1) % height) * srcStride;
+        for (u32 x = 0; x < width; x++) columns[x + 1] = up[x] + mid[x] + down[x];
+        columns[0] = columns[width];
+        columns[width + 1] = columns[1];
+        f64* out = dst + (u64)y * dstStride;
+        for (u32 x = 0; x < width; x++) out[x] = columns[x] + columns[x + 1] + columns[x + 2] - mid[x];
+    }
+}
+
+void Stencil::Convolve(const f64* src, u32 srcStride, f64* dst, u32 dstStride, u32 height, u32 width,
+    const f64* kernel, u32 kernelStride, u32 kernelHeight, u32 kernelWidth)
+{
+    if (height == 0 || width == 0) return;
+    for (u32 y = 0; y < height; y++)
+    {
+        f64* out = dst + (u64)y * dstStride;
+        for (u32 ky = 0; ky < kernelHeight; ky++)
+        {
+            i64 rowShift = (i64)ky - kernelHeight / 2;
+            u32 srcY = (u32)((((i64)y + rowShift) % height + height) % height);
+            const f64* row = src + (u64)srcY * srcStride;
+            for (u32 kx = 0; kx < kernelWidth; kx++)
+            {
+                f64 weight = kernel[(u64)ky * kernelStride + kx];
+                i64 columnShift = (i64)kx - kernelWidth / 2;
+                u32 shift = (u32)((columnShift % width + width) % width);
+                // out[x] += weight * row[(x + shift) % width], split in two runs without modulo
+                u32 split = width - shift;
+                for (u32 x = 0; x < split; x++) out[x] += weight * row[x + shift];
+                for (u32 x = split; x < width; x++) out[x] += weight * row[x - split];
+            }
+        }
+    }
+}
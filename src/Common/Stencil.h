@@ -0,0 +1,15 @@
+﻿#pragma once
+
+#include "Types.h"
+
+// 2d kernels over row-major planes of numbers, that wrap around the edges (toroidal),
+// consecutive rows are `stride` values apart, values within a row are contiguous
+class Stencil
+{
+public:
+    // dst = sum of 8 (moore) neighbours of every cell of src
+    static void NeighbourSum(const f64* src, u32 srcStride, f64* dst, u32 dstStride, u32 height, u32 width);
+    // dst += kernel applied to src, kernel is centered at (kernelHeight / 2, kernelWidth / 2)
+    static void Convolve(const f64* src, u32 srcStride, f64* dst, u32 dstStride, u32 height, u32 width,
+        const f64* kernel, u32 kernelStride, u32 kernelHeight, u32 kernelWidth);
+};
@@ -0,0 +1,196 @@
+﻿#include "StringSearch.h"
+
+#include <bit>
+#include <cstring>
+
+#include "Simd.h"
+
+usize StringSearch::FindByte(const char* data, usize size, char byte)
+{
+#ifdef BCVM_SIMD_X64
+    if (Simd::HasAvx2()) return FindByteAvx2(data, size, byte);
+    return FindByteSse2(data, size, byte);
+#else
+    return FindByteScalar(data, size, byte);
+#endif
+}
+
+usize StringSearch::Find(std::string_view haystack, std::string_view needle, usize from)
+{
+    if (from > haystack.size() || needle.size() > haystack.size() - from) return NPOS;
+    if (needle.empty()) return from;
+    
+    const char* data = haystack.data() + from;
+    usize size = haystack.size() - from;
+    usize index;
+    if (needle.size() == 1)
+    {
+        index = FindByte(data, size, needle[0]);
+    }
+    else
+    {
+#ifdef BCVM_SIMD_X64
+        if (Simd::HasAvx2()) index = FindAvx2(data, size, needle);
+        else index = FindSse2(data, size, needle);
+#else
+        index = FindScalar(data, size, needle);
+#endif
+    }
+    return index == NPOS ? NPOS : index + from;
+}
+
+usize StringSearch::Count(std::string_view haystack, std::string_view needle)
+{
+    if (needle.empty()) return 0;
+    if (needle.size() == 1)
+    {
+#ifdef BCVM_SIMD_X64
+        if (Simd::HasAvx2()) return CountByteAvx2(haystack.data(), haystack.size(), needle[0]);
+        return CountByteSse2(haystack.data(), haystack.size(), needle[0]);
+#else
+        return CountByteScalar(haystack.data(), haystack.size(), needle[0]);
+#endif
+    }
+    usize count = 0;
+    for (usize index = Find(haystack, needle); index != NPOS; index = Find(haystack, needle, index + needle.size()))
+    {
+        count++;
+    }
+    return count;
+}
+
+usize StringSearch::FindByteScalar(const char* data, usize size, char byte)
+{
+    const void* found = std::memchr(data, byte, size);
+    return found == nullptr ? NPOS : (usize)((const char*)found - data);
+}
+
+usize StringSearch::FindScalar(const char* data, usize size, std::string_view needle)
+{
+    std::string_view haystack{data, size};
+    usize index = haystack.find(needle);
+    return index == std::string_view::npos ? NPOS : index;
+}
+
+usize StringSearch::CountByteScalar(const char* data, usize size, char byte)
+{
+    usize count = 0;
+    for (usize i = 0; i < size; i++) count += data[i] == byte;
+    return count;
+}
+
+#ifdef BCVM_SIMD_X64
+
+usize StringSearch::FindByteSse2(const char* data, usize size, char byte)
+{
+    const __m128i pattern = _mm_set1_epi8(byte);
+    usize i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern));
+        if (mask != 0) return i + std::countr_zero(mask);
+    }
+    usize tail = FindByteScalar(data + i, size - i, byte);
+    return tail == NPOS ? NPOS : i + tail;
+}
+
+BCVM_TARGET_AVX2 usize StringSearch::FindByteAvx2(const char* data, usize size, char byte)
+{
+    const __m256i pattern = _mm256_set1_epi8(byte);
+    usize i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+        __m256i first = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i second = _mm256_loadu_si256((const __m256i*)(data + i + 32));
+        u64 mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(first, pattern)) |
+            (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(second, pattern)) << 32;
+        if (mask != 0) return i + std::countr_zero(mask);
+    }
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pattern));
+        if (mask != 0) return i + std::countr_zero(mask);
+    }
+    usize tail = FindByteScalar(data + i, size - i, byte);
+    return tail == NPOS ? NPOS : i + tail;
+}
+
+// compares the first and the last byte of `needle` at 16 (32) positions at once,
+// and verifies only the positions, where both of them match
+usize StringSearch::FindSse2(const char* data, usize size, std::string_view needle)
+{
+    const usize last = needle.size() - 1;
+    const __m128i firstPattern = _mm_set1_epi8(needle[0]);
+    const __m128i lastPattern = _mm_set1_epi8(needle[last]);
+    usize i = 0;
+    for (; i + last + 16 <= size; i += 16)
+    {
+        __m128i firstChunk = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i lastChunk = _mm_loadu_si128((const __m128i*)(data + i + last));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(firstChunk, firstPattern),
+            _mm_cmpeq_epi8(lastChunk, lastPattern)));
+        while (mask != 0)
+        {
+            u32 bit = std::countr_zero(mask);
+            if (std::memcmp(data + i + bit + 1, needle.data() + 1, last - 1) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    usize tail = FindScalar(data + i, size - i, needle);
+    return tail == NPOS ? NPOS : i + tail;
+}
+
+BCVM_TARGET_AVX2 usize StringSearch::FindAvx2(const char* data, usize size, std::string_view needle)
+{
+    const usize last = needle.size() - 1;
+    const __m256i firstPattern = _mm256_set1_epi8(needle[0]);
+    const __m256i lastPattern = _mm256_set1_epi8(needle[last]);
+    usize i = 0;
+    for (; i + last + 32 <= size; i += 32)
+    {
+        __m256i firstChunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i lastChunk = _mm256_loadu_si256((const __m256i*)(data + i + last));
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(firstChunk, firstPattern),
+            _mm256_cmpeq_epi8(lastChunk, lastPattern)));
+        while (mask != 0)
+        {
+            u32 bit = std::countr_zero(mask);
+            if (std::memcmp(data + i + bit + 1, needle.data() + 1, last - 1) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    usize tail = FindScalar(data + i, size - i, needle);
+    return tail == NPOS ? NPOS : i + tail;
+}
+
+usize StringSearch::CountByteSse2(const char* data, usize size, char byte)
+{
+    const __m128i pattern = _mm_set1_epi8(byte);
+    usize count = 0;
+    usize i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        count += std::popcount((u32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern)));
+    }
+    return count + CountByteScalar(data + i, size - i, byte);
+}
+
+BCVM_TARGET_AVX2 usize StringSearch::CountByteAvx2(const char* data, usize size, char byte)
+{
+    const __m256i pattern = _mm256_set1_epi8(byte);
+    usize count = 0;
+    usize i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        count += std::popcount((u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pattern)));
+    }
+    return count + CountByteScalar(data + i, size - i, byte);
+}
+
+#endif
@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include <limits>
+#include <string_view>
+
+#include "Types.h"
+
+class StringSearch
+{
+public:
+    static constexpr usize NPOS = std::numeric_limits<usize>::max();
+    // returns index of the first `byte` in `data`, or NPOS
+    static usize FindByte(const char* data, usize size, char byte);
+    // returns index of the first `needle` in `haystack` at or after `from`, or NPOS
+    static usize Find(std::string_view haystack, std::string_view needle, usize from = 0);
+    // counts non-overlapping occurrences of `needle`
+    static usize Count(std::string_view haystack, std::string_view needle);
+private:
+    static usize FindByteScalar(const char* data, usize size, char byte);
+    static usize FindByteSse2(const char* data, usize size, char byte);
+    static usize FindByteAvx2(const char* data, usize size, char byte);
+    
+    static usize FindScalar(const char* data, usize size, std::string_view needle);
+    static usize FindSse2(const char* data, usize size, std::string_view needle);
+    static usize FindAvx2(const char* data, usize size, std::string_view needle);
+
+    static usize CountByteScalar(const char* data, usize size, char byte);
+    static usize CountByteSse2(const char* data, usize size, char byte);
+    static usize CountByteAvx2(const char* data, usize size, char byte);
+};
@@ -0,0 +1,168 @@
+﻿#include "ValueHashMap.h"
+
+#include <cmath>
+
+#include "Obj.h"
+
+const Value* ValueHashMap::Find(Value key) const
+{
+    u32 index = FindIndex(key, Hash(key));
+    return index == NOT_FOUND ? nullptr : &m_Entries[index].Val;
+}
+
+Value* ValueHashMap::Find(Value key)
+{
+    return const_cast<Value*>(const_cast<const ValueHashMap&>(*this).Find(key));
+}
+
+void ValueHashMap::Set(Value key, Value val)
+{
+    u32 hash = Hash(key);
+    u32 index = FindIndex(key, hash);
+    if (index != NOT_FOUND)
+    {
+        m_Entries[index].Val = val;
+        return;
+    }
+    if ((u64)(m_Count + 1) * MAX_LOAD_DEN > (u64)m_Entries.size() * MAX_LOAD_NUM) Grow();
+    Insert({.Key = key, .Val = val, .Hash = hash, .Probe = 1});
+    m_Count++;
+}
+
+bool ValueHashMap::Remove(Value key)
+{
+    u32 index = FindIndex(key, Hash(key));
+    if (index == NOT_FOUND) return false;
+    // backward shift deletion: entries after the removed one move one bucket closer to their home
+    u32 mask = (u32)m_Entries.size() - 1;
+    u32 next = (index + 1) & mask;
+    while (m_Entries[next].Probe > 1)
+    {
+        m_Entries[index] = m_Entries[next];
+        m_Entries[index].Probe--;
+        index = next;
+        next = (next + 1) & mask;
+    }
+    m_Entries[index] = Entry{};
+    m_Count--;
+    return true;
+}
+
+void ValueHashMap::Reserve(u32 count)
+{
+    u32 capacity = std::max(MIN_CAPACITY, (u32)m_Entries.size());
+    while ((u64)count * MAX_LOAD_DEN > (u64)capacity * MAX_LOAD_NUM) capacity *= 2;
+    if (capacity > m_Entries.size()) Rehash(capacity);
+}
+
+bool ValueHashMap::IsValidKey(Value key)
+{
+    return !key.HasType<void*>();
+}
+
+u32 ValueHashMap::Hash(Value key)
+{
+    u64 bits;
+    if (key.HasType<f64>())
+    {
+        // 0.0 and -0.0 are the same key
+        f64 number = key.As<f64>() == 0.0 ? 0.0 : key.As<f64>();
+        bits = std::bit_cast<u64>(number);
+    }
+    else if (key.HasType<bool>())
+    {
+        bits = key.As<bool>() ? 1 : 2;
+    }
+    else if (StringUtils::IsString(key))
+    {
+        bits = std::hash<std::string_view>{}(StringUtils::GetView(key));
+    }
+    else if (key.As<ObjHandle>().HasType<RowObj>())
+    {
+        // rows are proxies, different proxies of the same row are the same key
+        const RowObj& row = key.As<ObjHandle>().As<RowObj>();
+        bits = std::hash<ObjHandle>{}(row.Table) * 31 + row.Index;
+    }
+    else
+    {
+        bits = std::hash<ObjHandle>{}(key.As<ObjHandle>());
+    }
+    // splitmix64 finalizer, low bits select the bucket
+    bits ^= bits >> 30;
+    bits *= 0xbf58476d1ce4e5b9llu;
+    bits ^= bits >> 27;
+    bits *= 0x94d049bb133111ebllu;
+    bits ^= bits >> 31;
+    return (u32)bits;
+}
+
+bool ValueHashMap::KeysEqual(Value a, Value b)
+{
+    if (a.HasType<f64>() && b.HasType<f64>())
+    {
+        f64 x = a.As<f64>();
+        f64 y = b.As<f64>();
+        return x == y || (std::isnan(x) && std::isnan(y));
+    }
+    if (a.HasType<bool>() && b.HasType<bool>()) return a.As<bool>() == b.As<bool>();
+    if (!(a.HasType<ObjHandle>() && b.HasType<ObjHandle>())) return false;
+    if (a.As<ObjHandle>() == b.As<ObjHandle>()) return true;
+    if (a.As<ObjHandle>().HasType<RowObj>() && b.As<ObjHandle>().HasType<RowObj>())
+    {
+        const RowObj& rowA = a.As<ObjHandle>().As<RowObj>();
+        const RowObj& rowB = b.As<ObjHandle>().As<RowObj>();
+        return rowA.Table == rowB.Table && rowA.Index == rowB.Index;
+    }
+    return StringUtils::IsString(a) && StringUtils::IsString(b) && StringUtils::GetView(a) == StringUtils::GetView(b);
+}
+
+u32 ValueHashMap::FindIndex(Value key, u32 hash) const
+{
+    if (m_Count == 0) return NOT_FOUND;
+    u32 mask = (u32)m_Entries.size() - 1;
+    u32 index = hash & mask;
+    for (u32 probe = 1;; probe++)
+    {
+        const Entry& entry = m_Entries[index];
+        // an entry closer to its home than we are to ours means the key is absent
+        if (entry.Probe < probe) return NOT_FOUND;
+        if (entry.Hash == hash && KeysEqual(entry.Key, key)) return index;
+        index = (index + 1) & mask;
+    }
+}
+
+void ValueHashMap::Insert(Entry entry)
+{
+    u32 mask = (u32)m_Entries.size() - 1;
+    u32 index = entry.Hash & mask;
+    for (;;)
+    {
+        Entry& current = m_Entries[index];
+        if (current.Probe == 0)
+        {
+            current = entry;
+            return;
+        }
+        // take the bucket from richer entry, and continue with it
+        if (current.Probe < entry.Probe) std::swap(current, entry);
+        entry.Probe++;
+        index = (index + 1) & mask;
+    }
+}
+
+void ValueHashMap::Grow()
+{
+    Rehash(std::max(MIN_CAPACITY, (u32)m_Entries.size() * 2));
+}
+
+void ValueHashMap::Rehash(u32 capacity)
+{
+    std::vector<Entry> old = std::move(m_Entries);
+    m_Entries = std::vector<Entry>(capacity);
+    for (auto& entry : old)
+    {
+        if (entry.Probe == 0) continue;
+        entry.Probe = 1;
+        Insert(entry);
+    }
+}
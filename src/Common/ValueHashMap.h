@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <vector>
+
+#include "Types.h"
+#include "Value.h"
+
+// open addressing hash map with robin hood probing,
+// numbers and strings (including slices) are compared by value, everything else by identity
+class ValueHashMap
+{
+    friend class GarbageCollector;
+    friend class ObjRegistry;
+public:
+    struct Entry
+    {
+        Value Key{};
+        Value Val{};
+        // cached hash of the key, so that probing and growing never rehash keys
+        u32 Hash{0};
+        // distance from the home bucket plus one, 0 for an empty bucket
+        u32 Probe{0};
+    };
+public:
+    const Value* Find(Value key) const;
+    Value* Find(Value key);
+    void Set(Value key, Value val);
+    bool Remove(Value key);
+    // makes room for `count` entries, so that inserting them does not grow the map
+    void Reserve(u32 count);
+    u32 GetCount() const { return m_Count; }
+    u64 GetAllocatedBytes() const { return sizeof(Entry) * m_Entries.size(); }
+
+    template <typename Fn>
+    void ForEach(Fn&& fn) const;
+
+    static bool IsValidKey(Value key);
+    static u32 Hash(Value key);
+    static bool KeysEqual(Value a, Value b);
+private:
+    u32 FindIndex(Value key, u32 hash) const;
+    void Insert(Entry entry);
+    void Grow();
+    void Rehash(u32 capacity);
+private:
+    std::vector<Entry> m_Entries;
+    u32 m_Count{0};
+    static constexpr u32 NOT_FOUND = std::numeric_limits<u32>::max();
+    static constexpr u32 MIN_CAPACITY = 8;
+    // max load factor is 7/8, robin hood keeps probe sequences short up to it
+    static constexpr u32 MAX_LOAD_NUM = 7;
+    static constexpr u32 MAX_LOAD_DEN = 8;
+};
+
+template <typename Fn>
+void ValueHashMap::ForEach(Fn&& fn) const
+{
+    for (auto& entry : m_Entries)
+    {
+        if (entry.Probe != 0) fn(entry.Key, entry.Val);
+    }
+}
@@ -0,0 +1,210 @@
+﻿#include "VectorMath.h"
+
+#include "Simd.h"
+
+#ifdef BCVM_SIMD_X64
+    #define DISPATCH_AVX2(fn, ...) if (Simd::HasAvx2()) return fn##Avx2(__VA_ARGS__);
+#else
+    #define DISPATCH_AVX2(fn, ...)
+#endif
+
+void VectorMath::Fill(f64* data, u32 count, f64 val)
+{
+    DISPATCH_AVX2(Fill, data, count, val)
+    for (u32 i = 0; i < count; i++) data[i] = val;
+}
+
+f64 VectorMath::Sum(const f64* data, u32 count)
+{
+    DISPATCH_AVX2(Sum, data, count)
+    return SumScalar(data, count);
+}
+
+f64 VectorMath::Dot(const f64* a, const f64* b, u32 count)
+{
+    DISPATCH_AVX2(Dot, a, b, count)
+    return DotScalar(a, b, count);
+}
+
+void VectorMath::Scale(f64* data, u32 count, f64 k)
+{
+    DISPATCH_AVX2(Scale, data, count, k)
+    for (u32 i = 0; i < count; i++) data[i] *= k;
+}
+
+void VectorMath::Axpy(f64 a, const f64* x, f64* y, u32 count)
+{
+    DISPATCH_AVX2(Axpy, a, x, y, count)
+    for (u32 i = 0; i < count; i++) y[i] += a * x[i];
+}
+
+f64 VectorMath::Min(const f64* data, u32 count)
+{
+    DISPATCH_AVX2(Min, data, count)
+    return MinScalar(data, count);
+}
+
+f64 VectorMath::Max(const f64* data, u32 count)
+{
+    DISPATCH_AVX2(Max, data, count)
+    return MaxScalar(data, count);
+}
+
+void VectorMath::Add(f64* a, const f64* b, u32 count)
+{
+    DISPATCH_AVX2(Add, a, b, count)
+    for (u32 i = 0; i < count; i++) a[i] += b[i];
+}
+
+void VectorMath::Mul(f64* a, const f64* b, u32 count)
+{
+    DISPATCH_AVX2(Mul, a, b, count)
+    for (u32 i = 0; i < count; i++) a[i] *= b[i];
+}
+
+// lanes are reduced pairwise, the same way on every path
+f64 VectorMath::ReduceLanes(const f64* lanes)
+{
+    return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+}
+
+f64 VectorMath::SumScalar(const f64* data, u32 count)
+{
+    f64 lanes[LANES] = {};
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        for (u32 lane = 0; lane < LANES; lane++) lanes[lane] += data[i + lane];
+    }
+    f64 sum = ReduceLanes(lanes);
+    for (; i < count; i++) sum += data[i];
+    return sum;
+}
+
+f64 VectorMath::DotScalar(const f64* a, const f64* b, u32 count)
+{
+    f64 lanes[LANES] = {};
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        for (u32 lane = 0; lane < LANES; lane++) lanes[lane] += a[i + lane] * b[i + lane];
+    }
+    f64 sum = ReduceLanes(lanes);
+    for (; i < count; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+// comparisons are written the same way as `minpd` / `maxpd` work
+f64 VectorMath::MinScalar(const f64* data, u32 count)
+{
+    f64 min = data[0];
+    for (u32 i = 1; i < count; i++) min = data[i] < min ? data[i] : min;
+    return min;
+}
+
+f64 VectorMath::MaxScalar(const f64* data, u32 count)
+{
+    f64 max = data[0];
+    for (u32 i = 1; i < count; i++) max = data[i] > max ? data[i] : max;
+    return max;
+}
+
+#ifdef BCVM_SIMD_X64
+
+BCVM_TARGET_AVX2 void VectorMath::FillAvx2(f64* data, u32 count, f64 val)
+{
+    const __m256d value = _mm256_set1_pd(val);
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) _mm256_storeu_pd(data + i, value);
+    for (; i < count; i++) data[i] = val;
+}
+
+BCVM_TARGET_AVX2 f64 VectorMath::SumAvx2(const f64* data, u32 count)
+{
+    __m256d lanes = _mm256_setzero_pd();
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) lanes = _mm256_add_pd(lanes, _mm256_loadu_pd(data + i));
+    f64 reduced[LANES];
+    _mm256_storeu_pd(reduced, lanes);
+    f64 sum = ReduceLanes(reduced);
+    for (; i < count; i++) sum += data[i];
+    return sum;
+}
+
+// no fma here, so that the result is bitwise the same as the scalar one
+BCVM_TARGET_AVX2 f64 VectorMath::DotAvx2(const f64* a, const f64* b, u32 count)
+{
+    __m256d lanes = _mm256_setzero_pd();
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        lanes = _mm256_add_pd(lanes, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    f64 reduced[LANES];
+    _mm256_storeu_pd(reduced, lanes);
+    f64 sum = ReduceLanes(reduced);
+    for (; i < count; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+BCVM_TARGET_AVX2 void VectorMath::ScaleAvx2(f64* data, u32 count, f64 k)
+{
+    const __m256d factor = _mm256_set1_pd(k);
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) _mm256_storeu_pd(data + i, _mm256_mul_pd(_mm256_loadu_pd(data + i), factor));
+    for (; i < count; i++) data[i] *= k;
+}
+
+BCVM_TARGET_AVX2 void VectorMath::AxpyAvx2(f64 a, const f64* x, f64* y, u32 count)
+{
+    const __m256d factor = _mm256_set1_pd(a);
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        __m256d product = _mm256_mul_pd(factor, _mm256_loadu_pd(x + i));
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i), product));
+    }
+    for (; i < count; i++) y[i] += a * x[i];
+}
+
+BCVM_TARGET_AVX2 f64 VectorMath::MinAvx2(const f64* data, u32 count)
+{
+    if (count < LANES) return MinScalar(data, count);
+    __m256d lanes = _mm256_loadu_pd(data);
+    u32 i = LANES;
+    for (; i + LANES <= count; i += LANES) lanes = _mm256_min_pd(_mm256_loadu_pd(data + i), lanes);
+    f64 reduced[LANES];
+    _mm256_storeu_pd(reduced, lanes);
+    f64 min = MinScalar(reduced, LANES);
+    for (; i < count; i++) min = data[i] < min ? data[i] : min;
+    return min;
+}
+
+BCVM_TARGET_AVX2 f64 VectorMath::MaxAvx2(const f64* data, u32 count)
+{
+    if (count < LANES) return MaxScalar(data, count);
+    __m256d lanes = _mm256_loadu_pd(data);
+    u32 i = LANES;
+    for (; i + LANES <= count; i += LANES) lanes = _mm256_max_pd(_mm256_loadu_pd(data + i), lanes);
+    f64 reduced[LANES];
+    _mm256_storeu_pd(reduced, lanes);
+    f64 max = MaxScalar(reduced, LANES);
+    for (; i < count; i++) max = data[i] > max ? data[i] : max;
+    return max;
+}
+
+BCVM_TARGET_AVX2 void VectorMath::AddAvx2(f64* a, const f64* b, u32 count)
+{
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    for (; i < count; i++) a[i] += b[i];
+}
+
+BCVM_TARGET_AVX2 void VectorMath::MulAvx2(f64* a, const f64* b, u32 count)
+{
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) _mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    for (; i < count; i++) a[i] *= b[i];
+}
+
+#endif
@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "Types.h"
+
+// bulk kernels over unboxed f64 arrays,
+// reductions accumulate in 4 interleaved lanes on every path, so results do not depend on the cpu
+class VectorMath
+{
+public:
+    static void Fill(f64* data, u32 count, f64 val);
+    static f64 Sum(const f64* data, u32 count);
+    static f64 Dot(const f64* a, const f64* b, u32 count);
+    // data *= k
+    static void Scale(f64* data, u32 count, f64 k);
+    // y += a * x
+    static void Axpy(f64 a, const f64* x, f64* y, u32 count);
+    // count has to be positive
+    static f64 Min(const f64* data, u32 count);
+    static f64 Max(const f64* data, u32 count);
+    // a += b, a *= b
+    static void Add(f64* a, const f64* b, u32 count);
+    static void Mul(f64* a, const f64* b, u32 count);
+private:
+    static f64 ReduceLanes(const f64* lanes);
+    static f64 SumScalar(const f64* data, u32 count);
+    static f64 DotScalar(const f64* a, const f64* b, u32 count);
+    static f64 MinScalar(const f64* data, u32 count);
+    static f64 MaxScalar(const f64* data, u32 count);
+
+    static void FillAvx2(f64* data, u32 count, f64 val);
+    static f64 SumAvx2(const f64* data, u32 count);
+    static f64 DotAvx2(const f64* a, const f64* b, u32 count);
+    static void ScaleAvx2(f64* data, u32 count, f64 k);
+    static void AxpyAvx2(f64 a, const f64* x, f64* y, u32 count);
+    static f64 MinAvx2(const f64* data, u32 count);
+    static f64 MaxAvx2(const f64* data, u32 count);
+    static void AddAvx2(f64* a, const f64* b, u32 count);
+    static void MulAvx2(f64* a, const f64* b, u32 count);
+
+    static constexpr u32 LANES = 4;
+};
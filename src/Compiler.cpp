@@ -5,6 +5,8 @@
 #include "VirtualMachine.h"
 #include "Obj.h"
 
+#include <algorithm>
+#include <charconv>
 #include <ranges>
 
 CompilerContext::CompilerContext() = default;
@@ -43,6 +45,9 @@ void Compiler::InitParseTable()
     rules[toInt(TokenType::Slash)]        = { nullptr,               &Compiler::Binary,    Precedence::Order::Factor };
     rules[toInt(TokenType::Star)]         = { nullptr,               &Compiler::Binary,    Precedence::Order::Factor };
     rules[toInt(TokenType::Pipe)]         = { nullptr,               &Compiler::Binary,    Precedence::Order::Factor };
+    rules[toInt(TokenType::Percent)]      = { nullptr,               &Compiler::Binary,    Precedence::Order::Factor };
+    rules[toInt(TokenType::Ampersand)]    = { nullptr,               &Compiler::Binary,    Precedence::Order::Factor };
+    rules[toInt(TokenType::Caret)]        = { nullptr,               &Compiler::Binary,    Precedence::Order::Factor };
     rules[toInt(TokenType::Bang)]         = { &Compiler::Unary,      nullptr,              Precedence::Order::None };
     rules[toInt(TokenType::BangEqual)]    = { nullptr,               &Compiler::Binary,    Precedence::Order::Equals };
     rules[toInt(TokenType::Equal)]        = { nullptr,               nullptr,              Precedence::Order::None };
@@ -51,6 +56,10 @@ void Compiler::InitParseTable()
     rules[toInt(TokenType::GreaterEqual)] = { nullptr,               &Compiler::Binary,    Precedence::Order::Comparison };
     rules[toInt(TokenType::Less)]         = { nullptr,               &Compiler::Binary,    Precedence::Order::Comparison };
     rules[toInt(TokenType::LessEqual)]    = { nullptr,               &Compiler::Binary,    Precedence::Order::Comparison };
+    rules[toInt(TokenType::LessLess)]     = { nullptr,               &Compiler::Binary,    Precedence::Order::Shift };
+    rules[toInt(TokenType::GreaterGreater)] = { nullptr,             &Compiler::Binary,    Precedence::Order::Shift };
+    rules[toInt(TokenType::Tilde)]        = { &Compiler::Unary,      nullptr,              Precedence::Order::None };
+    rules[toInt(TokenType::TildeSlash)]   = { nullptr,               &Compiler::Binary,    Precedence::Order::Factor };
     rules[toInt(TokenType::Identifier)]   = { &Compiler::Variable,   nullptr,              Precedence::Order::None };
     rules[toInt(TokenType::String)]       = { &Compiler::String,     nullptr,              Precedence::Order::None };
     rules[toInt(TokenType::Number)]       = { &Compiler::Number,     nullptr,              Precedence::Order::None };
@@ -64,6 +73,7 @@ void Compiler::InitParseTable()
     rules[toInt(TokenType::Nil)]          = { &Compiler::Nil,        nullptr,              Precedence::Order::None };
     rules[toInt(TokenType::Or)]           = { nullptr,               &Compiler::Or,        Precedence::Order::Or };
     rules[toInt(TokenType::Return)]       = { nullptr,               nullptr,              Precedence::Order::None };
+    rules[toInt(TokenType::Struct)]       = { nullptr,               nullptr,              Precedence::Order::None };
     rules[toInt(TokenType::Super)]        = { &Compiler::Super,      nullptr,              Precedence::Order::None };
     rules[toInt(TokenType::This)]         = { &Compiler::This,       nullptr,              Precedence::Order::None };
     rules[toInt(TokenType::True)]         = { &Compiler::True,       nullptr,              Precedence::Order::None };
@@ -162,6 +172,7 @@ void Compiler::Synchronize()
         switch (Peek().Type)
         { 
         case TokenType::Class:
+        case TokenType::Struct:
         case TokenType::Else: 
         case TokenType::Fun: 
         case TokenType::For: 
@@ -189,6 +200,7 @@ void Compiler::Declaration()
         FunDeclaration();
         break;
     case TokenType::Class:
+    case TokenType::Struct:
         Advance();
         ClassDeclaration();
         break;
@@ -286,7 +298,7 @@ void Compiler::FunRHSDefinition(FunType type)
 
 void Compiler::ClassDeclaration()
 {
-    CurrentClass current = CurrentClass{.Enclosing = m_CurrentContext.CurrentClass };
+    CurrentClass current = CurrentClass{.Enclosing = m_CurrentContext.CurrentClass, .IsStruct = Previous().Type == TokenType::Struct};
     m_CurrentContext.CurrentClass = &current;
     Consume(TokenType::Identifier, "Expected class name");
     if (m_CurrentContext.ScopeDepth == 0) GlobalClassDeclaration();
@@ -299,9 +311,13 @@ void Compiler::GlobalClassDeclaration()
 {
     u32 classIndex = GlobalIndexByIdentifier(Previous());
     EmitOperation(OpCode::OpConstant, EmitString(std::string{Previous().Lexeme}));
-    EmitOperation(OpCode::OpClass);
+    EmitOperation(m_CurrentContext.CurrentClass->IsStruct ? OpCode::OpStruct : OpCode::OpClass);
     EmitOperation(OpCode::OpDefineGlobal, classIndex);
-    if (Match(TokenType::Less)) Inherit(classIndex, false);
+    if (Match(TokenType::Less))
+    {
+        if (m_CurrentContext.CurrentClass->IsStruct) Error("Structs cannot inherit.");
+        Inherit(classIndex, false);
+    }
     EmitOperation(OpCode::OpReadGlobal, classIndex);
     ClassRHSDefinition();
 }
@@ -312,8 +328,12 @@ void Compiler::LocalClassDeclaration()
     // rhs methods might use class name, so we need to mark it as defined
     MarkDefined();
     EmitOperation(OpCode::OpConstant, EmitString(std::string{Previous().Lexeme}));
-    EmitOperation(OpCode::OpClass);
-    if (Match(TokenType::Less)) Inherit(classIndex, true);
+    EmitOperation(m_CurrentContext.CurrentClass->IsStruct ? OpCode::OpStruct : OpCode::OpClass);
+    if (Match(TokenType::Less))
+    {
+        if (m_CurrentContext.CurrentClass->IsStruct) Error("Structs cannot inherit.");
+        Inherit(classIndex, true);
+    }
     EmitOperation(OpCode::OpReadLocal, classIndex);
     ClassRHSDefinition();
 }
@@ -321,6 +341,7 @@ void Compiler::LocalClassDeclaration()
 void Compiler::ClassRHSDefinition()
 {
     Consume(TokenType::LeftBrace, "Expected '{' before class body.");
+    if (m_CurrentContext.CurrentClass->IsStruct) StructFields();
     while (!IsAtEnd() && !Check(TokenType::RightBrace))
     {
         Method();
@@ -329,6 +350,23 @@ void Compiler::ClassRHSDefinition()
     EmitOperation(OpCode::OpPop);
 }
 
+void Compiler::StructFields()
+{
+    // `struct Name { field, field; methods... }`, fields are positional arguments of the constructor
+    std::vector<std::string_view> fieldNames;
+    do
+    {
+        Consume(TokenType::Identifier, "Expected field name.");
+        std::string_view fieldName = Previous().Lexeme;
+        if (std::ranges::find(fieldNames, fieldName) != fieldNames.end()) Error("Struct already has field with this name.");
+        fieldNames.push_back(fieldName);
+        if (fieldNames.size() > 255) Error("Fields count more than 255.");
+        EmitOperation(OpCode::OpConstant, EmitString(std::string{fieldName}));
+        EmitOperation(OpCode::OpStructField);
+    } while (Match(TokenType::Comma));
+    Consume(TokenType::Semicolon, "Expected ';' after struct fields.");
+}
+
 void Compiler::Statement()
 {
     switch (Peek().Type)
@@ -586,6 +624,12 @@ void Compiler::Binary(bool canAssign)
     case TokenType::Slash:          EmitOperation(OpCode::OpDivide);        break;
     case TokenType::Star:           EmitOperation(OpCode::OpMultiply);      break;
     case TokenType::Pipe:           EmitOperation(OpCode::OpColMultiply);   break;
+    case TokenType::Percent:        EmitOperation(OpCode::OpModulo);        break;
+    case TokenType::TildeSlash:     EmitOperation(OpCode::OpIntDivide);     break;
+    case TokenType::Ampersand:      EmitOperation(OpCode::OpBitAnd);        break;
+    case TokenType::Caret:          EmitOperation(OpCode::OpBitXor);        break;
+    case TokenType::LessLess:       EmitOperation(OpCode::OpShiftLeft);     break;
+    case TokenType::GreaterGreater: EmitOperation(OpCode::OpShiftRight);    break;
     case TokenType::EqualEqual:     EmitOperation(OpCode::OpEqual);         break;
     case TokenType::BangEqual:      EmitOperation(OpCode::OpEqual);         EmitOperation(OpCode::OpNot); break;
     case TokenType::Less:           EmitOperation(OpCode::OpLess);          break;
@@ -604,6 +648,7 @@ void Compiler::Unary(bool canAssign)
     {
     case TokenType::Bang:   EmitOperation(OpCode::OpNot); break;
     case TokenType::Minus:  EmitOperation(OpCode::OpNegate); break;
+    case TokenType::Tilde:  EmitOperation(OpCode::OpBitNot); break;
     default: return;
     }
 }
@@ -611,7 +656,26 @@ void Compiler::Unary(bool canAssign)
 void Compiler::Number(bool canAssign)
 {
     Value val;
-    val = std::strtod(Previous().Lexeme.data(), nullptr);
+    std::string_view lexeme = Previous().Lexeme;
+    // literals without fractional part are integers, unless they are too big for one
+    i64 integer = 0;
+    auto [end, error] = std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), integer);
+    if (error == std::errc{} && end == lexeme.data() + lexeme.size() && integer <= std::numeric_limits<i32>::max())
+    {
+        val = (i32)integer;
+    }
+    else
+    {
+        // source may be a mapped file with no terminating nul, so only the lexeme itself is parsed
+        f64 number = 0;
+        if (std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), number).ec == std::errc::result_out_of_range)
+        {
+            // too many digits either way: huge if the whole part is not zero, tiny otherwise
+            std::string_view whole = lexeme.substr(0, lexeme.find('.'));
+            number = whole.find_first_not_of('0') != std::string_view::npos ? std::numeric_limits<f64>::infinity() : 0.0;
+        }
+        val = number;
+    }
     u32 index = EmitConstant(val);
     EmitOperation(OpCode::OpConstant, index);
 }
@@ -662,6 +726,7 @@ void Compiler::Variable(const Token& identifier, bool canAssign)
     }
     else
     {
+        if (readOp == OpCode::OpReadGlobal && Check(TokenType::LeftParen) && IntrinsicCall(identifier)) return;
         EmitOperation(readOp, varName);
     }
 }
@@ -704,6 +769,20 @@ void Compiler::Call(bool canAssign)
     EmitByte((u8)argc);
 }
 
+bool Compiler::IntrinsicCall(const Token& identifier)
+{
+    // locals and upvalues are resolved before this, redefinition of global is checked by vm
+    ObjHandle name = m_VirtualMachine->AddString(std::string{identifier.Lexeme});
+    if (!m_VirtualMachine->m_IntrinsicNames.Has(name)) return false;
+    u8 intrinsic = (u8)m_VirtualMachine->m_IntrinsicNames[name].As<i32>();
+    Advance();
+    u32 argc = CallArgList();
+    EmitOperation(OpCode::OpIntrinsic);
+    EmitByte(intrinsic);
+    EmitByte((u8)argc);
+    return true;
+}
+
 void Compiler::Dot(bool canAssign)
 {
     Consume(TokenType::Identifier, "Expected identifier after '.'");
@@ -784,16 +863,58 @@ void Compiler::Collection(bool canAssign)
 
 void Compiler::Subscript(bool canAssign)
 {
-    Expression();
+    // `grid[y, x]` takes all of its indices at once
+    u32 count = 0;
+    do
+    {
+        Expression();
+        count++;
+    } while (Match(TokenType::Comma));
     Consume(TokenType::RightSquare, "Expected ']' after subscript.");
+    if (count > std::numeric_limits<u8>::max())
+    {
+        Error("Subscript indices count more than 255.");
+    }
     if (Match(TokenType::Equal) && canAssign)
     {
         Expression();
-        EmitOperation(OpCode::OpSetSubscript);
+        if (count == 1)
+        {
+            EmitOperation(OpCode::OpSetSubscript);
+        }
+        else
+        {
+            EmitOperation(OpCode::OpSetSubscriptN);
+            EmitByte((u8)count);
+        }
+    }
+    else if (count == 1 && IsPropertyAccess())
+    {
+        // `table[i].field` reads or writes the column directly, without making a row in between
+        Advance();
+        const Token& identifier = Advance();
+        EmitOperation(OpCode::OpConstant, EmitString(std::string{identifier.Lexeme}));
+        if (Match(TokenType::Equal) && canAssign)
+        {
+            Expression();
+            EmitOperation(OpCode::OpSetSubscriptProperty);
+        }
+        else
+        {
+            EmitOperation(OpCode::OpReadSubscriptProperty);
+        }
     }
     else
     {
-        EmitOperation(OpCode::OpReadSubscript);
+        if (count == 1)
+        {
+            EmitOperation(OpCode::OpReadSubscript);
+        }
+        else
+        {
+            EmitOperation(OpCode::OpReadSubscriptN);
+            EmitByte((u8)count);
+        }
     }
 }
 
@@ -848,6 +969,14 @@ u8 Compiler::ResolveUpvalue(const Token& name)
     return UpvalueVar::INVALID_INDEX;
 }
 
+bool Compiler::IsPropertyAccess() const
+{
+    // `.name`, that is not a method call
+    return m_Tokens[m_CurrentTokenNum].Type == TokenType::Dot &&
+        m_Tokens[m_CurrentTokenNum + 1].Type == TokenType::Identifier &&
+        m_Tokens[m_CurrentTokenNum + 2].Type != TokenType::LeftParen;
+}
+
 u32 Compiler::ResolveGlobal(const Token& name)
 {
     ObjHandle varname = m_VirtualMachine->AddString(std::string{name.Lexeme});
@@ -33,11 +33,12 @@ struct Precedence
         And = 0x03,
         Equals = 0x04,
         Comparison = 0x05,
-        Term = 0x06,
-        Factor = 0x07,
-        Unary = 0x08,
-        Call = 0x09,
-        Primary = 0x0a,
+        Shift = 0x06,
+        Term = 0x07,
+        Factor = 0x08,
+        Unary = 0x09,
+        Call = 0x0a,
+        Primary = 0x0b,
     };
 };
 
@@ -73,6 +74,7 @@ struct CurrentClass
 {
     CurrentClass* Enclosing{nullptr};
     bool HasSuperClass{false};
+    bool IsStruct{false};
 };
 
 struct CompilerContext
@@ -96,6 +98,8 @@ public:
     Compiler(VirtualMachine* vm);
     void Init();
     CompilerResult Compile(std::string_view source);
+    // must be bumped whenever the same source compiles to different code, so that cached bytecode is rebuilt
+    static constexpr u32 VERSION = 1;
 private:
     void InitParseTable();
     void InitContext(FunType funType, std::string_view funName);
@@ -129,6 +133,7 @@ private:
     void GlobalClassDeclaration();
     void LocalClassDeclaration();
     void ClassRHSDefinition();
+    void StructFields();
     
     void Statement();
     void Block();
@@ -144,6 +149,8 @@ private:
     void Inherit(u32 subclassIndex, bool isLocal);
 
     u32 CallArgList();
+    // call of builtin, that has an intrinsic, is compiled to `OpIntrinsic`; false if `identifier` is not one
+    bool IntrinsicCall(const Token& identifier);
     
     void Expression();
     void Grouping([[maybe_unused]] bool canAssign);
@@ -169,6 +176,8 @@ private:
 
     u32 ResolveLocalVar(const Token& name);
     u8 ResolveUpvalue(const Token& name);
+    // checks whether the subscript, that was just parsed, is followed by a property (but not method) access
+    bool IsPropertyAccess() const;
     u32 ResolveGlobal(const Token& name);
 
     u32 LocalIndexByIdentifier(const Token& identifier);
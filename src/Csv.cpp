@@ -0,0 +1,299 @@
+﻿#include "Csv.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <format>
+
+#include "GarbageCollector.h"
+#include "Obj.h"
+#include "VirtualMachine.h"
+#include "Common/CsvIndex.h"
+
+bool CsvReader::Read(std::string_view path, char delimiter, VirtualMachine* vm, Value& result)
+{
+    m_Path = path;
+    m_Delimiter = delimiter;
+    m_Vm = vm;
+    if (!m_File.Open(path))
+        return ReadError("failed to open file");
+    // cells of a chunk are made with collection suspended, and rooted (with the chunk) before the next one
+    GarbageCollector::Suspend();
+    m_Roots = ObjRegistry::Create<CollectionObj>(0);
+    vm->PushTemporary(m_Roots);
+    bool isOk = ReadChunks();
+    if (isOk && !m_HasHeader)
+        isOk = ReadError("file has no header row");
+    if (isOk)
+        isOk = BuildColumns(result);
+    vm->PopTemporary();
+    GarbageCollector::Resume();
+    m_File.Close();
+    return isOk;
+}
+
+bool CsvReader::ReadChunks()
+{
+    std::string carry;
+    for (;;)
+    {
+        // everything made from earlier chunks is rooted, so that the allocation of the next one may collect
+        GarbageCollector::Resume();
+        ObjHandle chunk = ObjRegistry::Create<StringObj>();
+        GarbageCollector::Suspend();
+        std::string& text = chunk.As<StringObj>().String;
+        text.resize(std::max<usize>(BUFFER_SIZE, 2 * carry.size()));
+        std::memcpy(text.data(), carry.data(), carry.size());
+        usize read = m_File.Read(text.data() + carry.size(), text.size() - carry.size());
+        bool isEof = read == 0;
+        text.resize(carry.size() + read);
+        if (text.empty())
+            return true;
+        if (text.size() > std::numeric_limits<u32>::max())
+            return ReadError("row is too long");
+        if (m_Delimiter == 0)
+            m_Delimiter = DetectDelimiter(text);
+
+        bool isClosed = CsvIndex::Build(text, m_Delimiter, m_Indices);
+        usize end = text.size();
+        if (!isEof)
+        {
+            // the last row may be incomplete, so it is carried over to the next chunk
+            auto lastRowEnd = std::find_if(m_Indices.rbegin(), m_Indices.rend(), [&text](u32 index) { return text[index] == '\n'; });
+            if (lastRowEnd == m_Indices.rend())
+            {
+                carry = text;
+                continue;
+            }
+            end = *lastRowEnd + 1;
+        }
+        else if (!isClosed)
+        {
+            return ReadError("unterminated quoted field");
+        }
+        m_Chunks.push_back(chunk);
+        if (!AddRoot(chunk) || !ParseRows((u32)m_Chunks.size() - 1, text, (u32)end))
+            return false;
+        carry.assign(text, end);
+        text.resize(end);
+        if (isEof)
+            return true;
+    }
+}
+
+bool CsvReader::ParseRows(u32 chunk, std::string_view text, u32 end)
+{
+    u32 field = 0;
+    u32 start = 0;
+    u32 rowStart = 0;
+    for (u32 index : m_Indices)
+    {
+        if (index >= end) break;
+        bool isRowEnd = text[index] == '\n';
+        u32 cellEnd = index;
+        if (isRowEnd && cellEnd > start && text[cellEnd - 1] == '\r') cellEnd--;
+        // blank lines are skipped
+        if (!(isRowEnd && field == 0 && cellEnd == start))
+        {
+            if (!AddCell(field, chunk, start, cellEnd))
+                return false;
+            field++;
+            if (isRowEnd)
+            {
+                if (!FinishRow(field, chunk, rowStart))
+                    return false;
+                field = 0;
+            }
+        }
+        start = index + 1;
+        if (isRowEnd) rowStart = start;
+    }
+    // the last row of the file may have no line feed
+    if (start < end || field > 0)
+    {
+        u32 cellEnd = end;
+        if (cellEnd > start && text[cellEnd - 1] == '\r') cellEnd--;
+        if (!AddCell(field, chunk, start, cellEnd))
+            return false;
+        return FinishRow(field + 1, chunk, rowStart);
+    }
+    return true;
+}
+
+bool CsvReader::AddCell(u32 column, u32 chunk, u32 start, u32 end)
+{
+    if (!m_HasHeader)
+    {
+        // names are interned, so that they can be used as dict keys right away
+        m_Columns.push_back({.Name = m_Vm->AddString(Unquote(GetChunkText(chunk).substr(start, end - start)))});
+        return AddRoot(m_Columns.back().Name);
+    }
+    if (column >= m_Columns.size())
+        return ReadError(std::format("data row {} has more fields than the header", m_Rows.size() + 1));
+    Column& col = m_Columns[column];
+    if (col.IsNumeric)
+    {
+        f64 number;
+        if (ParseNumber(GetChunkText(chunk).substr(start, end - start), number))
+        {
+            col.Numbers.push_back(number);
+            return true;
+        }
+        if (!MakeTextColumn(column))
+            return false;
+    }
+    if (!col.Strings.As<CollectionObj>().Push(MakeString(chunk, start, end)))
+        return ReadError("failed to allocate text column");
+    return true;
+}
+
+bool CsvReader::FinishRow(u32 fieldCount, u32 chunk, u32 rowStart)
+{
+    if (!m_HasHeader)
+    {
+        m_HasHeader = true;
+        return true;
+    }
+    if (fieldCount != m_Columns.size())
+        return ReadError(std::format("data row {} has {} fields, but the header has {}", m_Rows.size() + 1, fieldCount, m_Columns.size()));
+    m_Rows.push_back({.Chunk = chunk, .Offset = rowStart});
+    return true;
+}
+
+bool CsvReader::MakeTextColumn(u32 column)
+{
+    Column& col = m_Columns[column];
+    col.IsNumeric = false;
+    col.Strings = ObjRegistry::Create<CollectionObj>(0);
+    if (!AddRoot(col.Strings) || !col.Strings.As<CollectionObj>().Reserve((u32)col.Numbers.size()))
+        return ReadError("failed to allocate text column");
+    for (u32 row = 0; row < col.Numbers.size(); row++)
+    {
+        // earlier rows are walked up to the column again, this happens once per column at most
+        std::string_view text = GetChunkText(m_Rows[row].Chunk);
+        u32 start = m_Rows[row].Offset;
+        u32 field = 0;
+        bool isInQuotes = false;
+        u32 i = start;
+        for (; i < text.size(); i++)
+        {
+            if (text[i] == '"')
+            {
+                isInQuotes = !isInQuotes;
+            }
+            else if (!isInQuotes && (text[i] == m_Delimiter || text[i] == '\n'))
+            {
+                if (field == column) break;
+                field++;
+                start = i + 1;
+            }
+        }
+        u32 end = i;
+        if (end > start && text[end - 1] == '\r') end--;
+        // fits into the reserved items
+        col.Strings.As<CollectionObj>().Push(MakeString(m_Rows[row].Chunk, start, end));
+    }
+    col.Numbers = {};
+    return true;
+}
+
+bool CsvReader::AddRoot(ObjHandle obj)
+{
+    if (!m_Roots.As<CollectionObj>().Push(obj))
+        return ReadError("failed to allocate reader state");
+    return true;
+}
+
+Value CsvReader::MakeString(u32 chunk, u32 start, u32 end)
+{
+    std::string_view cell = GetChunkText(chunk).substr(start, end - start);
+    if (!IsQuoted(cell))
+        return ObjRegistry::Create<StringSliceObj>(m_Chunks[chunk], start, end - start);
+    // only the escaped quotes need a copy
+    if (cell.find('"', 1) == cell.size() - 1)
+        return ObjRegistry::Create<StringSliceObj>(m_Chunks[chunk], start + 1, end - start - 2);
+    return m_Vm->AddString(Unquote(cell));
+}
+
+bool CsvReader::BuildColumns(Value& result)
+{
+    ObjHandle dict = ObjRegistry::Create<DictObj>();
+    dict.As<DictObj>().Reserve((u32)m_Columns.size());
+    for (Column& col : m_Columns)
+    {
+        ObjHandle column;
+        if (col.IsNumeric)
+        {
+            column = ObjRegistry::Create<F64ArrayObj>((u32)col.Numbers.size());
+            if (column.As<F64ArrayObj>().ItemCount != col.Numbers.size())
+                return ReadError(std::format("failed to allocate column of {} numbers", col.Numbers.size()));
+            std::copy(col.Numbers.begin(), col.Numbers.end(), column.As<F64ArrayObj>().Items);
+        }
+        else
+        {
+            column = col.Strings;
+        }
+        dict.As<DictObj>().Set(col.Name, column);
+    }
+    result = dict;
+    return true;
+}
+
+std::string_view CsvReader::GetChunkText(u32 chunk) const
+{
+    return m_Chunks[chunk].As<StringObj>().String;
+}
+
+bool CsvReader::ReadError(std::string_view message)
+{
+    m_Error = std::format("Failed to read csv file {}: {}", m_Path, message);
+    return false;
+}
+
+char CsvReader::DetectDelimiter(std::string_view text)
+{
+    // the candidate, that is the most frequent in the header row
+    static constexpr char CANDIDATES[] = {',', '\t', ';', '|'};
+    u32 counts[std::size(CANDIDATES)] = {};
+    bool isInQuotes = false;
+    for (usize i = 0; i < text.size() && (isInQuotes || text[i] != '\n'); i++)
+    {
+        if (text[i] == '"') isInQuotes = !isInQuotes;
+        if (isInQuotes) continue;
+        for (u32 candidate = 0; candidate < std::size(CANDIDATES); candidate++)
+            counts[candidate] += text[i] == CANDIDATES[candidate];
+    }
+    return CANDIDATES[std::max_element(std::begin(counts), std::end(counts)) - std::begin(counts)];
+}
+
+bool CsvReader::ParseNumber(std::string_view cell, f64& number)
+{
+    if (IsQuoted(cell)) cell = cell.substr(1, cell.size() - 2);
+    if (cell.empty())
+    {
+        number = std::nan("");
+        return true;
+    }
+    auto [end, error] = std::from_chars(cell.data(), cell.data() + cell.size(), number);
+    return error == std::errc{} && end == cell.data() + cell.size();
+}
+
+bool CsvReader::IsQuoted(std::string_view cell)
+{
+    return cell.size() >= 2 && cell.front() == '"' && cell.back() == '"';
+}
+
+std::string CsvReader::Unquote(std::string_view cell)
+{
+    if (!IsQuoted(cell)) return std::string{cell};
+    std::string text;
+    text.reserve(cell.size() - 2);
+    for (usize i = 1; i + 1 < cell.size(); i++)
+    {
+        text.push_back(cell[i]);
+        // `""` is an escaped quote
+        if (cell[i] == '"' && cell[i + 1] == '"') i++;
+    }
+    return text;
+}
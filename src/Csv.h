@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Types.h"
+#include "Value.h"
+#include "Common/FileReader.h"
+
+class VirtualMachine;
+
+// reads a csv file with a header row into a dict of columns: numeric columns are unboxed `F64ArrayObj`s
+// (with nans for empty cells), other columns are collections of slices of the file chunks
+class CsvReader
+{
+public:
+    // `delimiter` of 0 is detected from the header row; returns false and sets error on failure
+    bool Read(std::string_view path, char delimiter, VirtualMachine* vm, Value& result);
+    const std::string& GetError() const { return m_Error; }
+private:
+    struct Column
+    {
+        ObjHandle Name{};
+        // a column stays numeric until its first cell, that is not a number
+        bool IsNumeric{true};
+        std::vector<f64> Numbers;
+        // collection of the cells, made once the column turns out not to be numeric
+        ObjHandle Strings{ObjHandle::NonHandle()};
+    };
+    // cells of a column, that stops being numeric, are found again from the starts of earlier rows
+    struct RowStart
+    {
+        u32 Chunk{0};
+        u32 Offset{0};
+    };
+private:
+    bool ReadChunks();
+    // parses whole rows of `text` up to `end`, `m_Indices` are its separators
+    bool ParseRows(u32 chunk, std::string_view text, u32 end);
+    bool AddCell(u32 column, u32 chunk, u32 start, u32 end);
+    bool FinishRow(u32 fieldCount, u32 chunk, u32 rowStart);
+    bool MakeTextColumn(u32 column);
+    bool AddRoot(ObjHandle obj);
+    Value MakeString(u32 chunk, u32 start, u32 end);
+    bool BuildColumns(Value& result);
+    std::string_view GetChunkText(u32 chunk) const;
+    bool ReadError(std::string_view message);
+
+    static char DetectDelimiter(std::string_view text);
+    // empty cell is a missing number (nan)
+    static bool ParseNumber(std::string_view cell, f64& number);
+    static bool IsQuoted(std::string_view cell);
+    static std::string Unquote(std::string_view cell);
+private:
+    std::string m_Path;
+    FileReader m_File;
+    char m_Delimiter{0};
+    VirtualMachine* m_Vm{nullptr};
+    // chunks of the file (non-interned `StringObj`s), each holds whole rows only
+    std::vector<ObjHandle> m_Chunks;
+    // collection of chunks, column names and text columns, that nothing else references until the columns
+    // are built, it is kept on the vm stack, so that garbage can be collected between chunks
+    ObjHandle m_Roots{};
+    std::vector<u32> m_Indices;
+    std::vector<Column> m_Columns;
+    std::vector<RowStart> m_Rows;
+    bool m_HasHeader{false};
+    std::string m_Error;
+
+    static constexpr u32 BUFFER_SIZE = 1024 * 1024;
+};
@@ -6,9 +6,11 @@
 
 u32 GarbageCollector::s_MarkFlag = MARK_FLAG_INITIAL;
 GCContext GarbageCollector::s_Context = GCContext{};
+u32 GarbageCollector::s_SuspendCount = 0;
 
 void GarbageCollector::Collect()
 {
+    if (s_SuspendCount > 0) return;
 #ifdef GC_STRESS_TEST
     ForceCollect();
     return;
@@ -40,6 +42,26 @@ GCContext& GarbageCollector::GetContext()
     return s_Context;
 }
 
+void GarbageCollector::TrackAllocation(u64 bytes)
+{
+    s_Context.m_AllocatedBytes += bytes;
+}
+
+void GarbageCollector::TrackDeallocation(u64 bytes)
+{
+    s_Context.m_AllocatedBytes -= bytes;
+}
+
+void GarbageCollector::Suspend()
+{
+    s_SuspendCount++;
+}
+
+void GarbageCollector::Resume()
+{
+    s_SuspendCount--;
+}
+
 void GarbageCollector::Mark(GCContext& ctx)
 {
     MarkVMRoots(ctx);
@@ -78,6 +100,24 @@ void GarbageCollector::MarkVMRoots(GCContext& ctx)
 #endif
     ObjSparseSet& globals = ctx.VM->m_GlobalsSparseSet;
     MarkSparseSet(globals, ctx);
+    // natives, whose globals were redefined, may still be referenced (and saved in heap image) by name
+    MarkSparseSet(ctx.VM->m_NativeFuns, ctx);
+    // mark single-byte strings
+#ifdef DEBUG_TRACE
+    LOG_INFO("GC::Mark::VM::ByteStrings");
+#endif
+    for (ObjHandle byteString : ctx.VM->m_ByteStrings)
+    {
+        MarkObj(byteString, ctx);
+    }
+    // mark cached scripts
+#ifdef DEBUG_TRACE
+    LOG_INFO("GC::Mark::VM::ScriptCache");
+#endif
+    for (auto& entry : ctx.VM->m_ScriptCache.m_Entries)
+    {
+        MarkObj(entry.Script, ctx);
+    }
 }
 
 void GarbageCollector::MarkCompilerRoots(GCContext& ctx)
@@ -136,6 +176,7 @@ void GarbageCollector::Blacken(GCContext& ctx)
             ClassObj& classObj = ctx.m_GreyClasses.back().As<ClassObj>(); ctx.m_GreyClasses.pop_back();
             MarkObj(classObj.Name, ctx);
             MarkSparseSet(classObj.Methods, ctx);
+            for (auto fieldName : classObj.FieldNames) MarkObj(fieldName, ctx);
         }
 
         while (!ctx.m_GreyInstances.empty())
@@ -164,6 +205,9 @@ void GarbageCollector::Blacken(GCContext& ctx)
             LOG_INFO("GC::Blacken: {}", ctx.m_GreyCollections.back());
 #endif
             CollectionObj& collection = ctx.m_GreyCollections.back().As<CollectionObj>(); ctx.m_GreyCollections.pop_back();
+            MarkObj(collection.Pattern, ctx);
+            // untouched replica has no items of its own
+            if (collection.Items == nullptr) continue;
             for (u32 i = 0; i < collection.ItemCount; i++)
             {
                 if (collection.Items[i].HasType<ObjHandle>())
@@ -171,13 +215,81 @@ void GarbageCollector::Blacken(GCContext& ctx)
             }
         }
 
+        while (!ctx.m_GreyStringSlices.empty())
+        {
+#ifdef DEBUG_TRACE
+            LOG_INFO("GC::Blacken: {}", ctx.m_GreyStringSlices.back());
+#endif
+            StringSliceObj& slice = ctx.m_GreyStringSlices.back().As<StringSliceObj>(); ctx.m_GreyStringSlices.pop_back();
+            MarkObj(slice.Parent, ctx);
+        }
+
+        while (!ctx.m_GreyDicts.empty())
+        {
+#ifdef DEBUG_TRACE
+            LOG_INFO("GC::Blacken: {}", ctx.m_GreyDicts.back());
+#endif
+            DictObj& dict = ctx.m_GreyDicts.back().As<DictObj>(); ctx.m_GreyDicts.pop_back();
+            dict.Map.ForEach([&ctx](const Value& key, const Value& val)
+            {
+                if (key.HasType<ObjHandle>()) MarkObj(key.As<ObjHandle>(), ctx);
+                if (val.HasType<ObjHandle>()) MarkObj(val.As<ObjHandle>(), ctx);
+            });
+        }
+
+        while (!ctx.m_GreyGrids.empty())
+        {
+#ifdef DEBUG_TRACE
+            LOG_INFO("GC::Blacken: {}", ctx.m_GreyGrids.back());
+#endif
+            GridObj& grid = ctx.m_GreyGrids.back().As<GridObj>(); ctx.m_GreyGrids.pop_back();
+            MarkObj(grid.Base, ctx);
+        }
+
+        while (!ctx.m_GreyStructs.empty())
+        {
+#ifdef DEBUG_TRACE
+            LOG_INFO("GC::Blacken: {}", ctx.m_GreyStructs.back());
+#endif
+            StructObj& structObj = ctx.m_GreyStructs.back().As<StructObj>(); ctx.m_GreyStructs.pop_back();
+            MarkObj(structObj.Type, ctx);
+            for (u32 i = 0; i < structObj.FieldCount; i++)
+            {
+                if (structObj.Fields[i].HasType<ObjHandle>())
+                    MarkObj(structObj.Fields[i].As<ObjHandle>(), ctx);
+            }
+        }
+
+        while (!ctx.m_GreyTables.empty())
+        {
+#ifdef DEBUG_TRACE
+            LOG_INFO("GC::Blacken: {}", ctx.m_GreyTables.back());
+#endif
+            TableObj& table = ctx.m_GreyTables.back().As<TableObj>(); ctx.m_GreyTables.pop_back();
+            MarkObj(table.Type, ctx);
+            for (auto& name : table.FieldNames) MarkObj(name, ctx);
+            for (u32 field = 0; field < (u32)table.FieldNames.size(); field++)
+            {
+                const Value* column = table.GetColumn(field);
+                for (u32 row = 0; row < table.RowCount; row++)
+                {
+                    if (column[row].HasType<ObjHandle>()) MarkObj(column[row].As<ObjHandle>(), ctx);
+                }
+            }
+        }
+
         if (ctx.m_GreyFuns.empty() &&
             ctx.m_GreyClosures.empty() &&
             ctx.m_GreyUpvalues.empty() &&
             ctx.m_GreyClasses.empty() &&
             ctx.m_GreyInstances.empty() &&
             ctx.m_GreyBoundMethods.empty() &&
-            ctx.m_GreyCollections.empty()) break;
+            ctx.m_GreyCollections.empty() &&
+            ctx.m_GreyStringSlices.empty() &&
+            ctx.m_GreyDicts.empty() &&
+            ctx.m_GreyGrids.empty() &&
+            ctx.m_GreyStructs.empty() &&
+            ctx.m_GreyTables.empty()) break;
     }
 }
 
@@ -211,6 +323,15 @@ void GarbageCollector::MarkObj(ObjHandle obj, GCContext& ctx)
     case ObjType::Instance:     ctx.m_GreyInstances.push_back(obj); break;
     case ObjType::BoundMethod:  ctx.m_GreyBoundMethods.push_back(obj); break;
     case ObjType::Collection:   ctx.m_GreyCollections.push_back(obj); break;
+    case ObjType::StringSlice:  ctx.m_GreyStringSlices.push_back(obj); break;
+    case ObjType::Dict:         ctx.m_GreyDicts.push_back(obj); break;
+    case ObjType::Grid:         ctx.m_GreyGrids.push_back(obj); break;
+    case ObjType::Struct:       ctx.m_GreyStructs.push_back(obj); break;
+    case ObjType::Table:        ctx.m_GreyTables.push_back(obj); break;
+    // a row only references its table, a file its chunk and a buffer its base, no need for separate grey lists
+    case ObjType::Row:          MarkObj(obj.As<RowObj>().Table, ctx); break;
+    case ObjType::File:         MarkObj(obj.As<FileObj>().Chunk, ctx); break;
+    case ObjType::ByteBuffer:   MarkObj(obj.As<ByteBufferObj>().Base, ctx); break;
     default: break;
     }
 }
@@ -24,6 +24,11 @@ private:
     std::vector<ObjHandle> m_GreyInstances;
     std::vector<ObjHandle> m_GreyBoundMethods;
     std::vector<ObjHandle> m_GreyCollections;
+    std::vector<ObjHandle> m_GreyStringSlices;
+    std::vector<ObjHandle> m_GreyDicts;
+    std::vector<ObjHandle> m_GreyGrids;
+    std::vector<ObjHandle> m_GreyStructs;
+    std::vector<ObjHandle> m_GreyTables;
 
     u64 m_AllocatedBytes{0};
     u64 m_AllocatedThreshold{THRESHOLD_VAL_DEFAULT};
@@ -41,6 +46,13 @@ public:
     static void ForceCollect();
     static void InitContext(const GCContext& ctx);
     static GCContext& GetContext();
+    // for memory owned by objects, but allocated outside of `ObjRegistry::Create`
+    static void TrackAllocation(u64 bytes);
+    static void TrackDeallocation(u64 bytes);
+    // no collection happens between `Suspend` and matching `Resume` (calls can be nested),
+    // for code that creates objects, which are not yet reachable from any root
+    static void Suspend();
+    static void Resume();
 private:
     static void Mark(GCContext& ctx);
     static void MarkVMRoots(GCContext& ctx);
@@ -56,5 +68,6 @@ private:
 private:
     static u32 s_MarkFlag;
     static GCContext s_Context;
+    static u32 s_SuspendCount;
     static constexpr u32 MARK_FLAG_INITIAL = 1;
 };
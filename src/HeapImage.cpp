@@ -0,0 +1,1006 @@
+﻿#include "HeapImage.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+
+#include "BytecodeFile.h"
+#include "GarbageCollector.h"
+#include "Log.h"
+#include "NativeFunctions.h"
+#include "OpCode.h"
+#include "ValueFormatter.h"
+#include "VirtualMachine.h"
+
+static_assert(std::endian::native == std::endian::little, "Heap images are little-endian.");
+
+bool HeapImage::Save(std::string_view path, VirtualMachine* vm)
+{
+    m_Vm = vm;
+    m_Error.clear();
+    m_Objects.clear();
+    m_Indices.clear();
+    m_NativeNames.clear();
+    m_Data.clear();
+    m_Records.clear();
+    m_StringCount = 0;
+    vm->m_NativeFuns.ForEach([this](ObjHandle name, const Value& fun) { m_NativeNames.emplace(fun.As<ObjHandle>(), name); });
+
+    // natives are defined by vm anyway, unless the global was redefined
+    std::vector<std::pair<ObjHandle, Value>> globals;
+    vm->m_GlobalsSparseSet.ForEach([vm, &globals](ObjHandle name, const Value& val)
+    {
+        if (vm->m_NativeFuns.Has(name) && val.HasType<ObjHandle>() &&
+            vm->m_NativeFuns[name].As<ObjHandle>() == val.As<ObjHandle>())
+            return;
+        globals.emplace_back(name, val);
+    });
+
+    // replicas are materialized on the way, nothing is collected meanwhile
+    GarbageCollector::Suspend();
+    bool isOk = true;
+    for (auto& [name, val] : globals)
+        isOk = isOk && Collect(name) && (!val.HasType<ObjHandle>() || Collect(val.As<ObjHandle>()));
+    // `m_Objects` grows as references are collected, so it is traversed breadth first
+    for (usize i = 0; i < m_Objects.size() && isOk; i++)
+        isOk = CollectReferences(m_Objects[i]);
+    if (isOk)
+    {
+        std::ranges::stable_sort(m_Objects, {}, [this](ObjHandle obj) { return GetRank(GetRecord(obj)); });
+        for (u32 i = 0; i < m_Objects.size(); i++) m_Indices[m_Objects[i]] = i;
+        for (ObjHandle obj : m_Objects) WriteObj(obj);
+        Append((u32)globals.size());
+        for (auto& [name, val] : globals)
+        {
+            WriteIndex(name);
+            WriteValue(val);
+        }
+    }
+    GarbageCollector::Resume();
+    if (!isOk)
+        return false;
+
+    Header header = {
+        .Version = VERSION,
+        .OpCodeCount = (u32)OpCode::OpReturn + 1, .IntrinsicCount = (u32)Intrinsic::Count,
+        .ObjectCount = (u32)m_Objects.size(), .StringCount = m_StringCount, .GlobalCount = (u32)globals.size(),
+        .Reserved = 0, .DataSize = m_Data.size()};
+    std::memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+    // written aside and renamed, so that a concurrent run never maps a partially written image
+    std::string temporaryPath = std::format("{}.{}.tmp", path, std::chrono::steady_clock::now().time_since_epoch().count());
+    std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        m_Error = std::format("Failed to open file {} for writing", temporaryPath);
+        return false;
+    }
+    bool isWritten =
+        std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+        std::fwrite(m_Data.data(), 1, m_Data.size(), file) == m_Data.size() &&
+        std::fwrite(m_Records.data(), 1, m_Records.size(), file) == m_Records.size();
+    isWritten = std::fclose(file) == 0 && isWritten;
+    std::error_code error;
+    if (isWritten) std::filesystem::rename(temporaryPath, path, error);
+    if (!isWritten || error)
+    {
+        std::filesystem::remove(temporaryPath, error);
+        m_Error = std::format("Failed to write heap image {}", path);
+        return false;
+    }
+    m_Data.clear();
+    m_Records.clear();
+    return true;
+}
+
+bool HeapImage::Load(std::string_view path, VirtualMachine* vm, bool& isLoaded)
+{
+    m_Vm = vm;
+    m_Error.clear();
+    isLoaded = false;
+    std::error_code error;
+    if (!std::filesystem::exists(path, error)) return true;
+    // nothing is reachable from the roots until the globals are defined
+    GarbageCollector::Suspend();
+    m_ImageBuffer = NativeFunctionsUtils::MapFile(path);
+    bool isOk = m_ImageBuffer != ObjHandle::NonHandle();
+    if (isOk)
+    {
+        m_Image = m_ImageBuffer.As<ByteBufferObj>().GetView();
+        m_Position = 0;
+        isOk = ReadImage(path, isLoaded);
+    }
+    else
+    {
+        m_Error = std::format("Failed to load heap image {}", path);
+    }
+    GarbageCollector::Resume();
+    m_Handles.clear();
+    m_Kinds.clear();
+    m_References.clear();
+    return isOk;
+}
+
+HeapImage::Record HeapImage::GetRecord(ObjHandle obj) const
+{
+    switch (obj.GetType())
+    {
+    case ObjType::String:
+        {
+            auto it = m_Vm->m_InternedStrings.find(obj.As<StringObj>().String);
+            return it != m_Vm->m_InternedStrings.end() && it->second == obj ? Record::String : Record::UninternedString;
+        }
+    case ObjType::ByteBuffer:   return Record::ByteBuffer;
+    case ObjType::StringSlice:  return Record::Slice;
+    case ObjType::Fun:          return Record::Fun;
+    case ObjType::NativeFun:    return Record::NativeFun;
+    case ObjType::Class:        return Record::Class;
+    case ObjType::Upvalue:      return Record::Upvalue;
+    case ObjType::Collection:   return Record::Collection;
+    case ObjType::Dict:         return Record::Dict;
+    case ObjType::F64Array:     return Record::F64Array;
+    case ObjType::Grid:         return obj.As<GridObj>().Base == ObjHandle::NonHandle() ? Record::Grid : Record::GridView;
+    case ObjType::Instance:     return Record::Instance;
+    case ObjType::BoundMethod:  return Record::BoundMethod;
+    case ObjType::Row:          return Record::Row;
+    case ObjType::Closure:      return Record::Closure;
+    case ObjType::Struct:       return Record::Struct;
+    case ObjType::Table:        return Record::Table;
+    default: std::unreachable();
+    }
+}
+
+u32 HeapImage::GetRank(Record record)
+{
+    if (record == Record::String || record == Record::UninternedString || record == Record::ByteBuffer) return 0;
+    return record < Record::Closure ? 1 : 2;
+}
+
+bool HeapImage::Collect(ObjHandle obj)
+{
+    if (obj == ObjHandle::NonHandle() || m_Indices.contains(obj)) return true;
+    ObjType type = obj.GetType();
+    if (type == ObjType::File)
+    {
+        m_Error = "File cannot be saved in heap image";
+        return false;
+    }
+    if (type == ObjType::NativeFun && !m_NativeNames.contains(obj))
+    {
+        m_Error = std::format("{} cannot be saved in heap image", obj);
+        return false;
+    }
+    // lengths of strings and buffers are u32 in the image
+    if ((type == ObjType::String && obj.As<StringObj>().String.size() > std::numeric_limits<u32>::max()) ||
+        (type == ObjType::ByteBuffer && obj.As<ByteBufferObj>().GetView().size() > std::numeric_limits<u32>::max()))
+    {
+        m_Error = std::format("{} is too large to be saved in heap image", obj);
+        return false;
+    }
+    m_Indices.emplace(obj, (u32)m_Objects.size());
+    m_Objects.push_back(obj);
+    return true;
+}
+
+bool HeapImage::CollectValue(Value val)
+{
+    return !val.HasType<ObjHandle>() || Collect(val.As<ObjHandle>());
+}
+
+bool HeapImage::CollectReferences(ObjHandle obj)
+{
+    bool isOk = true;
+    auto collectSet = [this, &isOk](ObjHandle key, const Value& val) { isOk = isOk && Collect(key) && CollectValue(val); };
+    switch (obj.GetType())
+    {
+    case ObjType::StringSlice: return Collect(obj.As<StringSliceObj>().Parent);
+    case ObjType::Fun:
+        for (Value val : obj.As<FunObj>().Chunk.m_Values) isOk = isOk && CollectValue(val);
+        return isOk;
+    case ObjType::NativeFun: return Collect(m_NativeNames.at(obj));
+    case ObjType::Class:
+        {
+            ClassObj& classObj = obj.As<ClassObj>();
+            isOk = Collect(classObj.Name);
+            classObj.Methods.ForEach(collectSet);
+            for (ObjHandle name : classObj.FieldNames) isOk = isOk && Collect(name);
+            return isOk;
+        }
+    case ObjType::Upvalue: return CollectValue(*obj.As<UpvalueObj>().Location);
+    case ObjType::Collection:
+        {
+            CollectionObj& collection = obj.As<CollectionObj>();
+            if (collection.IsReplica()) collection.Materialize();
+            for (u32 i = 0; i < collection.ItemCount; i++) isOk = isOk && CollectValue(collection.Items[i]);
+            return isOk;
+        }
+    case ObjType::Dict:
+        obj.As<DictObj>().Map.ForEach([this, &isOk](Value key, Value val) { isOk = isOk && CollectValue(key) && CollectValue(val); });
+        return isOk;
+    case ObjType::Grid: return Collect(obj.As<GridObj>().Base);
+    case ObjType::Instance:
+        isOk = Collect(obj.As<InstanceObj>().Class);
+        obj.As<InstanceObj>().Fields.ForEach(collectSet);
+        return isOk;
+    case ObjType::BoundMethod:
+        return Collect(obj.As<BoundMethodObj>().Receiver) && Collect(obj.As<BoundMethodObj>().Method);
+    case ObjType::Row: return Collect(obj.As<RowObj>().Table);
+    case ObjType::Closure:
+        {
+            ClosureObj& closure = obj.As<ClosureObj>();
+            isOk = Collect(closure.Fun);
+            for (u32 i = 0; i < closure.UpvalueCount; i++) isOk = isOk && Collect(closure.Upvalues[i]);
+            return isOk;
+        }
+    case ObjType::Struct:
+        {
+            StructObj& structObj = obj.As<StructObj>();
+            isOk = Collect(structObj.Type);
+            for (u32 i = 0; i < structObj.FieldCount; i++) isOk = isOk && CollectValue(structObj.Fields[i]);
+            return isOk;
+        }
+    case ObjType::Table:
+        {
+            TableObj& table = obj.As<TableObj>();
+            isOk = Collect(table.Type);
+            for (ObjHandle name : table.FieldNames) isOk = isOk && Collect(name);
+            for (u32 field = 0; field < (u32)table.FieldNames.size(); field++)
+            {
+                const Value* column = table.GetColumn(field);
+                for (u32 row = 0; row < table.RowCount; row++) isOk = isOk && CollectValue(column[row]);
+            }
+            return isOk;
+        }
+    default: return true;
+    }
+}
+
+void HeapImage::WriteObj(ObjHandle obj)
+{
+    Record record = GetRecord(obj);
+    Append(record);
+    // fields, needed to construct the object
+    switch (record)
+    {
+    case Record::String:
+        m_StringCount++;
+        Append((u32)obj.As<StringObj>().String.size());
+        m_Records.append(obj.As<StringObj>().String);
+        break;
+    case Record::UninternedString:
+    case Record::ByteBuffer:
+        {
+            std::string_view bytes = obj.HasType<StringObj>() ?
+                std::string_view{obj.As<StringObj>().String} : obj.As<ByteBufferObj>().GetView();
+            Append((u64)(sizeof(Header) + m_Data.size()));
+            Append((u32)bytes.size());
+            m_Data.append(bytes);
+            break;
+        }
+    case Record::Slice:
+        WriteIndex(obj.As<StringSliceObj>().Parent);
+        Append(obj.As<StringSliceObj>().Offset);
+        Append(obj.As<StringSliceObj>().Length);
+        break;
+    case Record::Fun:
+        {
+            const FunObj& fun = obj.As<FunObj>();
+            const Chunk& chunk = fun.Chunk;
+            Append((u32)chunk.m_Name.size());
+            m_Records.append(chunk.m_Name);
+            Append(fun.Arity);
+            Append(fun.UpvalueCount);
+            Append((u32)chunk.m_Code.size());
+            m_Records.append(reinterpret_cast<const char*>(chunk.m_Code.data()), chunk.m_Code.size());
+            Append((u32)chunk.m_Lines.size());
+            for (const RunLengthLines& lines : chunk.m_Lines)
+            {
+                Append(lines.Count);
+                Append(lines.Line);
+            }
+            break;
+        }
+    case Record::NativeFun:
+        WriteIndex(m_NativeNames.at(obj));
+        break;
+    case Record::Class:
+        {
+            const ClassObj& classObj = obj.As<ClassObj>();
+            WriteIndex(classObj.Name);
+            Append(classObj.IsStruct);
+            Append((u32)classObj.FieldNames.size());
+            for (ObjHandle name : classObj.FieldNames) WriteIndex(name);
+            break;
+        }
+    case Record::F64Array:
+        Append(obj.As<F64ArrayObj>().ItemCount);
+        m_Records.append(reinterpret_cast<const char*>(obj.As<F64ArrayObj>().Items),
+            sizeof(f64) * obj.As<F64ArrayObj>().ItemCount);
+        break;
+    case Record::Grid:
+        {
+            const GridObj& grid = obj.As<GridObj>();
+            Append(grid.Rank);
+            for (u32 dim = 0; dim < grid.Rank; dim++) Append(grid.Shape[dim]);
+            // owner grids are contiguous
+            m_Records.append(reinterpret_cast<const char*>(grid.Data), sizeof(f64) * grid.GetCount());
+            break;
+        }
+    case Record::Closure:
+        WriteIndex(obj.As<ClosureObj>().Fun);
+        break;
+    case Record::Struct:
+        WriteIndex(obj.As<StructObj>().Type);
+        break;
+    case Record::Table:
+        {
+            const TableObj& table = obj.As<TableObj>();
+            WriteIndex(table.Type);
+            Append((u32)table.FieldNames.size());
+            for (ObjHandle name : table.FieldNames) WriteIndex(name);
+            Append(table.RowCount);
+            break;
+        }
+    case Record::GridView:
+        {
+            const GridObj& grid = obj.As<GridObj>();
+            WriteIndex(grid.Base);
+            Append((u64)(grid.Data - grid.Base.As<GridObj>().Data));
+            Append(grid.Rank);
+            for (u32 dim = 0; dim < grid.Rank; dim++) Append(grid.Shape[dim]);
+            for (u32 dim = 0; dim < grid.Rank; dim++) Append(grid.Strides[dim]);
+            break;
+        }
+    default: break;
+    }
+
+    // references, that are filled in once all objects exist
+    usize sizeOffset = m_Records.size();
+    Append((u32)0);
+    switch (record)
+    {
+    case Record::Fun:
+        Append((u32)obj.As<FunObj>().Chunk.m_Values.size());
+        for (Value val : obj.As<FunObj>().Chunk.m_Values) WriteValue(val);
+        break;
+    case Record::Class:
+        {
+            const ObjSparseSet& methods = obj.As<ClassObj>().Methods;
+            u32 count = 0;
+            methods.ForEach([&count](ObjHandle, const Value&) { count++; });
+            Append(count);
+            methods.ForEach([this](ObjHandle name, const Value& method) { WriteIndex(name); WriteValue(method); });
+            break;
+        }
+    case Record::Upvalue:
+        WriteValue(*obj.As<UpvalueObj>().Location);
+        break;
+    case Record::Collection:
+        Append(obj.As<CollectionObj>().ItemCount);
+        for (u32 i = 0; i < obj.As<CollectionObj>().ItemCount; i++) WriteValue(obj.As<CollectionObj>().Items[i]);
+        break;
+    case Record::Dict:
+        Append(obj.As<DictObj>().Map.GetCount());
+        obj.As<DictObj>().Map.ForEach([this](Value key, Value val) { WriteValue(key); WriteValue(val); });
+        break;
+    case Record::Instance:
+        {
+            const ObjSparseSet& fields = obj.As<InstanceObj>().Fields;
+            WriteIndex(obj.As<InstanceObj>().Class);
+            u32 count = 0;
+            fields.ForEach([&count](ObjHandle, const Value&) { count++; });
+            Append(count);
+            fields.ForEach([this](ObjHandle name, const Value& val) { WriteIndex(name); WriteValue(val); });
+            break;
+        }
+    case Record::BoundMethod:
+        WriteIndex(obj.As<BoundMethodObj>().Receiver);
+        WriteIndex(obj.As<BoundMethodObj>().Method);
+        break;
+    case Record::Row:
+        WriteIndex(obj.As<RowObj>().Table);
+        Append(obj.As<RowObj>().Index);
+        break;
+    case Record::Closure:
+        for (u32 i = 0; i < obj.As<ClosureObj>().UpvalueCount; i++) WriteIndex(obj.As<ClosureObj>().Upvalues[i]);
+        break;
+    case Record::Struct:
+        for (u32 i = 0; i < obj.As<StructObj>().FieldCount; i++) WriteValue(obj.As<StructObj>().Fields[i]);
+        break;
+    case Record::Table:
+        {
+            const TableObj& table = obj.As<TableObj>();
+            for (u32 field = 0; field < (u32)table.FieldNames.size(); field++)
+            {
+                const Value* column = table.GetColumn(field);
+                for (u32 row = 0; row < table.RowCount; row++) WriteValue(column[row]);
+            }
+            break;
+        }
+    default: break;
+    }
+    u32 size = (u32)(m_Records.size() - sizeOffset - sizeof(u32));
+    std::memcpy(m_Records.data() + sizeOffset, &size, sizeof(size));
+}
+
+void HeapImage::WriteValue(Value val)
+{
+    u64 payload = 0;
+    ValueTag tag;
+    if (val.HasType<void*>())
+    {
+        tag = ValueTag::Nil;
+    }
+    else if (val.HasType<bool>())
+    {
+        tag = val.As<bool>() ? ValueTag::True : ValueTag::False;
+    }
+    else if (val.HasType<i32>())
+    {
+        tag = ValueTag::Int;
+        payload = (u32)val.As<i32>();
+    }
+    else if (val.HasType<f64>())
+    {
+        tag = ValueTag::F64;
+        payload = std::bit_cast<u64>(val.As<f64>());
+    }
+    else
+    {
+        tag = ValueTag::Obj;
+        payload = m_Indices.at(val.As<ObjHandle>());
+    }
+    Append(tag);
+    Append(payload);
+}
+
+void HeapImage::WriteIndex(ObjHandle obj)
+{
+    Append(obj == ObjHandle::NonHandle() ? NO_INDEX : m_Indices.at(obj));
+}
+
+template <typename T>
+void HeapImage::Append(const T& val)
+{
+    m_Records.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+bool HeapImage::ReadImage(std::string_view path, bool& isLoaded)
+{
+    Header header;
+    if (!Take(header) || std::memcmp(header.Magic, MAGIC, sizeof(MAGIC)) != 0)
+        return ReadError("not a heap image");
+    if (header.Version != VERSION || header.OpCodeCount != (u32)OpCode::OpReturn + 1 ||
+        header.IntrinsicCount != (u32)Intrinsic::Count)
+    {
+        LOG_WARN("Heap image {} was saved by another version of vm, and is ignored.", path);
+        return true;
+    }
+    std::string_view data;
+    if (!TakeBytes(header.DataSize, data))
+        return ReadError("invalid data size");
+    // every object takes at least its record kind and size of its references
+    if (header.ObjectCount > (m_Image.size() - m_Position) / (sizeof(Record) + sizeof(u32)))
+        return ReadError("invalid object count");
+    if (header.StringCount > header.ObjectCount)
+        return ReadError("invalid string count");
+
+    ObjRegistry::Reserve(header.ObjectCount);
+    m_Vm->m_InternedStrings.reserve(m_Vm->m_InternedStrings.size() + header.StringCount);
+    m_Handles.reserve(header.ObjectCount);
+    m_Kinds.reserve(header.ObjectCount);
+    m_References.reserve(header.ObjectCount);
+    for (u32 i = 0; i < header.ObjectCount; i++)
+    {
+        Record record;
+        u32 size;
+        std::string_view references;
+        if (!Take(record) || record > Record::GridView)
+            return ReadError("invalid record");
+        if (!CreateObj(record, i))
+            return false;
+        m_Kinds.push_back(record);
+        m_References.push_back(m_Position + sizeof(u32));
+        if (!Take(size) || !TakeBytes(size, references))
+            return ReadError("invalid record size");
+    }
+    usize globalsPosition = m_Position;
+    // dict keys are hashed, so dicts go after the structs, that may be their keys, are complete
+    for (u32 i = 0; i < header.ObjectCount; i++)
+    {
+        m_Position = m_References[i];
+        if (m_Kinds[i] != Record::Dict && !FillObj(m_Kinds[i], i))
+            return false;
+    }
+    for (u32 i = 0; i < header.ObjectCount; i++)
+    {
+        m_Position = m_References[i];
+        if (m_Kinds[i] == Record::Dict && !FillObj(m_Kinds[i], i))
+            return false;
+    }
+
+    m_Position = globalsPosition;
+    u32 count;
+    if (!Take(count) || count != header.GlobalCount)
+        return ReadError("invalid globals");
+    std::vector<std::pair<ObjHandle, Value>> globals;
+    globals.reserve(count);
+    for (u32 i = 0; i < count; i++)
+    {
+        ObjHandle name;
+        Value val;
+        if (!ReadObj<StringObj>((u32)m_Handles.size(), name) || !ReadValue(val))
+            return false;
+        globals.emplace_back(name, val);
+    }
+    if (m_Position != m_Image.size())
+        return ReadError("unexpected data after the globals");
+    for (auto& [name, val] : globals)
+    {
+        m_Vm->CheckIntrinsicOverride(name);
+        m_Vm->m_GlobalsSparseSet.Set(name, val);
+    }
+    isLoaded = true;
+    return true;
+}
+
+bool HeapImage::CreateObj(Record record, u32 index)
+{
+    ObjHandle obj;
+    switch (record)
+    {
+    case Record::String:
+        {
+            u32 length;
+            std::string_view bytes;
+            if (!Take(length) || !TakeBytes(length, bytes))
+                return ReadError("invalid string");
+            // one lookup per string, the entry is not swept before it is set, as collection is suspended
+            auto [it, isNew] = m_Vm->m_InternedStrings.try_emplace(std::string{bytes});
+            if (isNew) it->second = ObjRegistry::Create<StringObj>(bytes);
+            obj = it->second;
+            break;
+        }
+    case Record::UninternedString:
+    case Record::ByteBuffer:
+        {
+            u64 offset;
+            u32 length;
+            if (!Take(offset) || !Take(length) || offset > m_Image.size() || length > m_Image.size() - offset)
+                return ReadError("invalid bytes");
+            std::string_view bytes = m_Image.substr(offset, length);
+            obj = record == Record::UninternedString ?
+                ObjRegistry::Create<StringObj>(bytes) : ObjRegistry::Create<ByteBufferObj>(m_ImageBuffer, bytes);
+            break;
+        }
+    case Record::Slice:
+        {
+            u32 parentIndex;
+            u32 offset;
+            u32 length;
+            if (!Take(parentIndex) || !Take(offset) || !Take(length) || parentIndex >= index ||
+                GetRank(m_Kinds[parentIndex]) != 0)
+                return ReadError("invalid slice");
+            ObjHandle parent = m_Handles[parentIndex];
+            u64 parentLength = parent.HasType<StringObj>() ?
+                parent.As<StringObj>().String.size() : parent.As<ByteBufferObj>().GetView().size();
+            if (offset > parentLength || length > parentLength - offset)
+                return ReadError("invalid slice");
+            obj = ObjRegistry::Create<StringSliceObj>(parent, offset, length);
+            break;
+        }
+    case Record::Fun:
+        {
+            u32 nameLength;
+            std::string_view name;
+            u32 arity;
+            u8 upvalueCount;
+            u32 codeLength;
+            std::string_view code;
+            u32 lineCount;
+            if (!Take(nameLength) || !TakeBytes(nameLength, name) || !Take(arity) || !Take(upvalueCount) ||
+                !Take(codeLength) || !TakeBytes(codeLength, code) || !Take(lineCount) ||
+                arity > 255 || lineCount > (m_Image.size() - m_Position) / (2 * sizeof(u32)))
+                return ReadError("invalid function");
+            obj = ObjRegistry::Create<FunObj>();
+            FunObj& fun = obj.As<FunObj>();
+            fun.Arity = arity;
+            fun.UpvalueCount = upvalueCount;
+            fun.Chunk.m_Name = name;
+            fun.Chunk.m_Code.assign(code.begin(), code.end());
+            fun.Chunk.m_Lines.reserve(lineCount);
+            for (u32 i = 0; i < lineCount; i++)
+            {
+                u32 count;
+                u32 line;
+                Take(count);
+                Take(line);
+                fun.Chunk.m_Lines.emplace_back(count, line);
+            }
+            break;
+        }
+    case Record::NativeFun:
+        {
+            ObjHandle name;
+            if (!ReadObj<StringObj>(index, name))
+                return false;
+            if (!m_Vm->m_NativeFuns.Has(name))
+                return ReadError(std::format("unknown native function {}", name.As<StringObj>().String));
+            obj = m_Vm->m_NativeFuns[name].As<ObjHandle>();
+            break;
+        }
+    case Record::Class:
+        {
+            ObjHandle name;
+            bool isStruct;
+            u32 fieldCount;
+            if (!ReadObj<StringObj>(index, name) || !Take(isStruct) || !Take(fieldCount) ||
+                fieldCount > (m_Image.size() - m_Position) / sizeof(u32))
+                return ReadError("invalid class");
+            obj = ObjRegistry::Create<ClassObj>(name);
+            ClassObj& classObj = obj.As<ClassObj>();
+            classObj.IsStruct = isStruct;
+            classObj.FieldNames.resize(fieldCount);
+            for (u32 i = 0; i < fieldCount; i++)
+            {
+                if (!ReadObj<StringObj>(index, classObj.FieldNames[i]))
+                    return false;
+            }
+            break;
+        }
+    case Record::Upvalue:
+        obj = ObjRegistry::Create<UpvalueObj>();
+        obj.As<UpvalueObj>().Location = &obj.As<UpvalueObj>().Closed;
+        break;
+    case Record::Collection: obj = ObjRegistry::Create<CollectionObj>(0); break;
+    case Record::Dict: obj = ObjRegistry::Create<DictObj>(); break;
+    case Record::F64Array:
+        {
+            u32 count;
+            std::string_view items;
+            if (!Take(count) || !TakeBytes((u64)count * sizeof(f64), items))
+                return ReadError("invalid array");
+            obj = ObjRegistry::Create<F64ArrayObj>(count);
+            if (obj.As<F64ArrayObj>().ItemCount != count)
+                return ReadError("failed to allocate array");
+            if (count > 0) std::memcpy(obj.As<F64ArrayObj>().Items, items.data(), items.size());
+            CanonicalizeNaNs(obj.As<F64ArrayObj>().Items, count);
+            break;
+        }
+    case Record::Grid:
+        {
+            u32 rank;
+            std::array<u32, GridObj::MAX_RANK> shape{};
+            if (!Take(rank) || rank == 0 || rank > GridObj::MAX_RANK)
+                return ReadError("invalid grid");
+            for (u32 dim = 0; dim < rank; dim++)
+            {
+                if (!Take(shape[dim]))
+                    return ReadError("invalid grid");
+            }
+            if (!GridObj::IsValidShape(shape.data(), rank))
+                return ReadError("invalid grid");
+            u64 count = 1;
+            for (u32 dim = 0; dim < rank; dim++) count *= shape[dim];
+            std::string_view items;
+            if (count > m_Image.size() / sizeof(f64) || !TakeBytes(count * sizeof(f64), items))
+                return ReadError("invalid grid");
+            obj = ObjRegistry::Create<GridObj>(shape.data(), rank);
+            if (obj.As<GridObj>().GetCount() != count)
+                return ReadError("failed to allocate grid");
+            if (count > 0) std::memcpy(obj.As<GridObj>().Data, items.data(), items.size());
+            CanonicalizeNaNs(obj.As<GridObj>().Data, count);
+            break;
+        }
+    case Record::Instance: obj = ObjRegistry::Create<InstanceObj>(ObjHandle::NonHandle()); break;
+    case Record::BoundMethod: obj = ObjRegistry::Create<BoundMethodObj>(ObjHandle::NonHandle(), ObjHandle::NonHandle()); break;
+    case Record::Row: obj = ObjRegistry::Create<RowObj>(ObjHandle::NonHandle(), 0); break;
+    case Record::Closure:
+        {
+            ObjHandle fun;
+            if (!ReadObj<FunObj>(index, fun))
+                return false;
+            obj = ObjRegistry::Create<ClosureObj>(fun);
+            break;
+        }
+    case Record::Struct:
+        {
+            ObjHandle type;
+            if (!ReadObj<ClassObj>(index, type))
+                return false;
+            obj = ObjRegistry::Create<StructObj>(type);
+            break;
+        }
+    case Record::Table:
+        {
+            ObjHandle type;
+            u32 fieldCount;
+            if (!ReadObj<ClassObj>(index, type) || !Take(fieldCount) ||
+                fieldCount > (m_Image.size() - m_Position) / sizeof(u32))
+                return ReadError("invalid table");
+            std::vector<ObjHandle> fieldNames(fieldCount);
+            for (u32 i = 0; i < fieldCount; i++)
+            {
+                if (!ReadObj<StringObj>(index, fieldNames[i]))
+                    return false;
+            }
+            u32 rowCount;
+            // every cell takes at least a value
+            if (!Take(rowCount) || (u64)rowCount * fieldCount > m_Image.size() / sizeof(u64))
+                return ReadError("invalid table");
+            obj = ObjRegistry::Create<TableObj>(type, fieldNames, rowCount);
+            if (obj.As<TableObj>().RowCount != rowCount)
+                return ReadError("failed to allocate table");
+            break;
+        }
+    case Record::GridView:
+        {
+            ObjHandle base;
+            u64 offset;
+            u32 rank;
+            std::array<u32, GridObj::MAX_RANK> shape{};
+            std::array<u32, GridObj::MAX_RANK> strides{};
+            if (!ReadObj<GridObj>(index, base) || base.As<GridObj>().Base != ObjHandle::NonHandle() ||
+                !Take(offset) || !Take(rank) || rank == 0 || rank > GridObj::MAX_RANK)
+                return ReadError("invalid grid view");
+            // the last element of the view must be within its base
+            u64 last = offset;
+            bool isEmpty = false;
+            for (u32 dim = 0; dim < rank; dim++)
+            {
+                if (!Take(shape[dim]))
+                    return ReadError("invalid grid view");
+                isEmpty = isEmpty || shape[dim] == 0;
+            }
+            for (u32 dim = 0; dim < rank; dim++)
+            {
+                if (!Take(strides[dim]))
+                    return ReadError("invalid grid view");
+                if (isEmpty) continue;
+                u64 extent = (u64)(shape[dim] - 1) * strides[dim];
+                if (extent > std::numeric_limits<u64>::max() - last)
+                    return ReadError("invalid grid view");
+                last += extent;
+            }
+            if (!isEmpty && last >= base.As<GridObj>().GetCount())
+                return ReadError("invalid grid view");
+            obj = ObjRegistry::Create<GridObj>(base, base.As<GridObj>().Data + (isEmpty ? 0 : offset),
+                shape.data(), strides.data(), rank);
+            break;
+        }
+    default: std::unreachable();
+    }
+    m_Handles.push_back(obj);
+    return true;
+}
+
+bool HeapImage::FillObj(Record record, u32 index)
+{
+    ObjHandle obj = m_Handles[index];
+    u32 limit = (u32)m_Handles.size();
+    switch (record)
+    {
+    case Record::Fun:
+        {
+            u32 count;
+            if (!Take(count) || count > (m_Image.size() - m_Position) / (sizeof(ValueTag) + sizeof(u64)))
+                return ReadError("invalid function constants");
+            std::vector<Value>& values = obj.As<FunObj>().Chunk.m_Values;
+            values.resize(count);
+            for (u32 i = 0; i < count; i++)
+            {
+                if (!ReadValue(values[i]))
+                    return false;
+            }
+            // code is checked the same way as in bytecode files, now that the constants it refers to are known
+            std::string error;
+            if (!BytecodeFile::CheckCode(obj.As<FunObj>(), error))
+                return ReadError(std::format("invalid code of {}: {}", obj.As<FunObj>().GetName(), error));
+            return true;
+        }
+    case Record::Class:
+    case Record::Instance:
+        {
+            ObjHandle classObj;
+            if (record == Record::Instance && !ReadObj<ClassObj>(limit, classObj))
+                return false;
+            u32 count;
+            if (!Take(count))
+                return ReadError("invalid fields");
+            ObjSparseSet& set = record == Record::Class ? obj.As<ClassObj>().Methods : obj.As<InstanceObj>().Fields;
+            if (record == Record::Instance) obj.As<InstanceObj>().Class = classObj;
+            for (u32 i = 0; i < count; i++)
+            {
+                ObjHandle name;
+                Value val;
+                if (!ReadObj<StringObj>(limit, name) || !ReadValue(val))
+                    return false;
+                // methods are called as closures, without checking their type
+                if (record == Record::Class && !(val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<ClosureObj>()))
+                    return ReadError("invalid method");
+                set.Set(name, val);
+            }
+            return true;
+        }
+    case Record::Upvalue: return ReadValue(obj.As<UpvalueObj>().Closed);
+    case Record::Collection:
+        {
+            u32 count;
+            if (!Take(count) || count > (m_Image.size() - m_Position) / (sizeof(ValueTag) + sizeof(u64)))
+                return ReadError("invalid collection");
+            CollectionObj& collection = obj.As<CollectionObj>();
+            if (!collection.Reserve(count))
+                return ReadError("failed to allocate collection");
+            for (u32 i = 0; i < count; i++)
+            {
+                if (!ReadValue(collection.Items[i]))
+                    return false;
+                collection.ItemCount = i + 1;
+            }
+            return true;
+        }
+    case Record::Dict:
+        {
+            u32 count;
+            if (!Take(count) || count > (m_Image.size() - m_Position) / (2 * (sizeof(ValueTag) + sizeof(u64))))
+                return ReadError("invalid dict");
+            DictObj& dict = obj.As<DictObj>();
+            dict.Reserve(count);
+            for (u32 i = 0; i < count; i++)
+            {
+                Value key;
+                Value val;
+                if (!ReadValue(key) || !ReadValue(val))
+                    return false;
+                if (!ValueHashMap::IsValidKey(key))
+                    return ReadError("invalid dict key");
+                dict.Set(key, val);
+            }
+            return true;
+        }
+    case Record::BoundMethod:
+        {
+            BoundMethodObj& boundMethod = obj.As<BoundMethodObj>();
+            if (!ReadIndex(limit, boundMethod.Receiver) || !ReadObj<ClosureObj>(limit, boundMethod.Method))
+                return false;
+            if (boundMethod.Receiver == ObjHandle::NonHandle() || !m_Vm->IsInstance(boundMethod.Receiver))
+                return ReadError("invalid bound method");
+            return true;
+        }
+    case Record::Row:
+        {
+            RowObj& row = obj.As<RowObj>();
+            if (!ReadObj<TableObj>(limit, row.Table) || !Take(row.Index) || row.Index >= row.Table.As<TableObj>().RowCount)
+                return ReadError("invalid row");
+            return true;
+        }
+    case Record::Closure:
+        {
+            ClosureObj& closure = obj.As<ClosureObj>();
+            for (u32 i = 0; i < closure.UpvalueCount; i++)
+            {
+                if (!ReadObj<UpvalueObj>(limit, closure.Upvalues[i]))
+                    return false;
+            }
+            return true;
+        }
+    case Record::Struct:
+        {
+            StructObj& structObj = obj.As<StructObj>();
+            for (u32 i = 0; i < structObj.FieldCount; i++)
+            {
+                if (!ReadValue(structObj.Fields[i]))
+                    return false;
+            }
+            return true;
+        }
+    case Record::Table:
+        {
+            TableObj& table = obj.As<TableObj>();
+            for (u32 field = 0; field < (u32)table.FieldNames.size(); field++)
+            {
+                Value* column = table.GetColumn(field);
+                for (u32 row = 0; row < table.RowCount; row++)
+                {
+                    if (!ReadValue(column[row]))
+                        return false;
+                }
+            }
+            return true;
+        }
+    default: return true;
+    }
+}
+
+bool HeapImage::ReadValue(Value& val)
+{
+    ValueTag tag;
+    u64 payload;
+    if (!Take(tag) || !Take(payload))
+        return ReadError("unexpected end of image");
+    switch (tag)
+    {
+    case ValueTag::Nil: val = nullptr; return true;
+    case ValueTag::False: val = false; return true;
+    case ValueTag::True: val = true; return true;
+    case ValueTag::Int: val = (i32)(u32)payload; return true;
+    case ValueTag::F64:
+        {
+            // with nan boxing other nans are tagged values, so a payload could forge one
+            f64 number = std::bit_cast<f64>(payload);
+            val = std::isnan(number) ? std::numeric_limits<f64>::quiet_NaN() : number;
+            return true;
+        }
+    case ValueTag::Obj:
+        if (payload >= m_Handles.size())
+            return ReadError("invalid object index");
+        val = m_Handles[payload];
+        return true;
+    default: return ReadError("invalid value");
+    }
+}
+
+void HeapImage::CanonicalizeNaNs(f64* items, u64 count)
+{
+    // items become values when read, and with nan boxing other nans are tagged values
+    for (u64 i = 0; i < count; i++)
+    {
+        if (std::isnan(items[i])) items[i] = std::numeric_limits<f64>::quiet_NaN();
+    }
+}
+
+bool HeapImage::ReadIndex(u32 limit, ObjHandle& obj)
+{
+    u32 index;
+    if (!Take(index))
+        return ReadError("unexpected end of image");
+    if (index == NO_INDEX)
+    {
+        obj = ObjHandle::NonHandle();
+        return true;
+    }
+    // objects, needed for construction, precede the one being constructed
+    if (index >= limit)
+        return ReadError("invalid object index");
+    obj = m_Handles[index];
+    return true;
+}
+
+template <typename T>
+bool HeapImage::ReadObj(u32 limit, ObjHandle& obj)
+{
+    if (!ReadIndex(limit, obj))
+        return false;
+    if (obj == ObjHandle::NonHandle() || !obj.HasType<T>())
+        return ReadError("unexpected object type");
+    return true;
+}
+
+template <typename T>
+bool HeapImage::Take(T& val)
+{
+    if (m_Image.size() - m_Position < sizeof(T))
+        return false;
+    std::memcpy(&val, m_Image.data() + m_Position, sizeof(T));
+    m_Position += sizeof(T);
+    return true;
+}
+
+bool HeapImage::TakeBytes(u64 count, std::string_view& bytes)
+{
+    if (m_Image.size() - m_Position < count)
+        return false;
+    bytes = m_Image.substr(m_Position, count);
+    m_Position += count;
+    return true;
+}
+
+bool HeapImage::ReadError(std::string_view message)
+{
+    m_Error = std::format("Invalid heap image at byte {}: {}", m_Position, message);
+    return false;
+}
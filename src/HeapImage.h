@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Obj.h"
+#include "Types.h"
+
+class VirtualMachine;
+
+// image of the heap reachable from globals, so that a script can skip its initialization in later runs:
+// `save_image` writes the globals (but natives) and every object they refer to, `load_image` maps the image,
+// creates all objects in bulk, relocating image indices to new handles, and then defines the globals;
+// every object comes back as the same type: interned strings are interned again, the rest of strings are copied,
+// and byte buffers view their bytes in the mapping;
+// objects are ordered so that whatever a constructor needs comes first, references between objects
+// are filled in afterwards, as cycles are allowed
+class HeapImage
+{
+public:
+    bool Save(std::string_view path, VirtualMachine* vm);
+    // `isLoaded` is false if there is no image at `path`, or it was saved by another version of vm
+    bool Load(std::string_view path, VirtualMachine* vm, bool& isLoaded);
+    const std::string& GetError() const { return m_Error; }
+private:
+    enum class Record : u8
+    {
+        // interned string, its bytes are inline, bytes of the other two are in the data after the header
+        String, UninternedString, ByteBuffer, Slice,
+        Fun, NativeFun, Class, Upvalue, Collection, Dict, F64Array, Grid, Instance, BoundMethod, Row,
+        // need objects of the records above to be constructed
+        Closure, Struct, Table, GridView
+    };
+    enum class ValueTag : u8
+    {
+        Nil = 0, False, True, Int, F64, Obj
+    };
+    struct Header
+    {
+        char Magic[4];
+        u32 Version;
+        u32 OpCodeCount;
+        u32 IntrinsicCount;
+        u32 ObjectCount;
+        // interned strings among objects, to size the intern table once
+        u32 StringCount;
+        u32 GlobalCount;
+        // zero, so that the header has no padding
+        u32 Reserved;
+        // bytes of uninterned strings and byte buffers, right after the header
+        u64 DataSize;
+    };
+    Record GetRecord(ObjHandle obj) const;
+    static u32 GetRank(Record record);
+    bool Collect(ObjHandle obj);
+    bool CollectValue(Value val);
+    bool CollectReferences(ObjHandle obj);
+    void WriteObj(ObjHandle obj);
+    void WriteValue(Value val);
+    void WriteIndex(ObjHandle obj);
+    template <typename T>
+    void Append(const T& val);
+
+    bool ReadImage(std::string_view path, bool& isLoaded);
+    // first pass: makes the object with everything its constructor needs
+    bool CreateObj(Record record, u32 index);
+    // second pass: fills in references
+    bool FillObj(Record record, u32 index);
+    bool ReadValue(Value& val);
+    static void CanonicalizeNaNs(f64* items, u64 count);
+    bool ReadIndex(u32 limit, ObjHandle& obj);
+    template <typename T>
+    bool ReadObj(u32 limit, ObjHandle& obj);
+    template <typename T>
+    bool Take(T& val);
+    bool TakeBytes(u64 count, std::string_view& bytes);
+    bool ReadError(std::string_view message);
+private:
+    VirtualMachine* m_Vm{nullptr};
+    std::string m_Error;
+
+    std::vector<ObjHandle> m_Objects;
+    std::unordered_map<ObjHandle, u32> m_Indices;
+    std::unordered_map<ObjHandle, ObjHandle> m_NativeNames;
+    std::string m_Data;
+    std::string m_Records;
+    u32 m_StringCount{0};
+
+    std::string_view m_Image;
+    usize m_Position{0};
+    ObjHandle m_ImageBuffer{};
+    // relocation table: new handle of each image object
+    std::vector<ObjHandle> m_Handles;
+    std::vector<Record> m_Kinds;
+    // where references of each object start
+    std::vector<usize> m_References;
+
+    static constexpr char MAGIC[4] = {'\x7f', 'B', 'C', 'I'};
+    static constexpr u32 VERSION = 4;
+    static constexpr u32 NO_INDEX = std::numeric_limits<u32>::max();
+};
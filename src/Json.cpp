@@ -0,0 +1,528 @@
+﻿#include "Json.h"
+
+#include <charconv>
+#include <cmath>
+#include <format>
+
+#include "GarbageCollector.h"
+#include "Obj.h"
+#include "ValueFormatter.h"
+#include "VirtualMachine.h"
+#include "Common/JsonIndex.h"
+#include "Common/NumberFormat.h"
+#include "Common/StringSearch.h"
+
+bool Json::Parse(Value source, VirtualMachine* vm, Value& result)
+{
+    m_Error.clear();
+    m_Vm = vm;
+    // slices are made of the string (or the byte buffer), that the source itself views into
+    ObjHandle string = source.As<ObjHandle>();
+    if (string.HasType<ByteBufferObj>())
+    {
+        m_Source = string.As<ByteBufferObj>().GetView();
+        m_SourceString = string;
+        m_SourceOffset = 0;
+    }
+    else if (string.HasType<StringSliceObj>())
+    {
+        m_Source = string.As<StringSliceObj>().GetView();
+        m_SourceString = string.As<StringSliceObj>().Parent;
+        m_SourceOffset = string.As<StringSliceObj>().Offset;
+    }
+    else
+    {
+        m_Source = string.As<StringObj>().String;
+        m_SourceString = string;
+        m_SourceOffset = 0;
+    }
+    if (m_Source.size() > std::numeric_limits<u32>::max())
+        return ParseError("text is too large", 0);
+    if (!JsonIndex::Build(m_Source, m_Indices))
+        return ParseError("unterminated string", m_Source.size());
+
+    // strings, arrays and objects are new objects (keys are mostly repeated, but are counted too),
+    // so the registry grows once for the whole document
+    u64 objectCount = 0;
+    for (u32 index : m_Indices)
+    {
+        char c = m_Source[index];
+        objectCount += c == '"' || c == '[' || c == '{';
+    }
+    ObjRegistry::Reserve(objectCount);
+
+    m_Current = 0;
+    m_Scratch.clear();
+    m_Keys.clear();
+    // nothing is reachable from the roots until the document is complete
+    GarbageCollector::Suspend();
+    bool isOk = ParseValue(result, 0);
+    if (isOk && m_Current != m_Indices.size())
+        isOk = ParseError("unexpected data after the value", PeekPosition());
+    GarbageCollector::Resume();
+    // interned keys are not kept alive by the parser
+    m_Keys.clear();
+    return isOk;
+}
+
+bool Json::Stringify(Value val)
+{
+    m_Text.clear();
+    m_Error.clear();
+    return WriteValue(val, 0);
+}
+
+bool Json::ParseValue(Value& val, u32 depth)
+{
+    if (m_Current == m_Indices.size())
+        return ParseError("unexpected end of text", m_Source.size());
+    u32 position = m_Indices[m_Current++];
+    switch (m_Source[position])
+    {
+    case '{': return ParseObject(val, depth + 1);
+    case '[': return ParseArray(val, depth + 1);
+    case '"': return ParseString(position, val);
+    case 't': val = true; return ParseLiteral(position, "true");
+    case 'f': val = false; return ParseLiteral(position, "false");
+    case 'n': val = nullptr; return ParseLiteral(position, "null");
+    default: return ParseNumber(position, val);
+    }
+}
+
+bool Json::ParseArray(Value& val, u32 depth)
+{
+    if (depth > MAX_DEPTH)
+        return ParseError("too deeply nested", m_Indices[m_Current - 1]);
+    usize first = m_Scratch.size();
+    if (Peek() == ']')
+    {
+        m_Current++;
+    }
+    else
+    {
+        for (;;)
+        {
+            Value item;
+            if (!ParseValue(item, depth))
+                return false;
+            m_Scratch.push_back(item);
+            char next = Peek();
+            if (next != ',' && next != ']')
+                return ParseError("expected ',' or ']'", PeekPosition());
+            m_Current++;
+            if (next == ']') break;
+        }
+    }
+    u32 count = (u32)(m_Scratch.size() - first);
+    // items are copied right into the storage, without filling it with nils first
+    ObjHandle collection = ObjRegistry::Create<CollectionObj>(0);
+    CollectionObj& collectionObj = collection.As<CollectionObj>();
+    if (!collectionObj.Reserve(count))
+        return ParseError("failed to allocate array", m_Indices[m_Current - 1]);
+    std::copy(m_Scratch.begin() + first, m_Scratch.end(), collectionObj.Items);
+    collectionObj.ItemCount = count;
+    m_Scratch.resize(first);
+    val = collection;
+    return true;
+}
+
+bool Json::ParseObject(Value& val, u32 depth)
+{
+    if (depth > MAX_DEPTH)
+        return ParseError("too deeply nested", m_Indices[m_Current - 1]);
+    usize first = m_Scratch.size();
+    if (Peek() == '}')
+    {
+        m_Current++;
+    }
+    else
+    {
+        for (;;)
+        {
+            if (Peek() != '"')
+                return ParseError("expected a string key", PeekPosition());
+            Value key;
+            if (!ParseKey(m_Indices[m_Current++], key))
+                return false;
+            if (Peek() != ':')
+                return ParseError("expected ':'", PeekPosition());
+            m_Current++;
+            Value item;
+            if (!ParseValue(item, depth))
+                return false;
+            m_Scratch.push_back(key);
+            m_Scratch.push_back(item);
+            char next = Peek();
+            if (next != ',' && next != '}')
+                return ParseError("expected ',' or '}'", PeekPosition());
+            m_Current++;
+            if (next == '}') break;
+        }
+    }
+    ObjHandle dict = ObjRegistry::Create<DictObj>();
+    DictObj& dictObj = dict.As<DictObj>();
+    dictObj.Reserve((u32)(m_Scratch.size() - first) / 2);
+    // the last of the duplicate keys wins
+    for (usize i = first; i < m_Scratch.size(); i += 2)
+        dictObj.Set(m_Scratch[i], m_Scratch[i + 1]);
+    m_Scratch.resize(first);
+    val = dict;
+    return true;
+}
+
+bool Json::ParseString(u32 position, Value& val)
+{
+    bool hasEscapes;
+    std::string_view raw = ScanString(position, hasEscapes);
+    if (!hasEscapes)
+    {
+        // note that the slice keeps the whole source alive
+        val = ObjRegistry::Create<StringSliceObj>(m_SourceString, m_SourceOffset + position + 1, (u32)raw.size());
+        return true;
+    }
+    if (!Unescape(raw, position))
+        return false;
+    val = m_Vm->AddString(m_Unescaped);
+    return true;
+}
+
+bool Json::ParseKey(u32 position, Value& key)
+{
+    bool hasEscapes;
+    std::string_view raw = ScanString(position, hasEscapes);
+    auto it = m_Keys.find(raw);
+    if (it != m_Keys.end())
+    {
+        key = it->second;
+        return true;
+    }
+    if (hasEscapes)
+    {
+        if (!Unescape(raw, position))
+            return false;
+    }
+    else
+    {
+        m_Unescaped.assign(raw);
+    }
+    ObjHandle name = m_Vm->AddString(m_Unescaped);
+    m_Keys.emplace(raw, name);
+    key = name;
+    return true;
+}
+
+bool Json::ParseNumber(u32 position, Value& val)
+{
+    auto isDigit = [this](usize i) { return i < m_Source.size() && m_Source[i] >= '0' && m_Source[i] <= '9'; };
+    usize i = position;
+    bool isNegative = m_Source[i] == '-';
+    if (isNegative) i++;
+    usize digitsStart = i;
+    if (isDigit(i) && m_Source[i] == '0')
+        i++;
+    else if (isDigit(i))
+        while (isDigit(i)) i++;
+    else
+        return ParseError("unexpected character", i);
+    usize digitsEnd = i;
+    bool isInteger = true;
+    if (i < m_Source.size() && m_Source[i] == '.')
+    {
+        i++;
+        if (!isDigit(i))
+            return ParseError("expected a digit", i);
+        while (isDigit(i)) i++;
+        isInteger = false;
+    }
+    if (i < m_Source.size() && (m_Source[i] == 'e' || m_Source[i] == 'E'))
+    {
+        i++;
+        if (i < m_Source.size() && (m_Source[i] == '+' || m_Source[i] == '-')) i++;
+        if (!isDigit(i))
+            return ParseError("expected a digit", i);
+        while (isDigit(i)) i++;
+        isInteger = false;
+    }
+    if (!IsTokenEnd(i))
+        return ParseError("unexpected character", i);
+
+    // 18 digits always fit into i64
+    if (isInteger && digitsEnd - digitsStart <= 18)
+    {
+        i64 integer = 0;
+        for (usize digit = digitsStart; digit < digitsEnd; digit++)
+            integer = integer * 10 + (m_Source[digit] - '0');
+        val = Value::FromI64(isNegative ? -integer : integer);
+        return true;
+    }
+    f64 number;
+    auto [end, error] = std::from_chars(m_Source.data() + position, m_Source.data() + i, number);
+    if (error != std::errc{})
+        return ParseError("number is out of range", position);
+    val = number;
+    return true;
+}
+
+bool Json::ParseLiteral(u32 position, std::string_view literal)
+{
+    if (m_Source.substr(position, literal.size()) != literal || !IsTokenEnd(position + literal.size()))
+        return ParseError("unexpected character", position);
+    return true;
+}
+
+std::string_view Json::ScanString(u32 position, bool& hasEscapes) const
+{
+    usize start = position + 1;
+    usize quote = start + StringSearch::FindByte(m_Source.data() + start, m_Source.size() - start, '"');
+    usize backslash = StringSearch::FindByte(m_Source.data() + start, quote - start, '\\');
+    hasEscapes = backslash != StringSearch::NPOS;
+    if (!hasEscapes)
+        return m_Source.substr(start, quote - start);
+    // the first quote may be escaped, so the rest is scanned escape by escape
+    usize end = start + backslash;
+    while (m_Source[end] != '"')
+        end += m_Source[end] == '\\' ? 2 : 1;
+    return m_Source.substr(start, end - start);
+}
+
+bool Json::Unescape(std::string_view raw, u32 position)
+{
+    m_Unescaped.clear();
+    for (usize i = 0; i < raw.size(); i++)
+    {
+        if (raw[i] != '\\')
+        {
+            m_Unescaped.push_back(raw[i]);
+            continue;
+        }
+        // escaped character is a part of the string, so `raw` never ends with a backslash
+        usize escape = i++;
+        switch (raw[i])
+        {
+        case '"': m_Unescaped.push_back('"'); break;
+        case '\\': m_Unescaped.push_back('\\'); break;
+        case '/': m_Unescaped.push_back('/'); break;
+        case 'b': m_Unescaped.push_back('\b'); break;
+        case 'f': m_Unescaped.push_back('\f'); break;
+        case 'n': m_Unescaped.push_back('\n'); break;
+        case 'r': m_Unescaped.push_back('\r'); break;
+        case 't': m_Unescaped.push_back('\t'); break;
+        case 'u':
+            {
+                u32 code;
+                if (!ReadHex4(raw, i + 1, code))
+                    return ParseError("invalid unicode escape", position + 1 + escape);
+                i += 4;
+                // characters outside of the basic plane are escaped as surrogate pairs
+                if (code >= 0xD800 && code < 0xDC00)
+                {
+                    u32 low;
+                    if (!(i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u' &&
+                        ReadHex4(raw, i + 3, low) && low >= 0xDC00 && low < 0xE000))
+                    {
+                        return ParseError("unpaired surrogate", position + 1 + escape);
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+                else if (code >= 0xDC00 && code < 0xE000)
+                {
+                    return ParseError("unpaired surrogate", position + 1 + escape);
+                }
+                AppendUtf8(m_Unescaped, code);
+                break;
+            }
+        default: return ParseError("invalid escape", position + 1 + escape);
+        }
+    }
+    return true;
+}
+
+bool Json::ReadHex4(std::string_view text, usize index, u32& code)
+{
+    if (index + 4 > text.size()) return false;
+    auto [end, error] = std::from_chars(text.data() + index, text.data() + index + 4, code, 16);
+    return error == std::errc{} && end == text.data() + index + 4;
+}
+
+void Json::AppendUtf8(std::string& text, u32 code)
+{
+    if (code < 0x80)
+    {
+        text.push_back((char)code);
+    }
+    else if (code < 0x800)
+    {
+        text.push_back((char)(0xC0 | code >> 6));
+        text.push_back((char)(0x80 | (code & 0x3F)));
+    }
+    else if (code < 0x10000)
+    {
+        text.push_back((char)(0xE0 | code >> 12));
+        text.push_back((char)(0x80 | (code >> 6 & 0x3F)));
+        text.push_back((char)(0x80 | (code & 0x3F)));
+    }
+    else
+    {
+        text.push_back((char)(0xF0 | code >> 18));
+        text.push_back((char)(0x80 | (code >> 12 & 0x3F)));
+        text.push_back((char)(0x80 | (code >> 6 & 0x3F)));
+        text.push_back((char)(0x80 | (code & 0x3F)));
+    }
+}
+
+char Json::Peek() const
+{
+    return m_Current < m_Indices.size() ? m_Source[m_Indices[m_Current]] : '\0';
+}
+
+usize Json::PeekPosition() const
+{
+    return m_Current < m_Indices.size() ? m_Indices[m_Current] : m_Source.size();
+}
+
+bool Json::IsTokenEnd(usize position) const
+{
+    if (position == m_Source.size()) return true;
+    switch (m_Source[position])
+    {
+    case ' ': case '\t': case '\n': case '\r':
+    case '{': case '}': case '[': case ']': case ':': case ',':
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Json::ParseError(std::string_view message, usize position)
+{
+    m_Error = std::format("Invalid json at byte {}: {}", position, message);
+    return false;
+}
+
+bool Json::WriteValue(Value val, u32 depth)
+{
+    if (depth > MAX_DEPTH)
+    {
+        m_Error = "Value is too deeply nested (or cyclic) for json";
+        return false;
+    }
+    if (val.HasType<void*>())
+    {
+        m_Text += "null";
+        return true;
+    }
+    if (val.HasType<bool>())
+    {
+        m_Text += val.As<bool>() ? "true" : "false";
+        return true;
+    }
+    if (val.HasType<f64>())
+    {
+        char number[NumberFormat::BUFFER_SIZE];
+        // json has neither infinities nor nans
+        if (val.HasType<i32>())
+            m_Text.append(number, NumberFormat::Write(number, val.As<i32>()));
+        else if (std::isfinite(val.As<f64>()))
+            m_Text.append(number, NumberFormat::Write(number, val.As<f64>()));
+        else
+            m_Text += "null";
+        return true;
+    }
+    if (StringUtils::IsString(val))
+    {
+        WriteString(StringUtils::GetView(val));
+        return true;
+    }
+    ObjHandle obj = val.As<ObjHandle>();
+    switch (obj.GetType())
+    {
+    case ObjType::Collection:
+        {
+            const CollectionObj& collection = obj.As<CollectionObj>();
+            m_Text += '[';
+            for (u32 i = 0; i < collection.ItemCount; i++)
+            {
+                if (i > 0) m_Text += ',';
+                if (!WriteValue(collection.Peek(i), depth + 1))
+                    return false;
+            }
+            m_Text += ']';
+            return true;
+        }
+    case ObjType::F64Array:
+        {
+            const F64ArrayObj& array = obj.As<F64ArrayObj>();
+            char number[NumberFormat::BUFFER_SIZE];
+            m_Text += '[';
+            for (u32 i = 0; i < array.ItemCount; i++)
+            {
+                if (i > 0) m_Text += ',';
+                if (std::isfinite(array.Items[i]))
+                    m_Text.append(number, NumberFormat::Write(number, array.Items[i]));
+                else
+                    m_Text += "null";
+            }
+            m_Text += ']';
+            return true;
+        }
+    case ObjType::Dict:
+        {
+            bool isOk = true;
+            bool isFirst = true;
+            m_Text += '{';
+            obj.As<DictObj>().Map.ForEach([&](Value key, Value item)
+            {
+                if (!isOk) return;
+                if (!StringUtils::IsString(key))
+                {
+                    m_Error = std::format("Json keys are strings, but dict has key {}", key);
+                    isOk = false;
+                    return;
+                }
+                if (!isFirst) m_Text += ',';
+                isFirst = false;
+                WriteString(StringUtils::GetView(key));
+                m_Text += ':';
+                isOk = WriteValue(item, depth + 1);
+            });
+            m_Text += '}';
+            return isOk;
+        }
+    default:
+        m_Error = std::format("{} has no json representation", val);
+        return false;
+    }
+}
+
+void Json::WriteString(std::string_view string)
+{
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    m_Text += '"';
+    // runs of characters, that need no escaping, are appended at once
+    usize runStart = 0;
+    for (usize i = 0; i < string.size(); i++)
+    {
+        u8 c = (u8)string[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        m_Text.append(string.data() + runStart, i - runStart);
+        runStart = i + 1;
+        switch (c)
+        {
+        case '"': m_Text += "\\\""; break;
+        case '\\': m_Text += "\\\\"; break;
+        case '\b': m_Text += "\\b"; break;
+        case '\f': m_Text += "\\f"; break;
+        case '\n': m_Text += "\\n"; break;
+        case '\r': m_Text += "\\r"; break;
+        case '\t': m_Text += "\\t"; break;
+        default:
+            m_Text += "\\u00";
+            m_Text += HEX_DIGITS[c >> 4];
+            m_Text += HEX_DIGITS[c & 0xF];
+            break;
+        }
+    }
+    m_Text.append(string.data() + runStart, string.size() - runStart);
+    m_Text += '"';
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+#include "Value.h"
+
+class VirtualMachine;
+
+// json text to vm values and back, owned by vm, so that its buffers are reused between calls
+class Json
+{
+public:
+    // arrays become collections, objects dicts, and strings without escapes slices of `source`;
+    // gc is suspended until the whole document is built, returns false and sets error on malformed input
+    bool Parse(Value source, VirtualMachine* vm, Value& result);
+    // returns false and sets error, if `val` (or anything inside of it) has no json representation
+    bool Stringify(Value val);
+    // text of the last successful `Stringify`, valid until the next call
+    std::string_view GetText() const { return m_Text; }
+    const std::string& GetError() const { return m_Error; }
+private:
+    bool ParseValue(Value& val, u32 depth);
+    bool ParseArray(Value& val, u32 depth);
+    bool ParseObject(Value& val, u32 depth);
+    bool ParseString(u32 position, Value& val);
+    // keys are interned, repeated keys are looked up by their raw text
+    bool ParseKey(u32 position, Value& key);
+    bool ParseNumber(u32 position, Value& val);
+    bool ParseLiteral(u32 position, std::string_view literal);
+    // raw text of the string, that opens at `position` (stage 1 guarantees it is terminated)
+    std::string_view ScanString(u32 position, bool& hasEscapes) const;
+    // unescapes into `m_Unescaped`
+    bool Unescape(std::string_view raw, u32 position);
+    static bool ReadHex4(std::string_view text, usize index, u32& code);
+    static void AppendUtf8(std::string& text, u32 code);
+    // character and position of the next structural index, `\0` and the end of the text at the end
+    char Peek() const;
+    usize PeekPosition() const;
+    bool IsTokenEnd(usize position) const;
+    bool ParseError(std::string_view message, usize position);
+
+    bool WriteValue(Value val, u32 depth);
+    void WriteString(std::string_view string);
+private:
+    std::string_view m_Source;
+    // string the slices are made of
+    ObjHandle m_SourceString{};
+    u32 m_SourceOffset{0};
+    std::vector<u32> m_Indices;
+    u32 m_Current{0};
+    // items of the arrays and objects being parsed
+    std::vector<Value> m_Scratch;
+    std::unordered_map<std::string_view, ObjHandle> m_Keys;
+    std::string m_Unescaped;
+    VirtualMachine* m_Vm{nullptr};
+
+    std::string m_Text;
+    std::string m_Error;
+
+    static constexpr u32 MAX_DEPTH = 1024;
+};
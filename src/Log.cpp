@@ -3,15 +3,25 @@
 #include <windows.h>
 
 #include "Types.h"
+#include "Common/OutputBuffer.h"
+
+OutputBuffer* Logger::s_OutputBuffer = nullptr;
+
+void Logger::SetOutputBuffer(OutputBuffer* outputBuffer)
+{
+    s_OutputBuffer = outputBuffer;
+}
 
 std::ostream& Logger::LogPrefix(std::ostream& s)
 {
+    FlushOutput();
     s << TimeStamp() << std::format(" {:<7}", "INFO:");
     return s;
 }
 
 std::ostream& Logger::WarnPrefix(std::ostream& s)
 {
+    FlushOutput();
     const HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE); 
     SetConsoleTextAttribute(handle, FOREGROUND_GREEN|FOREGROUND_RED);
     s << TimeStamp() << std::format(" {:<7}", "WARN:");
@@ -20,6 +30,7 @@ std::ostream& Logger::WarnPrefix(std::ostream& s)
 
 std::ostream& Logger::ErrorPrefix(std::ostream& s)
 {
+    FlushOutput();
     const HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE); 
     SetConsoleTextAttribute(handle, FOREGROUND_RED);
     s << TimeStamp() << std::format(" {:<7}", "ERROR:");
@@ -28,6 +39,7 @@ std::ostream& Logger::ErrorPrefix(std::ostream& s)
 
 std::ostream& Logger::FatalPrefix(std::ostream& s)
 {
+    FlushOutput();
     const HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE); 
     SetConsoleTextAttribute(handle, BACKGROUND_RED);
     s << TimeStamp() << std::format(" {:<7}", "FATAL:");
@@ -48,3 +60,8 @@ std::string Logger::TimeStamp()
     GetLocalTime(&lt);
     return std::format("[{:0>2}:{:0>2}:{:0>2}]", lt.wHour, lt.wMinute, lt.wSecond);
 }
+
+void Logger::FlushOutput()
+{
+    if (s_OutputBuffer) s_OutputBuffer->Flush();
+}
@@ -3,9 +3,14 @@
 #include <iostream>
 #include <format>
 
+class OutputBuffer;
+
 class Logger
 {
 public:
+    // buffered program output, that is flushed before each message
+    static void SetOutputBuffer(OutputBuffer* outputBuffer);
+
     template <typename ...Args>
     using Fmt = const std::format_string<Args...>;
 
@@ -27,6 +32,9 @@ private:
     static std::ostream& FatalPrefix(std::ostream &s);
     static std::ostream& Postfix(std::ostream &s);
     static std::string TimeStamp();
+    static void FlushOutput();
+private:
+    static OutputBuffer* s_OutputBuffer;
 };
 
 template <typename ... Args>
@@ -1,9 +1,8 @@
 ﻿#include "NativeFunctions.h"
 
-std::vector<std::string> NativeFunctionsUtils::SplitFormatString(const std::string& formatString, u32 count)
+std::vector<u32> NativeFunctionsUtils::SplitFormatString(std::string_view formatString)
 {
-    std::vector<std::string> result = {};
-    result.reserve(count);
+    std::vector<u32> result = {};
 
     usize offset = 0;
     i32 openBrackets = 0;
@@ -25,12 +24,236 @@ std::vector<std::string> NativeFunctionsUtils::SplitFormatString(const std::stri
             return {};
         if (openBrackets == 0 && depth & 1 && !first)
         {
-            result.push_back(formatString.substr(offset, i - offset + 1));
             offset = i + 1;
+            result.push_back((u32)offset);
             depth = 0;
         }
     }
-    if (offset != formatString.length())
-        result.back() += formatString.substr(offset);
+    // text after the last replacement field goes with it, a string without fields has no pieces at all
+    if (!result.empty())
+        result.back() = (u32)formatString.length();
+    return result;
+}
+
+const FormatPlan& NativeFunctionsUtils::GetFormatPlan(StringObj& formatString)
+{
+    if (!formatString.Format)
+        formatString.Format = std::make_unique<FormatPlan>(FormatPlan{.Ends = SplitFormatString(formatString.String)});
+    return *formatString.Format;
+}
+
+const FormatPlan& NativeFunctionsUtils::GetFormatPlan(Value formatString, FormatPlan& uncached)
+{
+    ObjHandle string = formatString.As<ObjHandle>();
+    if (string.HasType<StringObj>())
+        return GetFormatPlan(string.As<StringObj>());
+    uncached.Ends = SplitFormatString(string.As<StringSliceObj>().GetView());
+    return uncached;
+}
+
+bool NativeFunctionsUtils::IsIndex(Value val)
+{
+    if (val.HasType<i32>()) return val.As<i32>() >= 0;
+    if (!val.HasType<f64>()) return false;
+    // compared as f64, as casting a number out of the range of u32 is undefined
+    f64 number = val.As<f64>();
+    return number >= 0 && number <= std::numeric_limits<u32>::max() && std::floor(number) == number;
+}
+
+u32 NativeFunctionsUtils::AsIndex(Value val)
+{
+    return val.HasType<i32>() ? (u32)val.As<i32>() : (u32)val.As<f64>();
+}
+
+ObjHandle NativeFunctionsUtils::Slice(ObjHandle string, u32 offset, u32 length)
+{
+    if (string.HasType<StringSliceObj>())
+    {
+        const StringSliceObj& slice = string.As<StringSliceObj>();
+        return ObjRegistry::Create<StringSliceObj>(slice.Parent, slice.Offset + offset, length);
+    }
+    return ObjRegistry::Create<StringSliceObj>(string, offset, length);
+}
+
+bool NativeFunctionsUtils::IsF64Array(Value val)
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<F64ArrayObj>();
+}
+
+bool NativeFunctionsUtils::IsDict(Value val)
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<DictObj>();
+}
+
+bool NativeFunctionsUtils::IsGrid(Value val)
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<GridObj>();
+}
+
+bool NativeFunctionsUtils::IsTable(Value val)
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<TableObj>();
+}
+
+bool NativeFunctionsUtils::IsByteBuffer(Value val)
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<ByteBufferObj>();
+}
+
+bool NativeFunctionsUtils::IsFile(Value val)
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<FileObj>();
+}
+
+ObjHandle NativeFunctionsUtils::MapFile(std::string_view path)
+{
+    ObjHandle buffer = ObjRegistry::Create<ByteBufferObj>();
+    MappedFile& file = buffer.As<ByteBufferObj>().File;
+    CHECK_RETURN_RES(file.Open(path), ObjHandle::NonHandle(), "Failed to map file {}", path)
+    CHECK_RETURN_RES(file.GetSize() <= std::numeric_limits<u32>::max(), ObjHandle::NonHandle(),
+        "File {} is too large ({} bytes) to be mapped", path, file.GetSize())
+    return buffer;
+}
+
+Value NativeFunctionsUtils::Integral(f64 integral)
+{
+    if (integral >= std::numeric_limits<i32>::min() && integral <= std::numeric_limits<i32>::max())
+        return (i32)integral;
+    return integral;
+}
+
+NativeFnCallResult NativeFunctionsUtils::UnaryMath(std::string_view name, u8 argc, const Value* argv, f64 (*fn)(f64))
+{
+    NativeFnCallResult result = {};
+    CHECK_RETURN_RES(argc == 1, result, "'{}()' accepts 1 argument, but {} given", name, argc)
+    if (!argv[0].HasType<f64>())
+        return result;
+    result.Result = fn(argv[0].As<f64>());
+    result.IsOk = true;
+    return result;
+}
+
+NativeFnCallResult NativeFunctionsUtils::MinMax(std::string_view name, u8 argc, const Value* argv, bool isMin)
+{
+    NativeFnCallResult result = {};
+    bool allIntegers = true;
+    for (u32 i = 0; i < argc; i++)
+    {
+        CHECK_RETURN_RES(argv[i].HasType<f64>(), result, "'{}()' of several arguments expects numbers", name)
+        allIntegers = allIntegers && argv[i].HasType<i32>();
+    }
+    u32 best = 0;
+    for (u32 i = 1; i < argc; i++)
+    {
+        bool isBetter = isMin ? argv[i].As<f64>() < argv[best].As<f64>() : argv[i].As<f64>() > argv[best].As<f64>();
+        if (isBetter) best = i;
+    }
+    // mixed arguments give float, so that the result type does not depend on the values
+    result.Result = allIntegers ? argv[best] : Value(argv[best].As<f64>());
+    result.IsOk = true;
+    return result;
+}
+
+bool NativeFunctionsUtils::ValueLess::operator()(Value a, Value b)
+{
+    if (IsFailed) return false;
+    if (!HasComparator)
+    {
+        if (a.HasType<f64>() && b.HasType<f64>()) return a.As<f64>() < b.As<f64>();
+        if (StringUtils::IsString(a) && StringUtils::IsString(b)) return StringUtils::GetView(a) < StringUtils::GetView(b);
+        LOG_ERROR("Only numbers or strings can be compared without comparator");
+        IsFailed = true;
+        return false;
+    }
+    
+    Value args[2] = {a, b};
+    Value order;
+    if (!Vm->CallFromNative(Comparator, 2, args, order))
+    {
+        IsFailed = IsAborted = true;
+        return false;
+    }
+    if (order.HasType<bool>()) return order.As<bool>();
+    if (order.HasType<f64>()) return order.As<f64>() < 0;
+    LOG_ERROR("Comparator must return bool or number, but returned {}", order);
+    IsFailed = true;
+    return false;
+}
+
+bool NativeFunctionsUtils::SortDefault(Value* items, u32 count)
+{
+    bool allNumbers = true;
+    bool allIntegers = true;
+    bool allStrings = true;
+    for (u32 i = 0; i < count; i++)
+    {
+        allNumbers = allNumbers && items[i].HasType<f64>();
+        allIntegers = allIntegers && items[i].HasType<i32>();
+        allStrings = allStrings && StringUtils::IsString(items[i]);
+    }
+    if (allIntegers)
+        Sort::Introsort(items, count, [](Value a, Value b) { return a.As<i32>() < b.As<i32>(); });
+    else if (allNumbers)
+        Sort::Introsort(items, count, [](Value a, Value b) { return a.As<f64>() < b.As<f64>(); });
+    else if (allStrings)
+        Sort::Introsort(items, count, [](Value a, Value b) { return StringUtils::GetView(a) < StringUtils::GetView(b); });
+    return allNumbers || allStrings;
+}
+
+NativeFnCallResult NativeFunctionsUtils::Search(std::string_view name, u8 argc, Value* argv, VirtualMachine* vm, bool isExact)
+{
+    NativeFnCallResult result = {};
+    CHECK_RETURN_RES(argc == 2 || argc == 3, result, "'{}()' accepts 2 or 3 arguments, but {} given", name, argc)
+    bool isArray = IsF64Array(argv[0]);
+    if (!(isArray || (argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>())))
+        return result;
+    ObjHandle sequence = argv[0].As<ObjHandle>();
+    Value val = argv[1];
+    ValueLess less = {.Vm = vm};
+    if (argc == 3)
+    {
+        less.Comparator = argv[2];
+        less.HasComparator = true;
+    }
+    if (!isArray)
+        sequence.As<CollectionObj>().Materialize();
+    
+    // items are re-read on each step, as the comparator is free to modify the collection
+    auto getCount = [sequence, isArray]() {
+        return isArray ? sequence.As<F64ArrayObj>().ItemCount : sequence.As<CollectionObj>().ItemCount;
+    };
+    auto getItem = [sequence, isArray](u32 index) {
+        return isArray ? Value(sequence.As<F64ArrayObj>().Items[index]) : sequence.As<CollectionObj>().Items[index];
+    };
+    u32 first = 0;
+    u32 count = getCount();
+    while (count > 0)
+    {
+        u32 half = count / 2;
+        CHECK_RETURN_RES(first + half < getCount(), result, "'{}()' collection was resized by comparator", name)
+        if (less(getItem(first + half), val))
+        {
+            first += half + 1;
+            count -= half + 1;
+        }
+        else
+        {
+            count = half;
+        }
+    }
+    if (less.IsFailed)
+        return result;
+    
+    if (!isExact)
+    {
+        result.Result = Value::FromI64(first);
+        result.IsOk = true;
+        return result;
+    }
+    bool isFound = first < getCount() && !less(val, getItem(first));
+    if (less.IsFailed)
+        return result;
+    result.Result = isFound ? Value::FromI64(first) : Value(-1);
+    result.IsOk = true;
     return result;
 }
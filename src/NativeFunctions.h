@@ -1,11 +1,19 @@
 ﻿#pragma once
 #include "Core.h"
+#include "Csv.h"
+#include "HeapImage.h"
 #include "Common/Random.h"
+#include "Common/Sort.h"
+#include "Common/Stencil.h"
+#include "Common/StringSearch.h"
+#include "Common/VectorMath.h"
 #include "Obj.h"
 #include "Types.h"
 #include "VirtualMachine.h"
 #include "ValueFormatter.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 
 
@@ -13,7 +21,48 @@ class Value;
 
 namespace NativeFunctionsUtils
 {
-    std::vector<std::string> SplitFormatString(const std::string& formatString, u32 count);
+    // ends of format pieces, see `FormatPlan`, no pieces if the format string is malformed or has no replacement fields
+    std::vector<u32> SplitFormatString(std::string_view formatString);
+    // format plan of the string, parsed on the first call
+    const FormatPlan& GetFormatPlan(StringObj& formatString);
+    // format plan of string or string slice, the plan of a slice is not cached, but made in `uncached`
+    const FormatPlan& GetFormatPlan(Value formatString, FormatPlan& uncached);
+    // true for integral numbers in the range of u32
+    bool IsIndex(Value val);
+    // `val` must satisfy `IsIndex`
+    u32 AsIndex(Value val);
+    // creates a slice of string (or of string slice), which always references the original `StringObj`
+    ObjHandle Slice(ObjHandle string, u32 offset, u32 length);
+    bool IsF64Array(Value val);
+    bool IsDict(Value val);
+    bool IsGrid(Value val);
+    bool IsTable(Value val);
+    bool IsByteBuffer(Value val);
+    bool IsFile(Value val);
+    // maps the file into a new `ByteBufferObj`, or returns `NonHandle` (slices address it with u32 offsets)
+    ObjHandle MapFile(std::string_view path);
+    // integer, if `integral` fits into one, and f64 otherwise
+    Value Integral(f64 integral);
+    NativeFnCallResult UnaryMath(std::string_view name, u8 argc, const Value* argv, f64 (*fn)(f64));
+    // min or max of numbers, integers stay integers
+    NativeFnCallResult MinMax(std::string_view name, u8 argc, const Value* argv, bool isMin);
+    // ordering of `sort()` and searches: numbers numerically and strings lexicographically by default,
+    // or by script comparator, that returns either bool (whether `a` goes first) or number (negative if it does);
+    // after a failure everything compares equal, so that a sort in progress finishes quickly
+    struct ValueLess
+    {
+        VirtualMachine* Vm{nullptr};
+        Value Comparator{};
+        bool HasComparator{false};
+        bool IsFailed{false};
+        // the comparator raised a runtime error, which has cleared the stacks
+        bool IsAborted{false};
+        bool operator()(Value a, Value b);
+    };
+    // sorts all-number or all-string collections without comparator, false for other collections
+    bool SortDefault(Value* items, u32 count);
+    // `lower_bound()` or `binary_search()` on sorted collection or f64 array
+    NativeFnCallResult Search(std::string_view name, u8 argc, Value* argv, VirtualMachine* vm, bool isExact);
 }
 
 namespace NativeFunctions
@@ -21,26 +70,29 @@ namespace NativeFunctions
     inline NativeFn Print = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc >= 1, result, "'print()' accepts at least 1 argument, but {} given", argc)
-        const std::string& formatString = argv[0].As<ObjHandle>().As<StringObj>().String;
+        CHECK_RETURN_RES(StringUtils::IsString(argv[0]), result, "'print()' expects format string as its first argument")
+        std::string_view formatString = StringUtils::GetView(argv[0]);
+        OutputBuffer& output = vm->GetOutput();
         if (argc == 1)
         {
-            std::cout << formatString;
+            output.Write(formatString);
             result.IsOk = true;
         }
         else
         {
-            std::vector<std::string> subFormats = NativeFunctionsUtils::SplitFormatString(formatString, argc);
-            if (subFormats.size() == argc - 1)
+            FormatPlan uncached;
+            const FormatPlan& plan = NativeFunctionsUtils::GetFormatPlan(argv[0], uncached);
+            if (plan.Ends.size() == argc - 1)
             {
                 result.IsOk = true;
                 for (u32 i = 1; i < argc; i++)
                 {
-                    std::cout << std::vformat(subFormats[i - 1], std::make_format_args(argv[i]));
+                    output.VFormat(plan.GetPiece(formatString, i - 1), std::make_format_args(argv[i]));
                 }
             }
             else
             {
-                LOG_ERROR("Format string expects {} agruments but {} given.", subFormats.size(), argc - 1);
+                LOG_ERROR("Format string expects {} agruments but {} given.", plan.Ends.size(), argc - 1);
             }
         }
         return result;
@@ -49,27 +101,31 @@ namespace NativeFunctions
     inline NativeFn PrintLn = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc >= 1, result, "'println()' accepts at least 1 argument, but {} given", argc)
-        const std::string& formatString = argv[0].As<ObjHandle>().As<StringObj>().String;
+        CHECK_RETURN_RES(StringUtils::IsString(argv[0]), result, "'println()' expects format string as its first argument")
+        std::string_view formatString = StringUtils::GetView(argv[0]);
+        OutputBuffer& output = vm->GetOutput();
         if (argc == 1)
         {
-            std::cout << formatString << "\n";
+            output.Write(formatString);
+            output.Write("\n");
             result.IsOk = true;
         }
         else
         {
-            std::vector<std::string> subFormats = NativeFunctionsUtils::SplitFormatString(formatString, argc);
-            if (subFormats.size() == argc - 1)
+            FormatPlan uncached;
+            const FormatPlan& plan = NativeFunctionsUtils::GetFormatPlan(argv[0], uncached);
+            if (plan.Ends.size() == argc - 1)
             {
                 result.IsOk = true;
                 for (u32 i = 1; i < argc; i++)
                 {
-                    std::cout << std::vformat(subFormats[i - 1], std::make_format_args(argv[i]));
+                    output.VFormat(plan.GetPiece(formatString, i - 1), std::make_format_args(argv[i]));
                 }
-                std::cout << "\n";
+                output.Write("\n");
             }
             else
             {
-                LOG_ERROR("Format string expects {} agruments but {} given.", subFormats.size(), argc - 1);
+                LOG_ERROR("Format string expects {} agruments but {} given.", plan.Ends.size(), argc - 1);
             }
         }
         return result;
@@ -78,6 +134,8 @@ namespace NativeFunctions
     inline NativeFn Input = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc == 0, result, "'input()' accepts 0 arguments, but {} given", argc)
+        // the prompt has to be seen before the input is read
+        vm->GetOutput().Flush();
         std::string line;
         std::getline(std::cin, line);
         result.Result = vm->AddString(line);
@@ -85,6 +143,240 @@ namespace NativeFunctions
         return result;
     };
     
+    inline NativeFn MapFile = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'map_file()' accepts 1 argument, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        ObjHandle buffer = NativeFunctionsUtils::MapFile(StringUtils::GetView(argv[0]));
+        if (buffer == ObjHandle::NonHandle())
+            return result;
+        result.Result = buffer;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn ReadFile = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'read_file()' accepts 1 argument, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        ObjHandle buffer = NativeFunctionsUtils::MapFile(StringUtils::GetView(argv[0]));
+        if (buffer == ObjHandle::NonHandle())
+            return result;
+        // the whole file as a string, without a copy
+        vm->PushTemporary(buffer);
+        result.Result = NativeFunctionsUtils::Slice(buffer, 0, (u32)buffer.As<ByteBufferObj>().GetView().size());
+        vm->PopTemporary();
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn WriteFile = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'write_file()' accepts 2 arguments, but {} given", argc)
+        if (!(StringUtils::IsString(argv[0]) && StringUtils::IsString(argv[1])))
+            return result;
+        std::string path = std::string{StringUtils::GetView(argv[0])};
+        std::string_view bytes = StringUtils::GetView(argv[1]);
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        CHECK_RETURN_RES(file != nullptr, result, "Failed to open file {} for writing", path)
+        bool isWritten = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        isWritten = std::fclose(file) == 0 && isWritten;
+        CHECK_RETURN_RES(isWritten, result, "Failed to write file {}", path)
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn ReadCsv = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1 || argc == 2, result, "'read_csv()' accepts 1 or 2 arguments, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        // detected from the header row, unless given
+        char delimiter = 0;
+        if (argc == 2)
+        {
+            if (!StringUtils::IsString(argv[1]))
+                return result;
+            std::string_view given = StringUtils::GetView(argv[1]);
+            CHECK_RETURN_RES(given.size() == 1 && given[0] != '"' && given[0] != '\n' && given[0] != '\r', result,
+                "'read_csv()' delimiter has to be a single character, but '{}' given", given)
+            delimiter = given[0];
+        }
+        CsvReader reader;
+        CHECK_RETURN_RES(reader.Read(StringUtils::GetView(argv[0]), delimiter, vm, result.Result), result, "{}", reader.GetError())
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Open = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'open()' accepts 1 argument, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        ObjHandle file = ObjRegistry::Create<FileObj>();
+        CHECK_RETURN_RES(file.As<FileObj>().Reader.Open(StringUtils::GetView(argv[0])), result,
+            "Failed to open file {}", StringUtils::GetView(argv[0]))
+        result.Result = file;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Stdin = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 0, result, "'stdin()' accepts 0 arguments, but {} given", argc)
+        // reads ahead, so it does not mix with `input()`
+        ObjHandle file = ObjRegistry::Create<FileObj>();
+        file.As<FileObj>().Reader.OpenStdin();
+        result.Result = file;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn ReadLine = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'read_line()' accepts 1 argument, but {} given", argc)
+        if (!NativeFunctionsUtils::IsFile(argv[0]))
+            return result;
+        ObjHandle line = argv[0].As<ObjHandle>().As<FileObj>().ReadLine(vm->GetOutput());
+        if (line != ObjHandle::NonHandle())
+            result.Result = line;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Lines = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'lines()' accepts 2 arguments, but {} given", argc)
+        if (!NativeFunctionsUtils::IsFile(argv[0]))
+            return result;
+        ObjHandle file = argv[0].As<ObjHandle>();
+        Value fn = argv[1];
+        for (ObjHandle line = file.As<FileObj>().ReadLine(vm->GetOutput()); line != ObjHandle::NonHandle();
+            line = file.As<FileObj>().ReadLine(vm->GetOutput()))
+        {
+            Value arg = line;
+            Value res;
+            if (!vm->CallFromNative(fn, 1, &arg, res))
+                return result;
+        }
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Close = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'close()' accepts 1 argument, but {} given", argc)
+        if (!NativeFunctionsUtils::IsFile(argv[0]))
+            return result;
+        // lines, that are already read, stay valid
+        argv[0].As<ObjHandle>().As<FileObj>().Reader.Close();
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn JsonParse = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'json_parse()' accepts 1 argument, but {} given", argc)
+        if (!(StringUtils::IsString(argv[0]) || NativeFunctionsUtils::IsByteBuffer(argv[0])))
+            return result;
+        Json& json = vm->GetJson();
+        CHECK_RETURN_RES(json.Parse(argv[0], vm, result.Result), result, "{}", json.GetError())
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn JsonStringify = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'json_stringify()' accepts 1 argument, but {} given", argc)
+        Json& json = vm->GetJson();
+        CHECK_RETURN_RES(json.Stringify(argv[0]), result, "{}", json.GetError())
+        std::string_view text = json.GetText();
+        CHECK_RETURN_RES(text.size() <= std::numeric_limits<u32>::max(), result, "'json_stringify()' result is too large")
+        // text is copied once into a string, that is not interned, and is viewed through a slice
+        ObjHandle string = ObjRegistry::Create<StringObj>(text);
+        vm->PushTemporary(string);
+        result.Result = NativeFunctionsUtils::Slice(string, 0, (u32)text.size());
+        vm->PopTemporary();
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Pack = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'pack()' accepts 1 argument, but {} given", argc)
+        Packer& packer = vm->GetPacker();
+        CHECK_RETURN_RES(packer.Pack(argv[0]), result, "{}", packer.GetError())
+        std::string_view bytes = packer.GetBytes();
+        CHECK_RETURN_RES(bytes.size() <= std::numeric_limits<u32>::max(), result, "'pack()' result is too large")
+        ObjHandle string = ObjRegistry::Create<StringObj>(bytes);
+        vm->PushTemporary(string);
+        result.Result = NativeFunctionsUtils::Slice(string, 0, (u32)bytes.size());
+        vm->PopTemporary();
+        result.IsOk = true;
+        return result;
+    };
+
+    // `unpack(bytes, keys...)` unpacks only the value at the path of collection indices and dict keys
+    inline NativeFn Unpack = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc >= 1, result, "'unpack()' accepts at least 1 argument, but {} given", argc)
+        if (!(StringUtils::IsString(argv[0]) || NativeFunctionsUtils::IsByteBuffer(argv[0])))
+            return result;
+        Packer& packer = vm->GetPacker();
+        CHECK_RETURN_RES(packer.Unpack(argv[0], argv + 1, argc - 1u, vm, result.Result), result, "{}",
+            packer.GetError())
+        result.IsOk = true;
+        return result;
+    };
+
+    // `save_image(path)` stores all globals (with whatever they refer to), see `HeapImage`
+    inline NativeFn SaveImage = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'save_image()' accepts 1 argument, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        HeapImage image;
+        CHECK_RETURN_RES(image.Save(StringUtils::GetView(argv[0]), vm), result, "{}", image.GetError())
+        result.IsOk = true;
+        return result;
+    };
+
+    // `load_image(path)` defines the globals of the image, false if there is no (up-to-date) image
+    inline NativeFn LoadImage = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'load_image()' accepts 1 argument, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        HeapImage image;
+        bool isLoaded;
+        CHECK_RETURN_RES(image.Load(StringUtils::GetView(argv[0]), vm, isLoaded), result, "{}", image.GetError())
+        result.Result = isLoaded;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Flush = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 0, result, "'flush()' accepts 0 arguments, but {} given", argc)
+        vm->GetOutput().Flush();
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn OutputMode = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'output_mode()' accepts 1 argument, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        std::string_view mode = StringUtils::GetView(argv[0]);
+        CHECK_RETURN_RES(mode == "line" || mode == "block", result, "'output_mode()' expects 'line' or 'block', but {} given", mode)
+        vm->GetOutput().SetMode(mode == "line" ? OutputBuffer::Mode::Line : OutputBuffer::Mode::Block);
+        result.IsOk = true;
+        return result;
+    };
+    
     inline NativeFn Clock = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc == 0, result, "'clock()' accepts 0 arguments, but {} given", argc)
@@ -98,6 +390,7 @@ namespace NativeFunctions
         CHECK_RETURN_RES(argc == 1, result, "'sleep()' accepts 1 argument, but {} given", argc)
         if (argv[0].HasType<f64>() && argv[0].As<f64>() >= 0)
         {
+            vm->GetOutput().Flush();
             std::this_thread::sleep_for(std::chrono::milliseconds((u64)argv[0].As<f64>()));
             result.IsOk = true;
         }
@@ -112,9 +405,17 @@ namespace NativeFunctions
             result.Result = *argv;
             result.IsOk = true;
         }
+        else if (argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<StringSliceObj>())
+        {
+            result.Result = vm->AddString(std::string{argv[0].As<ObjHandle>().As<StringSliceObj>().GetView()});
+            result.IsOk = true;
+        }
         else if (argv[0].HasType<f64>())
         {
-            result.Result = vm->AddString(std::format("{}", argv[0].As<f64>()));
+            char number[NumberFormat::BUFFER_SIZE];
+            u32 length = argv[0].HasType<i32>() ?
+                NumberFormat::Write(number, argv[0].As<i32>()) : NumberFormat::Write(number, argv[0].As<f64>());
+            result.Result = vm->AddString(std::string{number, length});
             result.IsOk = true;
         }
         return result;
@@ -123,29 +424,35 @@ namespace NativeFunctions
     inline NativeFn Int = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc == 1, result, "'int()' accepts 1 argument, but {} given", argc)
-        if (argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<StringObj>())
+        if (StringUtils::IsString(argv[0]))
         {
-            const std::string& string = argv[0].As<ObjHandle>().As<StringObj>().String;
+            // slices are not null-terminated
+            const std::string string{StringUtils::GetView(argv[0])};
             if (string.length() == 0)
                 return result;
             
             char* end;
-            i32 asInt = strtol(argv[0].As<ObjHandle>().As<StringObj>().String.c_str(), &end, 0);
+            i32 asInt = strtol(string.c_str(), &end, 0);
             // if `end` is not `\0` we failed to parse
             if (*end == '\0')
             {
-                result.Result = (f64)asInt;
+                result.Result = asInt;
                 result.IsOk = true;                
             }
         }
+        else if (argv[0].HasType<i32>())
+        {
+            result.Result = argv[0];
+            result.IsOk = true;
+        }
         else if (argv[0].HasType<f64>())
         {
-            result.Result = std::floor(argv[0].As<f64>());
+            result.Result = NativeFunctionsUtils::Integral(std::floor(argv[0].As<f64>()));
             result.IsOk = true;
         }
         else if (argv[0].HasType<bool>())
         {
-            result.Result = (f64)argv[0].As<bool>();
+            result.Result = (i32)argv[0].As<bool>();
             result.IsOk = true;
         }
         return result;
@@ -154,14 +461,15 @@ namespace NativeFunctions
     inline NativeFn Float = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc == 1, result, "'float()' accepts 1 argument, but {} given", argc)
-        if (argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<StringObj>())
+        if (StringUtils::IsString(argv[0]))
         {
-            const std::string& string = argv[0].As<ObjHandle>().As<StringObj>().String;
+            // slices are not null-terminated
+            const std::string string{StringUtils::GetView(argv[0])};
             if (string.length() == 0)
                 return result;
             
             char* end;
-            f64 asF64 = strtod(argv[0].As<ObjHandle>().As<StringObj>().String.c_str(), &end);
+            f64 asF64 = strtod(string.c_str(), &end);
             // if `end` is not `\0` we failed to parse
             if (*end == '\0')
             {
@@ -185,7 +493,84 @@ namespace NativeFunctions
     inline NativeFn Rand = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc == 0, result, "'rand()' accepts 0 argument, but {} given", argc)
-        result.Result = Random::F64();
+        result.Result = vm->GetRandom().F64();
+        result.IsOk = true;
+        return result;
+    };
+
+    // seed(n): restarts the sequence of this vm's generator
+    inline NativeFn Seed = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'seed()' accepts 1 argument, but {} given", argc)
+        i32 seed;
+        if (!VirtualMachine::ToInteger(argv[0], seed))
+            return result;
+        vm->GetRandom().Seed((u64)(i64)seed);
+        result.IsOk = true;
+        return result;
+    };
+
+    // rand_int(n) is in [0, n), rand_int(min, max) is in [min, max)
+    inline NativeFn RandInt = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1 || argc == 2, result, "'rand_int()' accepts 1 or 2 arguments, but {} given", argc)
+        i32 min = 0;
+        i32 max;
+        if (!VirtualMachine::ToInteger(argv[argc - 1], max))
+            return result;
+        if (argc == 2 && !VirtualMachine::ToInteger(argv[0], min))
+            return result;
+        CHECK_RETURN_RES(min < max, result, "'rand_int()' range is empty")
+        result.Result = (i32)(min + (i64)vm->GetRandom().Bounded((u64)((i64)max - min)));
+        result.IsOk = true;
+        return result;
+    };
+
+    // rand_range(min, max) is in [min, max)
+    inline NativeFn RandRange = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'rand_range()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<f64>() && argv[1].HasType<f64>()))
+            return result;
+        f64 min = argv[0].As<f64>();
+        result.Result = min + (argv[1].As<f64>() - min) * vm->GetRandom().F64();
+        result.IsOk = true;
+        return result;
+    };
+
+    // rand_fill(c[, min, max]): fills f64 array, grid or collection with samples in [min, max), [0, 1) by default
+    inline NativeFn RandFill = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1 || argc == 3, result, "'rand_fill()' accepts 1 or 3 arguments, but {} given", argc)
+        f64 min = 0.0;
+        f64 max = 1.0;
+        if (argc == 3)
+        {
+            if (!(argv[1].HasType<f64>() && argv[2].HasType<f64>()))
+                return result;
+            min = argv[1].As<f64>();
+            max = argv[2].As<f64>();
+        }
+        Random& random = vm->GetRandom();
+        if (NativeFunctionsUtils::IsF64Array(argv[0]))
+        {
+            F64ArrayObj& array = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+            random.Fill(array.Items, array.ItemCount, min, max);
+        }
+        else if (NativeFunctionsUtils::IsGrid(argv[0]))
+        {
+            argv[0].As<ObjHandle>().As<GridObj>().ForEachRow([&](f64* row, u32 length) { random.Fill(row, length, min, max); });
+        }
+        else if (argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>())
+        {
+            CollectionObj& collection = argv[0].As<ObjHandle>().As<CollectionObj>();
+            collection.Materialize();
+            for (u32 i = 0; i < collection.ItemCount; i++) collection.Items[i] = min + (max - min) * random.F64();
+        }
+        else
+        {
+            return result;
+        }
         result.IsOk = true;
         return result;
     };
@@ -193,16 +578,829 @@ namespace NativeFunctions
     inline NativeFn Len = [](u8 argc, Value* argv, VirtualMachine* vm) {
         NativeFnCallResult result = {};
         CHECK_RETURN_RES(argc == 1, result, "'len()' accepts 1 argument, but {} given", argc)
-        if (argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<StringObj>())
+        if (StringUtils::IsString(argv[0]))
         {
-            result.Result = (f64)argv[0].As<ObjHandle>().As<StringObj>().String.length();
+            result.Result = Value::FromI64((i64)StringUtils::GetView(argv[0]).length());
             result.IsOk = true;
         }
         else if (argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>())
         {
-            result.Result = (f64)argv[0].As<ObjHandle>().As<CollectionObj>().ItemCount;
+            result.Result = Value::FromI64((i64)argv[0].As<ObjHandle>().As<CollectionObj>().ItemCount);
+            result.IsOk = true;
+        }
+        else if (NativeFunctionsUtils::IsF64Array(argv[0]))
+        {
+            result.Result = Value::FromI64((i64)argv[0].As<ObjHandle>().As<F64ArrayObj>().ItemCount);
+            result.IsOk = true;
+        }
+        else if (NativeFunctionsUtils::IsDict(argv[0]))
+        {
+            result.Result = Value::FromI64((i64)argv[0].As<ObjHandle>().As<DictObj>().Map.GetCount());
+            result.IsOk = true;
+        }
+        else if (NativeFunctionsUtils::IsGrid(argv[0]))
+        {
+            result.Result = Value::FromI64((i64)argv[0].As<ObjHandle>().As<GridObj>().Shape[0]);
+            result.IsOk = true;
+        }
+        else if (NativeFunctionsUtils::IsTable(argv[0]))
+        {
+            result.Result = Value::FromI64((i64)argv[0].As<ObjHandle>().As<TableObj>().RowCount);
+            result.IsOk = true;
+        }
+        else if (NativeFunctionsUtils::IsByteBuffer(argv[0]))
+        {
+            result.Result = Value::FromI64((i64)argv[0].As<ObjHandle>().As<ByteBufferObj>().GetView().size());
+            result.IsOk = true;
+        }
+        return result;
+    };
+
+    inline NativeFn Ord = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1 || argc == 2, result, "'ord()' accepts 1 or 2 arguments, but {} given", argc)
+        if (!StringUtils::IsString(argv[0]))
+            return result;
+        std::string_view string = StringUtils::GetView(argv[0]);
+        u32 index = 0;
+        if (argc == 2)
+        {
+            if (!NativeFunctionsUtils::IsIndex(argv[1]))
+                return result;
+            index = (u32)argv[1].As<f64>();
+        }
+        if (index < string.size())
+        {
+            result.Result = (i32)(u8)string[index];
+            result.IsOk = true;
+        }
+        return result;
+    };
+
+    inline NativeFn Chr = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'chr()' accepts 1 argument, but {} given", argc)
+        if (argv[0].HasType<f64>() && argv[0].As<f64>() >= 0 && argv[0].As<f64>() <= 255 && std::floor(argv[0].As<f64>()) == argv[0].As<f64>())
+        {
+            result.Result = vm->GetByteString((u8)argv[0].As<f64>());
+            result.IsOk = true;
+        }
+        return result;
+    };
+
+    inline NativeFn Substr = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2 || argc == 3, result, "'substr()' accepts 2 or 3 arguments, but {} given", argc)
+        bool isBytes = NativeFunctionsUtils::IsByteBuffer(argv[0]);
+        if (!((StringUtils::IsString(argv[0]) || isBytes) && NativeFunctionsUtils::IsIndex(argv[1])))
+            return result;
+        // substrings of byte buffers are string slices, that view right into the mapped file
+        std::string_view string = isBytes ? argv[0].As<ObjHandle>().As<ByteBufferObj>().GetView() : StringUtils::GetView(argv[0]);
+        u32 start = (u32)argv[1].As<f64>();
+        if (start > string.size())
+            return result;
+        u32 length = (u32)string.size() - start;
+        if (argc == 3)
+        {
+            if (!NativeFunctionsUtils::IsIndex(argv[2]))
+                return result;
+            length = std::min(length, (u32)argv[2].As<f64>());
+        }
+        result.Result = NativeFunctionsUtils::Slice(argv[0].As<ObjHandle>(), start, length);
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Find = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2 || argc == 3, result, "'find()' accepts 2 or 3 arguments, but {} given", argc)
+        if (!(StringUtils::IsString(argv[0]) && StringUtils::IsString(argv[1])))
+            return result;
+        usize from = 0;
+        if (argc == 3)
+        {
+            if (!NativeFunctionsUtils::IsIndex(argv[2]))
+                return result;
+            from = (usize)argv[2].As<f64>();
+        }
+        usize index = StringSearch::Find(StringUtils::GetView(argv[0]), StringUtils::GetView(argv[1]), from);
+        result.Result = index == StringSearch::NPOS ? Value(-1) : Value::FromI64((i64)index);
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Split = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'split()' accepts 2 arguments, but {} given", argc)
+        if (!(StringUtils::IsString(argv[0]) && StringUtils::IsString(argv[1])))
+            return result;
+        ObjHandle source = argv[0].As<ObjHandle>();
+        std::string_view string = StringUtils::GetView(argv[0]);
+        std::string_view separator = StringUtils::GetView(argv[1]);
+        if (separator.empty())
+            return result;
+
+        u32 count = (u32)StringSearch::Count(string, separator) + 1;
+        ObjHandle pieces = ObjRegistry::Create<CollectionObj>(count);
+        vm->PushTemporary(pieces);
+        usize start = 0;
+        for (u32 i = 0; i < count; i++)
+        {
+            usize end = i == count - 1 ? string.size() : StringSearch::Find(string, separator, start);
+            ObjHandle piece = NativeFunctionsUtils::Slice(source, (u32)start, (u32)(end - start));
+            pieces.As<CollectionObj>().Items[i] = piece;
+            start = end + separator.size();
+        }
+        vm->PopTemporary();
+        result.Result = pieces;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn StartsWith = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'starts_with()' accepts 2 arguments, but {} given", argc)
+        if (!(StringUtils::IsString(argv[0]) && StringUtils::IsString(argv[1])))
+            return result;
+        result.Result = StringUtils::GetView(argv[0]).starts_with(StringUtils::GetView(argv[1]));
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Count = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'count()' accepts 2 arguments, but {} given", argc)
+        if (!(StringUtils::IsString(argv[0]) && StringUtils::IsString(argv[1])))
+            return result;
+        result.Result = Value::FromI64((i64)StringSearch::Count(StringUtils::GetView(argv[0]), StringUtils::GetView(argv[1])));
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Push = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'push()' accepts 2 arguments, but {} given", argc)
+        if (NativeFunctionsUtils::IsTable(argv[0]))
+        {
+            TableObj& table = argv[0].As<ObjHandle>().As<TableObj>();
+            CHECK_RETURN_RES(TableObj::IsRowSource(argv[1]), result, "'push()' to table expects struct, instance or row")
+            CHECK_RETURN_RES(table.PushRow(argv[1]), result, "'push()' failed to grow table of {} rows", table.RowCount)
             result.IsOk = true;
+            return result;
         }
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        CollectionObj& collection = argv[0].As<ObjHandle>().As<CollectionObj>();
+        collection.Materialize();
+        CHECK_RETURN_RES(collection.Push(argv[1]), result, "'push()' failed to grow collection of {} items", collection.ItemCount)
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Pop = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'pop()' accepts 1 argument, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        CollectionObj& collection = argv[0].As<ObjHandle>().As<CollectionObj>();
+        CHECK_RETURN_RES(collection.ItemCount > 0, result, "'pop()' called on empty collection")
+        collection.Materialize();
+        result.Result = collection.Pop();
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Insert = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 3, result, "'insert()' accepts 3 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>() &&
+            NativeFunctionsUtils::IsIndex(argv[1])))
+            return result;
+        CollectionObj& collection = argv[0].As<ObjHandle>().As<CollectionObj>();
+        u32 index = (u32)argv[1].As<f64>();
+        CHECK_RETURN_RES(index <= collection.ItemCount, result, "'insert()' index {} is out of range", index)
+        collection.Materialize();
+        CHECK_RETURN_RES(collection.Insert(index, argv[2]), result, "'insert()' failed to grow collection of {} items", collection.ItemCount)
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Extend = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'extend()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>() &&
+            argv[1].HasType<ObjHandle>() && argv[1].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        CollectionObj& collection = argv[0].As<ObjHandle>().As<CollectionObj>();
+        CollectionObj& other = argv[1].As<ObjHandle>().As<CollectionObj>();
+        collection.Materialize();
+        other.Materialize();
+        CHECK_RETURN_RES(collection.Extend(other), result, "'extend()' failed to grow collection of {} items by {}",
+            collection.ItemCount, other.ItemCount)
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Reserve = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'reserve()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>() &&
+            NativeFunctionsUtils::IsIndex(argv[1])))
+            return result;
+        CollectionObj& collection = argv[0].As<ObjHandle>().As<CollectionObj>();
+        collection.Materialize();
+        u32 capacity = (u32)argv[1].As<f64>();
+        CHECK_RETURN_RES(collection.Reserve(capacity), result, "'reserve()' failed to allocate {} items", capacity)
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Sort = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1 || argc == 2, result, "'sort()' accepts 1 or 2 arguments, but {} given", argc)
+        NativeFunctionsUtils::ValueLess less = {.Vm = vm};
+        if (argc == 2)
+        {
+            less.Comparator = argv[1];
+            less.HasComparator = true;
+        }
+        if (NativeFunctionsUtils::IsF64Array(argv[0]))
+        {
+            // f64 arrays never resize, so they are sorted in place even with comparator
+            F64ArrayObj& array = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+            if (argc == 1)
+                ::Sort::Introsort(array.Items, array.ItemCount, [](f64 a, f64 b) { return a < b; });
+            else
+                ::Sort::Introsort(array.Items, array.ItemCount, [&less](f64 a, f64 b) { return less(Value(a), Value(b)); });
+            result.IsOk = !less.IsFailed;
+            return result;
+        }
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        ObjHandle collection = argv[0].As<ObjHandle>();
+        collection.As<CollectionObj>().Materialize();
+        u32 count = collection.As<CollectionObj>().ItemCount;
+        if (argc == 1)
+        {
+            CHECK_RETURN_RES(NativeFunctionsUtils::SortDefault(collection.As<CollectionObj>().Items, count), result,
+                "'sort()' without comparator expects all numbers or all strings")
+            result.IsOk = true;
+            return result;
+        }
+
+        // the comparator is free to modify the collection, so the sort works on a copy, that nothing else sees
+        ObjHandle sorted = ObjRegistry::Create<CollectionObj>(count);
+        vm->PushTemporary(sorted);
+        std::copy_n(collection.As<CollectionObj>().Items, count, sorted.As<CollectionObj>().Items);
+        ::Sort::Introsort(sorted.As<CollectionObj>().Items, count, less);
+        if (less.IsAborted)
+            return result;
+        vm->PopTemporary();
+        if (less.IsFailed)
+            return result;
+        CHECK_RETURN_RES(collection.As<CollectionObj>().ItemCount == count, result, "'sort()' collection was resized by comparator")
+        std::copy_n(sorted.As<CollectionObj>().Items, count, collection.As<CollectionObj>().Items);
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn LowerBound = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::Search("lower_bound", argc, argv, vm, false);
+    };
+
+    inline NativeFn BinarySearch = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::Search("binary_search", argc, argv, vm, true);
+    };
+
+    inline NativeFn Map = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'map()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        ObjHandle collection = argv[0].As<ObjHandle>();
+        Value fn = argv[1];
+        collection.As<CollectionObj>().Materialize();
+        u32 count = collection.As<CollectionObj>().ItemCount;
+        ObjHandle mapped = ObjRegistry::Create<CollectionObj>(0);
+        CHECK_RETURN_RES(mapped.As<CollectionObj>().Reserve(count), result, "'map()' failed to allocate {} items", count)
+        vm->PushTemporary(mapped);
+        // `fn` is free to modify the collection, so it is re-read on each step
+        for (u32 i = 0; i < count && i < collection.As<CollectionObj>().ItemCount; i++)
+        {
+            Value item = collection.As<CollectionObj>().Items[i];
+            Value res;
+            if (!vm->CallFromNative(fn, 1, &item, res))
+                return result;
+            CHECK_RETURN_RES(mapped.As<CollectionObj>().Push(res), result, "'map()' failed to grow collection")
+        }
+        vm->PopTemporary();
+        result.Result = mapped;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Filter = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'filter()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        ObjHandle collection = argv[0].As<ObjHandle>();
+        Value fn = argv[1];
+        collection.As<CollectionObj>().Materialize();
+        u32 count = collection.As<CollectionObj>().ItemCount;
+        ObjHandle filtered = ObjRegistry::Create<CollectionObj>(0);
+        vm->PushTemporary(filtered);
+        for (u32 i = 0; i < count && i < collection.As<CollectionObj>().ItemCount; i++)
+        {
+            Value item = collection.As<CollectionObj>().Items[i];
+            Value keep;
+            if (!vm->CallFromNative(fn, 1, &item, keep))
+                return result;
+            if (!vm->IsFalsey(keep))
+                CHECK_RETURN_RES(filtered.As<CollectionObj>().Push(item), result, "'filter()' failed to grow collection")
+        }
+        vm->PopTemporary();
+        result.Result = filtered;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Reduce = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2 || argc == 3, result, "'reduce()' accepts 2 or 3 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        ObjHandle collection = argv[0].As<ObjHandle>();
+        Value fn = argv[1];
+        collection.As<CollectionObj>().Materialize();
+        u32 count = collection.As<CollectionObj>().ItemCount;
+        CHECK_RETURN_RES(argc == 3 || count > 0, result, "'reduce()' of empty collection expects initial value")
+        // the accumulator is not rooted between the calls, but nothing is allocated there
+        u32 first = argc == 3 ? 0 : 1;
+        Value accumulator = argc == 3 ? argv[2] : collection.As<CollectionObj>().Items[0];
+        for (u32 i = first; i < count && i < collection.As<CollectionObj>().ItemCount; i++)
+        {
+            Value args[2] = {accumulator, collection.As<CollectionObj>().Items[i]};
+            if (!vm->CallFromNative(fn, 2, args, accumulator))
+                return result;
+        }
+        result.Result = accumulator;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn ForEach = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'for_each()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        ObjHandle collection = argv[0].As<ObjHandle>();
+        Value fn = argv[1];
+        collection.As<CollectionObj>().Materialize();
+        u32 count = collection.As<CollectionObj>().ItemCount;
+        for (u32 i = 0; i < count && i < collection.As<CollectionObj>().ItemCount; i++)
+        {
+            Value item = collection.As<CollectionObj>().Items[i];
+            Value res;
+            if (!vm->CallFromNative(fn, 1, &item, res))
+                return result;
+        }
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn F64Array = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'f64_array()' accepts 1 argument, but {} given", argc)
+        if (argv[0].HasType<f64>())
+        {
+            CHECK_RETURN_RES(NativeFunctionsUtils::IsIndex(argv[0]), result, "'f64_array()' size {} is not a valid item count", argv[0])
+            u32 count = NativeFunctionsUtils::AsIndex(argv[0]);
+            result.Result = ObjRegistry::Create<F64ArrayObj>(count);
+            CHECK_RETURN_RES(result.Result.As<ObjHandle>().As<F64ArrayObj>().ItemCount == count, result,
+                "'f64_array()' failed to allocate {} items", count)
+            result.IsOk = true;
+            return result;
+        }
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        u32 count = argv[0].As<ObjHandle>().As<CollectionObj>().ItemCount;
+        ObjHandle array = ObjRegistry::Create<F64ArrayObj>(count);
+        CHECK_RETURN_RES(array.As<F64ArrayObj>().ItemCount == count, result, "'f64_array()' failed to allocate {} items", count)
+        CollectionObj& collection = argv[0].As<ObjHandle>().As<CollectionObj>();
+        for (u32 i = 0; i < collection.ItemCount; i++)
+        {
+            Value item = collection.Peek(i);
+            CHECK_RETURN_RES(item.HasType<f64>(), result, "'f64_array()' collection item {} is not a number", i)
+            array.As<F64ArrayObj>().Items[i] = item.As<f64>();
+        }
+        result.Result = array;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Fill = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'fill()' accepts 2 arguments, but {} given", argc)
+        if (NativeFunctionsUtils::IsGrid(argv[0]) && argv[1].HasType<f64>())
+        {
+            f64 val = argv[1].As<f64>();
+            argv[0].As<ObjHandle>().As<GridObj>().ForEachRow([val](f64* row, u32 length) { VectorMath::Fill(row, length, val); });
+            result.IsOk = true;
+            return result;
+        }
+        if (!(NativeFunctionsUtils::IsF64Array(argv[0]) && argv[1].HasType<f64>()))
+            return result;
+        F64ArrayObj& array = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        VectorMath::Fill(array.Items, array.ItemCount, argv[1].As<f64>());
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Sum = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'sum()' accepts 1 argument, but {} given", argc)
+        if (NativeFunctionsUtils::IsGrid(argv[0]))
+        {
+            f64 sum = 0.0;
+            argv[0].As<ObjHandle>().As<GridObj>().ForEachRow([&sum](const f64* row, u32 length) { sum += VectorMath::Sum(row, length); });
+            result.Result = sum;
+            result.IsOk = true;
+            return result;
+        }
+        if (!NativeFunctionsUtils::IsF64Array(argv[0]))
+            return result;
+        F64ArrayObj& array = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        result.Result = VectorMath::Sum(array.Items, array.ItemCount);
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Dot = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'dot()' accepts 2 arguments, but {} given", argc)
+        if (!(NativeFunctionsUtils::IsF64Array(argv[0]) && NativeFunctionsUtils::IsF64Array(argv[1])))
+            return result;
+        F64ArrayObj& a = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        F64ArrayObj& b = argv[1].As<ObjHandle>().As<F64ArrayObj>();
+        CHECK_RETURN_RES(a.ItemCount == b.ItemCount, result, "'dot()' arrays have different lengths: {} and {}", a.ItemCount, b.ItemCount)
+        result.Result = VectorMath::Dot(a.Items, b.Items, a.ItemCount);
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Scale = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'scale()' accepts 2 arguments, but {} given", argc)
+        if (!(NativeFunctionsUtils::IsF64Array(argv[0]) && argv[1].HasType<f64>()))
+            return result;
+        F64ArrayObj& array = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        VectorMath::Scale(array.Items, array.ItemCount, argv[1].As<f64>());
+        result.IsOk = true;
+        return result;
+    };
+
+    // axpy(a, x, y): y = a * x + y
+    inline NativeFn Axpy = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 3, result, "'axpy()' accepts 3 arguments, but {} given", argc)
+        if (!(argv[0].HasType<f64>() && NativeFunctionsUtils::IsF64Array(argv[1]) && NativeFunctionsUtils::IsF64Array(argv[2])))
+            return result;
+        F64ArrayObj& x = argv[1].As<ObjHandle>().As<F64ArrayObj>();
+        F64ArrayObj& y = argv[2].As<ObjHandle>().As<F64ArrayObj>();
+        CHECK_RETURN_RES(x.ItemCount == y.ItemCount, result, "'axpy()' arrays have different lengths: {} and {}", x.ItemCount, y.ItemCount)
+        VectorMath::Axpy(argv[0].As<f64>(), x.Items, y.Items, x.ItemCount);
+        result.IsOk = true;
+        return result;
+    };
+
+    // min(array) or min(a, b, ...)
+    inline NativeFn Min = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        if (argc >= 2)
+            return NativeFunctionsUtils::MinMax("min", argc, argv, true);
+        CHECK_RETURN_RES(argc == 1, result, "'min()' accepts 1 or more arguments, but {} given", argc)
+        if (!NativeFunctionsUtils::IsF64Array(argv[0]))
+            return result;
+        F64ArrayObj& array = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        CHECK_RETURN_RES(array.ItemCount > 0, result, "'min()' called on empty array")
+        result.Result = VectorMath::Min(array.Items, array.ItemCount);
+        result.IsOk = true;
+        return result;
+    };
+
+    // max(array) or max(a, b, ...)
+    inline NativeFn Max = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        if (argc >= 2)
+            return NativeFunctionsUtils::MinMax("max", argc, argv, false);
+        CHECK_RETURN_RES(argc == 1, result, "'max()' accepts 1 or more arguments, but {} given", argc)
+        if (!NativeFunctionsUtils::IsF64Array(argv[0]))
+            return result;
+        F64ArrayObj& array = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        CHECK_RETURN_RES(array.ItemCount > 0, result, "'max()' called on empty array")
+        result.Result = VectorMath::Max(array.Items, array.ItemCount);
+        result.IsOk = true;
+        return result;
+    };
+
+    // add(a, b): a = a + b
+    inline NativeFn Add = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'add()' accepts 2 arguments, but {} given", argc)
+        if (!(NativeFunctionsUtils::IsF64Array(argv[0]) && NativeFunctionsUtils::IsF64Array(argv[1])))
+            return result;
+        F64ArrayObj& a = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        F64ArrayObj& b = argv[1].As<ObjHandle>().As<F64ArrayObj>();
+        CHECK_RETURN_RES(a.ItemCount == b.ItemCount, result, "'add()' arrays have different lengths: {} and {}", a.ItemCount, b.ItemCount)
+        VectorMath::Add(a.Items, b.Items, a.ItemCount);
+        result.IsOk = true;
+        return result;
+    };
+
+    // mul(a, b): a = a * b
+    inline NativeFn Mul = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'mul()' accepts 2 arguments, but {} given", argc)
+        if (!(NativeFunctionsUtils::IsF64Array(argv[0]) && NativeFunctionsUtils::IsF64Array(argv[1])))
+            return result;
+        F64ArrayObj& a = argv[0].As<ObjHandle>().As<F64ArrayObj>();
+        F64ArrayObj& b = argv[1].As<ObjHandle>().As<F64ArrayObj>();
+        CHECK_RETURN_RES(a.ItemCount == b.ItemCount, result, "'mul()' arrays have different lengths: {} and {}", a.ItemCount, b.ItemCount)
+        VectorMath::Mul(a.Items, b.Items, a.ItemCount);
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Dict = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 0, result, "'dict()' accepts 0 arguments, but {} given", argc)
+        result.Result = ObjRegistry::Create<DictObj>();
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Keys = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'keys()' accepts 1 argument, but {} given", argc)
+        if (!NativeFunctionsUtils::IsDict(argv[0]))
+            return result;
+        ObjHandle keys = ObjRegistry::Create<CollectionObj>(argv[0].As<ObjHandle>().As<DictObj>().Map.GetCount());
+        u32 i = 0;
+        argv[0].As<ObjHandle>().As<DictObj>().Map.ForEach([&](const Value& key, const Value&) { keys.As<CollectionObj>().Items[i++] = key; });
+        result.Result = keys;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Values = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'values()' accepts 1 argument, but {} given", argc)
+        if (!NativeFunctionsUtils::IsDict(argv[0]))
+            return result;
+        ObjHandle values = ObjRegistry::Create<CollectionObj>(argv[0].As<ObjHandle>().As<DictObj>().Map.GetCount());
+        u32 i = 0;
+        argv[0].As<ObjHandle>().As<DictObj>().Map.ForEach([&](const Value&, const Value& val) { values.As<CollectionObj>().Items[i++] = val; });
+        result.Result = values;
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Has = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'has()' accepts 2 arguments, but {} given", argc)
+        if (!NativeFunctionsUtils::IsDict(argv[0]))
+            return result;
+        result.Result = argv[0].As<ObjHandle>().As<DictObj>().Map.Find(argv[1]) != nullptr;
+        result.IsOk = true;
+        return result;
+    };
+
+    // returns true, if key was present
+    inline NativeFn Remove = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'remove()' accepts 2 arguments, but {} given", argc)
+        if (!NativeFunctionsUtils::IsDict(argv[0]))
+            return result;
+        result.Result = argv[0].As<ObjHandle>().As<DictObj>().Remove(argv[1]);
+        result.IsOk = true;
+        return result;
+    };
+
+    // grid(d0, d1, ...): zero-filled grid, the last dimension is contiguous
+    inline NativeFn Grid = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc >= 1 && argc <= GridObj::MAX_RANK, result, "'grid()' accepts 1 to {} arguments, but {} given", GridObj::MAX_RANK, argc)
+        std::array<u32, GridObj::MAX_RANK> shape{};
+        for (u32 dim = 0; dim < argc; dim++)
+        {
+            if (!NativeFunctionsUtils::IsIndex(argv[dim]))
+                return result;
+            shape[dim] = NativeFunctionsUtils::AsIndex(argv[dim]);
+        }
+        CHECK_RETURN_RES(GridObj::IsValidShape(shape.data(), argc), result, "'grid()' cannot hold more than {} elements", GridObj::MAX_COUNT)
+        u64 count = 1;
+        for (u32 dim = 0; dim < argc; dim++) count *= shape[dim];
+        result.Result = ObjRegistry::Create<GridObj>(shape.data(), (u32)argc);
+        CHECK_RETURN_RES(result.Result.As<ObjHandle>().As<GridObj>().GetCount() == count, result, "'grid()' failed to allocate {} elements", count)
+        result.IsOk = true;
+        return result;
+    };
+
+    // grid_view(g, o0, o1, ..., s0, s1, ...): view of `g` of shape s0 x s1 x ... at offset (o0, o1, ...)
+    inline NativeFn GridView = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc >= 1, result, "'grid_view()' accepts at least 1 argument, but {} given", argc)
+        if (!NativeFunctionsUtils::IsGrid(argv[0]))
+            return result;
+        ObjHandle gridH = argv[0].As<ObjHandle>();
+        const GridObj& grid = gridH.As<GridObj>();
+        CHECK_RETURN_RES(argc == 1 + 2 * grid.Rank, result, "'grid_view()' of grid of rank {} accepts {} arguments, but {} given", grid.Rank, 1 + 2 * grid.Rank, argc)
+        std::array<u32, GridObj::MAX_RANK> shape{};
+        f64* data = grid.Data;
+        for (u32 dim = 0; dim < grid.Rank; dim++)
+        {
+            Value offset = argv[1 + dim];
+            Value size = argv[1 + grid.Rank + dim];
+            if (!(NativeFunctionsUtils::IsIndex(offset) && NativeFunctionsUtils::IsIndex(size)))
+                return result;
+            CHECK_RETURN_RES((u64)offset.As<f64>() + (u64)size.As<f64>() <= grid.Shape[dim], result,
+                "'grid_view()' view is out of grid bounds in dimension {}", dim)
+            shape[dim] = (u32)size.As<f64>();
+            data += (u64)offset.As<f64>() * grid.Strides[dim];
+        }
+        result.Result = ObjRegistry::Create<GridObj>(grid.GetOwner(gridH), data, shape.data(), grid.Strides.data(), grid.Rank);
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Shape = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'shape()' accepts 1 argument, but {} given", argc)
+        if (!NativeFunctionsUtils::IsGrid(argv[0]))
+            return result;
+        ObjHandle shape = ObjRegistry::Create<CollectionObj>(argv[0].As<ObjHandle>().As<GridObj>().Rank);
+        const GridObj& grid = argv[0].As<ObjHandle>().As<GridObj>();
+        for (u32 dim = 0; dim < grid.Rank; dim++) shape.As<CollectionObj>().Items[dim] = Value::FromI64((i64)grid.Shape[dim]);
+        result.Result = shape;
+        result.IsOk = true;
+        return result;
+    };
+
+    // neighbours(g): new grid with sums of 8 neighbours of each cell of 2d grid, edges wrap around
+    inline NativeFn Neighbours = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'neighbours()' accepts 1 argument, but {} given", argc)
+        if (!NativeFunctionsUtils::IsGrid(argv[0]))
+            return result;
+        CHECK_RETURN_RES(argv[0].As<ObjHandle>().As<GridObj>().Rank == 2, result, "'neighbours()' expects 2d grid")
+        ObjHandle sums = ObjRegistry::Create<GridObj>(argv[0].As<ObjHandle>().As<GridObj>().Shape.data(), 2);
+        const GridObj& grid = argv[0].As<ObjHandle>().As<GridObj>();
+        GridObj& sumsGrid = sums.As<GridObj>();
+        CHECK_RETURN_RES(sumsGrid.GetCount() == grid.GetCount(), result, "'neighbours()' failed to allocate {} elements", grid.GetCount())
+        Stencil::NeighbourSum(grid.Data, grid.Strides[0], sumsGrid.Data, sumsGrid.Strides[0], grid.Shape[0], grid.Shape[1]);
+        result.Result = sums;
+        result.IsOk = true;
+        return result;
+    };
+
+    // convolve(g, kernel): new grid, edges wrap around, kernel is centered
+    inline NativeFn Convolve = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'convolve()' accepts 2 arguments, but {} given", argc)
+        if (!(NativeFunctionsUtils::IsGrid(argv[0]) && NativeFunctionsUtils::IsGrid(argv[1])))
+            return result;
+        CHECK_RETURN_RES(argv[0].As<ObjHandle>().As<GridObj>().Rank == 2 && argv[1].As<ObjHandle>().As<GridObj>().Rank == 2, result,
+            "'convolve()' expects 2d grid and 2d kernel")
+        ObjHandle convolved = ObjRegistry::Create<GridObj>(argv[0].As<ObjHandle>().As<GridObj>().Shape.data(), 2);
+        const GridObj& grid = argv[0].As<ObjHandle>().As<GridObj>();
+        const GridObj& kernel = argv[1].As<ObjHandle>().As<GridObj>();
+        GridObj& convolvedGrid = convolved.As<GridObj>();
+        CHECK_RETURN_RES(convolvedGrid.GetCount() == grid.GetCount(), result, "'convolve()' failed to allocate {} elements", grid.GetCount())
+        Stencil::Convolve(grid.Data, grid.Strides[0], convolvedGrid.Data, convolvedGrid.Strides[0], grid.Shape[0], grid.Shape[1],
+            kernel.Data, kernel.Strides[0], kernel.Shape[0], kernel.Shape[1]);
+        result.Result = convolved;
+        result.IsOk = true;
+        return result;
+    };
+
+    // table(type, count[, fields]): `count` rows of struct `type` stored column by column, all cells nil;
+    // instances of classes have no fixed layout, so for a class `fields` collection of names is required
+    inline NativeFn Table = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2 || argc == 3, result, "'table()' accepts 2 or 3 arguments, but {} given", argc)
+        if (!(argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<ClassObj>() && NativeFunctionsUtils::IsIndex(argv[1])))
+            return result;
+        const ClassObj& type = argv[0].As<ObjHandle>().As<ClassObj>();
+        std::vector<ObjHandle> fieldNames = type.FieldNames;
+        if (argc == 3 && !(argv[2].HasType<ObjHandle>() && argv[2].As<ObjHandle>().HasType<CollectionObj>()))
+            return result;
+        // names must be interned to be matched against property names, and they are unreachable
+        // (interned strings are weak) until the table holds them
+        GarbageCollector::Suspend();
+        if (argc == 3)
+        {
+            CollectionObj& fields = argv[2].As<ObjHandle>().As<CollectionObj>();
+            fieldNames.clear();
+            for (u32 i = 0; i < fields.ItemCount; i++)
+            {
+                Value name = fields.Peek(i);
+                if (!StringUtils::IsString(name))
+                {
+                    GarbageCollector::Resume();
+                    return result;
+                }
+                fieldNames.push_back(vm->AddString(std::string{StringUtils::GetView(name)}));
+            }
+        }
+        u32 rowCount = (u32)argv[1].As<f64>();
+        if (!fieldNames.empty())
+            result.Result = ObjRegistry::Create<TableObj>(argv[0].As<ObjHandle>(), fieldNames, rowCount);
+        GarbageCollector::Resume();
+        CHECK_RETURN_RES(!fieldNames.empty(), result, "'table()' of class {} requires a collection of field names", type.Name)
+        CHECK_RETURN_RES(result.Result.As<ObjHandle>().As<TableObj>().RowCount == rowCount, result,
+            "'table()' failed to allocate {} rows of {} columns", rowCount, fieldNames.size())
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Abs = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 1, result, "'abs()' accepts 1 argument, but {} given", argc)
+        if (argv[0].HasType<i32>())
+            result.Result = Value::FromI64(std::abs((i64)argv[0].As<i32>()));
+        else if (argv[0].HasType<f64>())
+            result.Result = std::abs(argv[0].As<f64>());
+        else
+            return result;
+        result.IsOk = true;
+        return result;
+    };
+
+    // floor, ceil and round give integers, unless the result is out of integer range
+    inline NativeFn Floor = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = NativeFunctionsUtils::UnaryMath("floor", argc, argv, [](f64 x) { return std::floor(x); });
+        if (result.IsOk) result.Result = NativeFunctionsUtils::Integral(result.Result.As<f64>());
+        return result;
+    };
+
+    inline NativeFn Ceil = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = NativeFunctionsUtils::UnaryMath("ceil", argc, argv, [](f64 x) { return std::ceil(x); });
+        if (result.IsOk) result.Result = NativeFunctionsUtils::Integral(result.Result.As<f64>());
+        return result;
+    };
+
+    inline NativeFn Round = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = NativeFunctionsUtils::UnaryMath("round", argc, argv, [](f64 x) { return std::round(x); });
+        if (result.IsOk) result.Result = NativeFunctionsUtils::Integral(result.Result.As<f64>());
+        return result;
+    };
+
+    inline NativeFn Sqrt = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::UnaryMath("sqrt", argc, argv, [](f64 x) { return std::sqrt(x); });
+    };
+
+    inline NativeFn Exp = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::UnaryMath("exp", argc, argv, [](f64 x) { return std::exp(x); });
+    };
+
+    inline NativeFn Log = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::UnaryMath("log", argc, argv, [](f64 x) { return std::log(x); });
+    };
+
+    inline NativeFn Sin = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::UnaryMath("sin", argc, argv, [](f64 x) { return std::sin(x); });
+    };
+
+    inline NativeFn Cos = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::UnaryMath("cos", argc, argv, [](f64 x) { return std::cos(x); });
+    };
+
+    inline NativeFn Tan = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::UnaryMath("tan", argc, argv, [](f64 x) { return std::tan(x); });
+    };
+
+    inline NativeFn Atan = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        return NativeFunctionsUtils::UnaryMath("atan", argc, argv, [](f64 x) { return std::atan(x); });
+    };
+
+    inline NativeFn Atan2 = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'atan2()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<f64>() && argv[1].HasType<f64>()))
+            return result;
+        result.Result = std::atan2(argv[0].As<f64>(), argv[1].As<f64>());
+        result.IsOk = true;
+        return result;
+    };
+
+    inline NativeFn Pow = [](u8 argc, Value* argv, VirtualMachine* vm) {
+        NativeFnCallResult result = {};
+        CHECK_RETURN_RES(argc == 2, result, "'pow()' accepts 2 arguments, but {} given", argc)
+        if (!(argv[0].HasType<f64>() && argv[1].HasType<f64>()))
+            return result;
+        result.Result = std::pow(argv[0].As<f64>(), argv[1].As<f64>());
+        result.IsOk = true;
         return result;
     };
 }
@@ -1,9 +1,478 @@
 ﻿#include "Obj.h"
 
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#include "Common/StringSearch.h"
+
 std::vector<ObjRecord> ObjRegistry::s_Records = std::vector<ObjRecord>{};
 u64 ObjRegistry::s_FreeList = FREELIST_EMPTY;
+std::vector<void*> StructObj::s_FreeList = std::vector<void*>{};
+
+u32 ClassObj::GetFieldIndex(ObjHandle name) const
+{
+    // structs are small, linear scan beats any lookup structure here
+    for (u32 i = 0; i < (u32)FieldNames.size(); i++)
+    {
+        if (FieldNames[i] == name) return i;
+    }
+    return NO_FIELD;
+}
+
+CollectionObj::CollectionObj(u32 itemCount) : Obj(ObjType::Collection)
+{
+    // sized collections are made for items, that already exist elsewhere, only growing can fail gracefully
+    bool isAllocated = Reserve(itemCount);
+    BCVM_ASSERT(isAllocated, "Failed to allocate {} items of collection.", itemCount)
+    std::uninitialized_fill_n(Items, itemCount, Value{nullptr});
+    ItemCount = itemCount;
+}
+
+CollectionObj::CollectionObj(ObjHandle pattern, u32 itemCount) : Obj(ObjType::Collection), ItemCount(itemCount), Pattern(pattern)
+{
+}
+
+CollectionObj::~CollectionObj()
+{
+    GarbageCollector::TrackDeallocation(sizeof(Value) * Capacity);
+    free(Items);
+}
+
+bool CollectionObj::Reserve(u32 capacity)
+{
+    if (capacity <= Capacity) return true;
+    // values are trivially copyable, so realloc is fine here
+    Value* items = static_cast<Value*>(realloc(Items, sizeof(Value) * capacity));
+    if (items == nullptr) return false;
+    Items = items;
+    GarbageCollector::TrackAllocation(sizeof(Value) * (capacity - Capacity));
+    Capacity = capacity;
+    return true;
+}
+
+bool CollectionObj::Push(Value val)
+{
+    if (ItemCount == Capacity && !Grow((u64)ItemCount + 1)) return false;
+    Items[ItemCount++] = val;
+    return true;
+}
+
+bool CollectionObj::Grow(u64 required)
+{
+    if (required > std::numeric_limits<u32>::max()) return false;
+    u64 grown = std::max<u64>({MIN_CAPACITY, (u64)Capacity * GROWTH_FACTOR, required});
+    return Reserve((u32)std::min<u64>(grown, std::numeric_limits<u32>::max()));
+}
+
+Value CollectionObj::Pop()
+{
+    return Items[--ItemCount];
+}
+
+bool CollectionObj::Insert(u32 index, Value val)
+{
+    if (ItemCount == Capacity && !Grow((u64)ItemCount + 1)) return false;
+    std::memmove(Items + index + 1, Items + index, sizeof(Value) * (ItemCount - index));
+    Items[index] = val;
+    ItemCount++;
+    return true;
+}
+
+bool CollectionObj::Extend(const CollectionObj& other)
+{
+    // `other` might be this collection, so its count is read before growing
+    u32 otherCount = other.ItemCount;
+    if ((u64)ItemCount + otherCount > Capacity && !Grow((u64)ItemCount + otherCount)) return false;
+    if (otherCount > 0) std::memcpy(Items + ItemCount, other.Items, sizeof(Value) * otherCount);
+    ItemCount += otherCount;
+    return true;
+}
+
+Value CollectionObj::Get(u32 index)
+{
+    if (Items == nullptr)
+    {
+        const CollectionObj& pattern = Pattern.As<CollectionObj>();
+        Value item = pattern.Items[index % pattern.ItemCount];
+        // primitives are shared as is, so reading them does not need any storage
+        if (!item.HasType<ObjHandle>()) return item;
+        MakeReplicaStorage();
+    }
+    if (SharedCount > 0 && Shared[index])
+    {
+        Items[index] = ObjRegistry::Clone(Items[index].As<ObjHandle>());
+        Shared[index] = false;
+        if (--SharedCount == 0) ReleasePattern();
+    }
+    return Items[index];
+}
+
+Value CollectionObj::Peek(u32 index) const
+{
+    if (Items == nullptr)
+    {
+        const CollectionObj& pattern = Pattern.As<CollectionObj>();
+        return pattern.Items[index % pattern.ItemCount];
+    }
+    return Items[index];
+}
+
+void CollectionObj::Set(u32 index, Value val)
+{
+    if (Items == nullptr) MakeReplicaStorage();
+    if (SharedCount > 0 && Shared[index])
+    {
+        Shared[index] = false;
+        if (--SharedCount == 0) ReleasePattern();
+    }
+    Items[index] = val;
+}
+
+void CollectionObj::Materialize()
+{
+    if (!IsReplica()) return;
+    if (Items == nullptr) MakeReplicaStorage();
+    if (SharedCount == 0) return;
+    // partially cloned collection is not consistent, so gc has to wait
+    GarbageCollector::Suspend();
+    for (u32 i = 0; i < ItemCount; i++)
+    {
+        if (Shared[i]) Items[i] = ObjRegistry::Clone(Items[i].As<ObjHandle>());
+    }
+    GarbageCollector::Resume();
+    ReleasePattern();
+}
+
+void CollectionObj::MakeReplicaStorage()
+{
+    const CollectionObj& pattern = Pattern.As<CollectionObj>();
+    Reserve(ItemCount);
+    for (u32 i = 0; i < ItemCount; i += pattern.ItemCount)
+    {
+        std::memcpy(Items + i, pattern.Items, sizeof(Value) * std::min(pattern.ItemCount, ItemCount - i));
+    }
+    // object items are still pattern's objects, they are cloned on first touch
+    Shared.assign(ItemCount, false);
+    for (u32 patternI = 0; patternI < pattern.ItemCount; patternI++)
+    {
+        if (!pattern.Items[patternI].HasType<ObjHandle>()) continue;
+        for (u32 i = patternI; i < ItemCount; i += pattern.ItemCount)
+        {
+            Shared[i] = true;
+            SharedCount++;
+        }
+    }
+    if (SharedCount == 0) ReleasePattern();
+}
+
+void CollectionObj::ReleasePattern()
+{
+    Pattern = ObjHandle::NonHandle();
+    SharedCount = 0;
+    Shared = {};
+}
+
+StructObj::StructObj(ObjHandle type) : Obj(ObjType::Struct), Type(type)
+{
+    FieldCount = (u32)type.As<ClassObj>().FieldNames.size();
+    if (FieldCount <= INLINE_FIELDS)
+    {
+        Fields = InlineFields.data();
+        return;
+    }
+    Fields = new Value[FieldCount]{};
+    GarbageCollector::TrackAllocation(sizeof(Value) * FieldCount);
+}
+
+void* StructObj::operator new(std::size_t size)
+{
+    if (s_FreeList.empty()) return ::operator new(size);
+    void* memory = s_FreeList.back();
+    s_FreeList.pop_back();
+    return memory;
+}
+
+void StructObj::operator delete(void* ptr)
+{
+    if (s_FreeList.size() >= MAX_FREE_LIST)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    s_FreeList.push_back(ptr);
+}
+
+void StructObj::ReleaseFreeList()
+{
+    for (void* memory : s_FreeList) ::operator delete(memory);
+    s_FreeList = {};
+}
+
+StructObj::~StructObj()
+{
+    if (Fields == InlineFields.data()) return;
+    GarbageCollector::TrackDeallocation(sizeof(Value) * FieldCount);
+    delete[] Fields;
+}
+
+TableObj::TableObj(ObjHandle type, const std::vector<ObjHandle>& fieldNames, u32 rowCount) : Obj(ObjType::Table),
+    Type(type), FieldNames(fieldNames)
+{
+    // table stays empty, if there is no memory for its rows
+    if (!Reserve(rowCount)) return;
+    RowCount = rowCount;
+}
+
+TableObj::~TableObj()
+{
+    GarbageCollector::TrackDeallocation(sizeof(Value) * FieldNames.size() * Capacity);
+    free(Cells);
+}
+
+u32 TableObj::GetFieldIndex(ObjHandle name) const
+{
+    for (u32 i = 0; i < (u32)FieldNames.size(); i++)
+    {
+        if (FieldNames[i] == name) return i;
+    }
+    return ClassObj::NO_FIELD;
+}
+
+bool TableObj::Reserve(u32 capacity)
+{
+    if (capacity <= Capacity && Cells != nullptr) return true;
+    capacity = std::max(capacity, Capacity);
+    u64 fieldCount = FieldNames.size();
+    if (fieldCount * capacity > std::numeric_limits<usize>::max() / sizeof(Value)) return false;
+    Value* cells = static_cast<Value*>(malloc(sizeof(Value) * std::max<u64>(1, fieldCount * capacity)));
+    if (cells == nullptr) return false;
+    std::uninitialized_fill_n(cells, fieldCount * capacity, Value{nullptr});
+    // columns move apart, so each one is copied separately
+    for (u64 field = 0; field < fieldCount && RowCount > 0; field++)
+    {
+        std::memcpy(cells + field * capacity, Cells + field * Capacity, sizeof(Value) * RowCount);
+    }
+    free(Cells);
+    GarbageCollector::TrackAllocation(sizeof(Value) * fieldCount * (capacity - Capacity));
+    Cells = cells;
+    Capacity = capacity;
+    return true;
+}
+
+bool TableObj::IsRowSource(Value val)
+{
+    if (!val.HasType<ObjHandle>()) return false;
+    ObjType type = val.As<ObjHandle>().GetType();
+    return type == ObjType::Struct || type == ObjType::Instance || type == ObjType::Row;
+}
+
+bool TableObj::SetRow(u32 row, Value val)
+{
+    if (!IsRowSource(val)) return false;
+    ObjHandle obj = val.As<ObjHandle>();
+    // row of this very table might be the source, so fields are gathered before any write
+    std::vector<Value> fields(FieldNames.size(), Value{nullptr});
+    switch (obj.GetType())
+    {
+    case ObjType::Struct:
+        {
+            const StructObj& structObj = obj.As<StructObj>();
+            for (u32 i = 0; i < (u32)FieldNames.size(); i++)
+            {
+                u32 field = structObj.Type.As<ClassObj>().GetFieldIndex(FieldNames[i]);
+                if (field != ClassObj::NO_FIELD) fields[i] = structObj.Fields[field];
+            }
+            break;
+        }
+    case ObjType::Instance:
+        {
+            const InstanceObj& instance = obj.As<InstanceObj>();
+            for (u32 i = 0; i < (u32)FieldNames.size(); i++)
+            {
+                if (instance.Fields.Has(FieldNames[i])) fields[i] = instance.Fields[FieldNames[i]];
+            }
+            break;
+        }
+    case ObjType::Row:
+        {
+            const RowObj& source = obj.As<RowObj>();
+            const TableObj& table = source.Table.As<TableObj>();
+            for (u32 i = 0; i < (u32)FieldNames.size(); i++)
+            {
+                u32 field = table.GetFieldIndex(FieldNames[i]);
+                if (field != ClassObj::NO_FIELD) fields[i] = table.GetColumn(field)[source.Index];
+            }
+            break;
+        }
+    default:
+        return false;
+    }
+    for (u32 i = 0; i < (u32)FieldNames.size(); i++) GetColumn(i)[row] = fields[i];
+    return true;
+}
+
+bool TableObj::PushRow(Value val)
+{
+    if (RowCount == Capacity)
+    {
+        if (RowCount == std::numeric_limits<u32>::max()) return false;
+        u64 grown = std::max<u64>(MIN_CAPACITY, (u64)Capacity * GROWTH_FACTOR);
+        if (!Reserve((u32)std::min<u64>(grown, std::numeric_limits<u32>::max()))) return false;
+    }
+    if (!SetRow(RowCount, val)) return false;
+    RowCount++;
+    return true;
+}
+
+F64ArrayObj::F64ArrayObj(u32 itemCount) : Obj(ObjType::F64Array), ItemCount(itemCount)
+{
+    if (itemCount == 0) return;
+    // aligned allocation size has to be a multiple of alignment
+    usize bytes = (sizeof(f64) * itemCount + ALIGNMENT - 1) & ~(usize)(ALIGNMENT - 1);
+#ifdef _MSC_VER
+    Items = static_cast<f64*>(_aligned_malloc(bytes, ALIGNMENT));
+#else
+    Items = static_cast<f64*>(std::aligned_alloc(ALIGNMENT, bytes));
+#endif
+    if (Items == nullptr)
+    {
+        ItemCount = 0;
+        return;
+    }
+    std::memset(Items, 0, sizeof(f64) * itemCount);
+    GarbageCollector::TrackAllocation(sizeof(f64) * itemCount);
+}
+
+F64ArrayObj::~F64ArrayObj()
+{
+    GarbageCollector::TrackDeallocation(sizeof(f64) * ItemCount);
+#ifdef _MSC_VER
+    _aligned_free(Items);
+#else
+    std::free(Items);
+#endif
+}
+
+DictObj::~DictObj()
+{
+    GarbageCollector::TrackDeallocation(Map.GetAllocatedBytes());
+}
+
+void DictObj::Set(Value key, Value val)
+{
+    u64 allocated = Map.GetAllocatedBytes();
+    Map.Set(key, val);
+    GarbageCollector::TrackAllocation(Map.GetAllocatedBytes() - allocated);
+}
+
+void DictObj::Reserve(u32 count)
+{
+    u64 allocated = Map.GetAllocatedBytes();
+    Map.Reserve(count);
+    GarbageCollector::TrackAllocation(Map.GetAllocatedBytes() - allocated);
+}
+
+bool DictObj::Remove(Value key)
+{
+    return Map.Remove(key);
+}
+
+GridObj::GridObj(const u32* shape, u32 rank) : Obj(ObjType::Grid), Rank(rank)
+{
+    u64 stride = 1;
+    for (i32 dim = (i32)rank - 1; dim >= 0; dim--)
+    {
+        Shape[dim] = shape[dim];
+        Strides[dim] = (u32)stride;
+        stride *= shape[dim];
+    }
+    if (stride == 0) return;
+    Data = static_cast<f64*>(std::calloc(stride, sizeof(f64)));
+    if (Data == nullptr)
+    {
+        Shape.fill(0);
+        Strides.fill(0);
+        return;
+    }
+    GarbageCollector::TrackAllocation(sizeof(f64) * stride);
+}
+
+GridObj::GridObj(ObjHandle base, f64* data, const u32* shape, const u32* strides, u32 rank) : Obj(ObjType::Grid),
+    Base(base), Data(data), Rank(rank)
+{
+    std::copy_n(shape, rank, Shape.begin());
+    std::copy_n(strides, rank, Strides.begin());
+}
+
+GridObj::~GridObj()
+{
+    if (Base != ObjHandle::NonHandle()) return;
+    GarbageCollector::TrackDeallocation(sizeof(f64) * GetCount());
+    std::free(Data);
+}
+
+u64 GridObj::GetCount() const
+{
+    u64 count = 1;
+    for (u32 dim = 0; dim < Rank; dim++) count *= Shape[dim];
+    return count;
+}
+
+bool GridObj::IsValidShape(const u32* shape, u32 rank)
+{
+    if (std::find(shape, shape + rank, 0u) != shape + rank) return true;
+    // the product stays within u32 before each step, so it never overflows u64
+    u64 count = 1;
+    for (u32 dim = 0; dim < rank; dim++)
+    {
+        count *= shape[dim];
+        if (count > MAX_COUNT) return false;
+    }
+    return true;
+}
 
 ObjHandle ObjRegistry::Clone(ObjHandle obj)
+{
+    // clones are unreachable until returned, so gc has to wait
+    GarbageCollector::Suspend();
+    ObjHandle clone = CloneObj(obj);
+    GarbageCollector::Resume();
+    return clone;
+}
+
+ObjHandle FileObj::ReadLine(OutputBuffer& output)
+{
+    for (;;)
+    {
+        std::string_view unread = Chunk == ObjHandle::NonHandle() ? std::string_view{} :
+            std::string_view{Chunk.As<StringObj>().String}.substr(Position);
+        usize lineEnd = StringSearch::FindByte(unread.data(), unread.size(), '\n');
+        if (lineEnd != StringSearch::NPOS || (IsEof && !unread.empty()))
+        {
+            u32 start = Position;
+            u32 length = lineEnd == StringSearch::NPOS ? (u32)unread.size() : (u32)lineEnd;
+            Position += lineEnd == StringSearch::NPOS ? length : length + 1;
+            if (length > 0 && unread[length - 1] == '\r') length--;
+            return ObjRegistry::Create<StringSliceObj>(Chunk, start, length);
+        }
+        if (IsEof)
+            return ObjHandle::NonHandle();
+
+        // the unfinished line moves to the new chunk, old chunk stays intact for the lines taken from it
+        if (Reader.IsStdin()) output.Flush();
+        Buffer.resize(std::max<usize>({Buffer.size(), BUFFER_SIZE, 2 * unread.size()}));
+        std::memcpy(Buffer.data(), unread.data(), unread.size());
+        usize read = Reader.Read(Buffer.data() + unread.size(), Buffer.size() - unread.size());
+        IsEof = read == 0;
+        Chunk = ObjRegistry::Create<StringObj>(std::string_view{Buffer.data(), unread.size() + read});
+        Position = 0;
+    }
+}
+
+ObjHandle ObjRegistry::CloneObj(ObjHandle obj)
 {
     switch (obj.GetType())
     {
@@ -24,7 +493,7 @@ ObjHandle ObjRegistry::Clone(ObjHandle obj)
             ObjHandle clone = Create<ClosureObj>(obj.As<ClosureObj>().Fun);
             for (u32 i = 0; i < clone.As<ClosureObj>().UpvalueCount; i++)
             {
-                clone.As<ClosureObj>().Upvalues[i] = Clone(obj.As<ClosureObj>().Upvalues[i]);
+                clone.As<ClosureObj>().Upvalues[i] = CloneObj(obj.As<ClosureObj>().Upvalues[i]);
             }
             return clone;
         }
@@ -35,7 +504,7 @@ ObjHandle ObjRegistry::Clone(ObjHandle obj)
                 ObjHandle clone = Create<UpvalueObj>();
                 if (obj.As<UpvalueObj>().Closed.HasType<ObjHandle>())
                 {
-                    clone.As<UpvalueObj>().Closed = Clone(obj.As<UpvalueObj>().Closed.As<ObjHandle>());
+                    clone.As<UpvalueObj>().Closed = CloneObj(obj.As<UpvalueObj>().Closed.As<ObjHandle>());
                 }
                 else
                 {
@@ -51,6 +520,8 @@ ObjHandle ObjRegistry::Clone(ObjHandle obj)
         {
             ObjHandle clone = Create<ClassObj>(obj.As<ClassObj>().Name);
             clone.As<ClassObj>().Methods = obj.As<ClassObj>().Methods;
+            clone.As<ClassObj>().IsStruct = obj.As<ClassObj>().IsStruct;
+            clone.As<ClassObj>().FieldNames = obj.As<ClassObj>().FieldNames;
             return clone;
         }
     case ObjType::Instance:
@@ -61,21 +532,26 @@ ObjHandle ObjRegistry::Clone(ObjHandle obj)
             {
                 if (val.HasType<ObjHandle>())
                 {
-                    val = Clone(val.As<ObjHandle>());
+                    val = CloneObj(val.As<ObjHandle>());
                 }
             }
             return clone;
         }
     case ObjType::BoundMethod:
-        return Create<BoundMethodObj>(Clone(obj.As<BoundMethodObj>().Receiver), Clone(obj.As<BoundMethodObj>().Method));
+        return Create<BoundMethodObj>(CloneObj(obj.As<BoundMethodObj>().Receiver), CloneObj(obj.As<BoundMethodObj>().Method));
     case ObjType::Collection:
         {
+            // untouched replica can share its pattern
+            if (obj.As<CollectionObj>().IsReplica() && obj.As<CollectionObj>().Items == nullptr)
+            {
+                return Create<CollectionObj>(obj.As<CollectionObj>().Pattern, obj.As<CollectionObj>().ItemCount);
+            }
             ObjHandle clone = Create<CollectionObj>(obj.As<CollectionObj>().ItemCount);
             for (u32 i = 0; i < obj.As<CollectionObj>().ItemCount; i++)
             {
                 if (obj.As<CollectionObj>().Items[i].HasType<ObjHandle>())
                 {
-                    clone.As<CollectionObj>().Items[i] = Clone(obj.As<CollectionObj>().Items[i].As<ObjHandle>());
+                    clone.As<CollectionObj>().Items[i] = CloneObj(obj.As<CollectionObj>().Items[i].As<ObjHandle>());
                 }
                 else
                 {
@@ -84,6 +560,87 @@ ObjHandle ObjRegistry::Clone(ObjHandle obj)
             }
             return clone;
         }
+    case ObjType::Struct:
+        {
+            ObjHandle clone = Create<StructObj>(obj.As<StructObj>().Type);
+            for (u32 i = 0; i < clone.As<StructObj>().FieldCount; i++)
+            {
+                if (obj.As<StructObj>().Fields[i].HasType<ObjHandle>())
+                {
+                    clone.As<StructObj>().Fields[i] = CloneObj(obj.As<StructObj>().Fields[i].As<ObjHandle>());
+                }
+                else
+                {
+                    clone.As<StructObj>().Fields[i] = obj.As<StructObj>().Fields[i];
+                }
+            }
+            return clone;
+        }
+    case ObjType::Table:
+        {
+            const TableObj& table = obj.As<TableObj>();
+            ObjHandle clone = Create<TableObj>(table.Type, table.FieldNames, table.RowCount);
+            BCVM_ASSERT(clone.As<TableObj>().RowCount == table.RowCount, "Failed to allocate {} rows of table.", table.RowCount)
+            for (u32 field = 0; field < (u32)table.FieldNames.size(); field++)
+            {
+                for (u32 row = 0; row < table.RowCount; row++)
+                {
+                    Value cell = table.GetColumn(field)[row];
+                    if (cell.HasType<ObjHandle>()) cell = CloneObj(cell.As<ObjHandle>());
+                    clone.As<TableObj>().GetColumn(field)[row] = cell;
+                }
+            }
+            return clone;
+        }
+    case ObjType::Row:
+        return Create<RowObj>(obj.As<RowObj>().Table, obj.As<RowObj>().Index);
+    case ObjType::ByteBuffer:
+    case ObjType::File:
+        // read-only buffer and a handle, which are shared
+        return obj;
+    case ObjType::StringSlice:
+        {
+            const StringSliceObj& slice = obj.As<StringSliceObj>();
+            return Create<StringSliceObj>(slice.Parent, slice.Offset, slice.Length);
+        }
+    case ObjType::Dict:
+        {
+            // keys keep their identity, only values are cloned
+            ObjHandle clone = Create<DictObj>();
+            ValueHashMap& map = clone.As<DictObj>().Map;
+            map = obj.As<DictObj>().Map;
+            GarbageCollector::TrackAllocation(map.GetAllocatedBytes());
+            for (auto& entry : map.m_Entries)
+            {
+                if (entry.Probe != 0 && entry.Val.HasType<ObjHandle>())
+                {
+                    entry.Val = CloneObj(entry.Val.As<ObjHandle>());
+                }
+            }
+            return clone;
+        }
+    case ObjType::Grid:
+        {
+            // clone of a view is a compact grid of its own
+            const GridObj& grid = obj.As<GridObj>();
+            ObjHandle clone = Create<GridObj>(grid.Shape.data(), grid.Rank);
+            BCVM_ASSERT(clone.As<GridObj>().GetCount() == grid.GetCount(), "Failed to allocate {} elements of grid.", grid.GetCount())
+            f64* destination = clone.As<GridObj>().Data;
+            grid.ForEachRow([&destination](const f64* row, u32 length)
+            {
+                std::memcpy(destination, row, sizeof(f64) * length);
+                destination += length;
+            });
+            return clone;
+        }
+    case ObjType::F64Array:
+        {
+            ObjHandle clone = Create<F64ArrayObj>(obj.As<F64ArrayObj>().ItemCount);
+            BCVM_ASSERT(clone.As<F64ArrayObj>().ItemCount == obj.As<F64ArrayObj>().ItemCount, "Failed to allocate {} items of array.",
+                obj.As<F64ArrayObj>().ItemCount)
+            std::memcpy(clone.As<F64ArrayObj>().Items, obj.As<F64ArrayObj>().Items, sizeof(f64) * obj.As<F64ArrayObj>().ItemCount);
+            return clone;
+        }
     default:
         BCVM_ASSERT(false, "Something went really wrong")
         break;
@@ -101,6 +658,13 @@ void ObjRegistry::Delete(ObjHandle obj)
     s_FreeList = index;
 }
 
+void ObjRegistry::Reserve(u64 count)
+{
+    usize required = s_Records.size() + count;
+    // keeps the growth geometric, when called repeatedly
+    if (required > s_Records.capacity()) s_Records.reserve(std::max(required, s_Records.capacity() * 2));
+}
+
 u64 ObjRegistry::PushOrReuse(ObjRecord&& record)
 {
     if (s_FreeList == FREELIST_EMPTY)
@@ -155,12 +719,62 @@ void ObjRegistry::Delete(Obj* obj)
         GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(CollectionObj);
         delete static_cast<CollectionObj*>(obj);
         break;
+    case ObjType::Struct:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(StructObj);
+        delete static_cast<StructObj*>(obj);
+        break;
+    case ObjType::Table:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(TableObj);
+        delete static_cast<TableObj*>(obj);
+        break;
+    case ObjType::Row:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(RowObj);
+        delete static_cast<RowObj*>(obj);
+        break;
+    case ObjType::ByteBuffer:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(ByteBufferObj);
+        delete static_cast<ByteBufferObj*>(obj);
+        break;
+    case ObjType::File:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(FileObj);
+        delete static_cast<FileObj*>(obj);
+        break;
+    case ObjType::StringSlice:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(StringSliceObj);
+        delete static_cast<StringSliceObj*>(obj);
+        break;
+    case ObjType::F64Array:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(F64ArrayObj);
+        delete static_cast<F64ArrayObj*>(obj);
+        break;
+    case ObjType::Dict:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(DictObj);
+        delete static_cast<DictObj*>(obj);
+        break;
+    case ObjType::Grid:
+        GarbageCollector::GetContext().m_AllocatedBytes -= sizeof(GridObj);
+        delete static_cast<GridObj*>(obj);
+        break;
     default:
         BCVM_ASSERT(false, "Something went really wrong")
         break;
     }
 }
 
+bool StringUtils::IsString(Value val)
+{
+    if (!val.HasType<ObjHandle>()) return false;
+    ObjType type = val.As<ObjHandle>().GetType();
+    return type == ObjType::String || type == ObjType::StringSlice;
+}
+
+std::string_view StringUtils::GetView(Value val)
+{
+    ObjHandle obj = val.As<ObjHandle>();
+    if (obj.HasType<StringObj>()) return obj.As<StringObj>().String;
+    return obj.As<StringSliceObj>().GetView();
+}
+
 namespace std
 {
     size_t hash<StringObj>::operator()(const StringObj& stringObj) const noexcept
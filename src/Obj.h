@@ -1,7 +1,9 @@
 ﻿#pragma once
 
 #define OBJ_TYPE(x) static constexpr ObjType GetStaticType() { return ObjType::x; }
+#include <array>
 #include <functional>
+#include <memory>
 #include <string_view>
 
 #include "Chunk.h"
@@ -9,7 +11,11 @@
 #include "GarbageCollector.h"
 #include "Types.h"
 #include "ObjHandle.h"
+#include "Common/FileReader.h"
+#include "Common/MappedFile.h"
 #include "Common/ObjSparseSet.h"
+#include "Common/OutputBuffer.h"
+#include "Common/ValueHashMap.h"
 
 class Obj
 {
@@ -21,12 +27,28 @@ protected:
     ObjType m_Type;
 };
 
+// format string of `print()`, split into pieces of literal text followed by one replacement field each,
+// kept as offsets, so that pieces are formatted straight out of the string
+struct FormatPlan
+{
+    // end of each piece, that starts where the previous one ends; the last one takes the rest of the string
+    std::vector<u32> Ends;
+    std::string_view GetPiece(std::string_view format, u32 piece) const
+    {
+        u32 start = piece == 0 ? 0 : Ends[piece - 1];
+        return format.substr(start, Ends[piece] - start);
+    }
+};
+
 struct StringObj : Obj, ObjHasher<StringObj>
 {
     OBJ_TYPE(String)
     StringObj() : Obj(ObjType::String) {}
     StringObj(std::string_view string) : Obj(ObjType::String), String(string) {}
     std::string String{};
+    // made on the first use of the string as format string (they are interned constants, so it is reused),
+    // must be reset whenever `String` is changed in place
+    std::unique_ptr<FormatPlan> Format{};
 };
 
 struct FunObj : Obj, ObjHasher<FunObj>
@@ -86,8 +108,14 @@ struct ClassObj : Obj, ObjHasher<ClassObj>
 {
     OBJ_TYPE(Class)
     ClassObj(ObjHandle name) : Obj(ObjType::Class), Name(name) {}
+    // index of field in `FieldNames`, or `NO_FIELD`
+    u32 GetFieldIndex(ObjHandle name) const;
     ObjHandle Name;
     ObjSparseSet Methods;
+    // structs have fixed set of fields, in declaration order
+    bool IsStruct{false};
+    std::vector<ObjHandle> FieldNames;
+    static constexpr u32 NO_FIELD = std::numeric_limits<u32>::max();
 };
 
 struct InstanceObj : Obj, ObjHasher<InstanceObj>
@@ -109,20 +137,232 @@ struct BoundMethodObj : Obj, ObjHasher<BoundMethodObj>
 struct CollectionObj : Obj, ObjHasher<CollectionObj>
 {
     OBJ_TYPE(Collection)
-    CollectionObj(u32 itemCount) : Obj(ObjType::Collection), ItemCount(itemCount)
-    {
-        if (itemCount != 0)
-            Items = new Value[itemCount]{nullptr};
-    }
-    ~CollectionObj()
+    CollectionObj(u32 itemCount);
+    // copy-on-write replica (`collection | n`): item `i` is a clone of `pattern[i % patternCount]`,
+    // that is not made until the item is actually touched
+    CollectionObj(ObjHandle pattern, u32 itemCount);
+    ~CollectionObj();
+    // grows `Items` to hold at least `capacity` values, never shrinks,
+    // false if there is no memory for them (as are the growing operations below, or over u32 items)
+    bool Reserve(u32 capacity);
+    bool Push(Value val);
+    Value Pop();
+    bool Insert(u32 index, Value val);
+    bool Extend(const CollectionObj& other);
+    // accessors, that respect copy-on-write replication
+    Value Get(u32 index);
+    void Set(u32 index, Value val);
+    // reads item without cloning it, a shared item is the pattern's own object, so it must only be read
+    Value Peek(u32 index) const;
+    bool IsReplica() const { return Pattern != ObjHandle::NonHandle(); }
+    // clones all items still shared with pattern, must be called before any direct access to `Items`
+    void Materialize();
+    Value* Items{nullptr};
+    u32 ItemCount{0};
+    u32 Capacity{0};
+    // private frozen collection, replica items are cloned from
+    ObjHandle Pattern{ObjHandle::NonHandle()};
+    // marks items of replica, that still reference pattern objects
+    std::vector<bool> Shared;
+    u32 SharedCount{0};
+    static constexpr u32 MIN_CAPACITY = 8;
+    static constexpr u32 GROWTH_FACTOR = 2;
+private:
+    // reserves geometrically more, so that `required` items fit, saturated at the largest u32
+    bool Grow(u64 required);
+    void MakeReplicaStorage();
+    void ReleasePattern();
+};
+
+// instance of a struct type: fields are fixed slots in the declaration order, resolved by index
+// rather than looked up in a per-instance set; like any other object it is shared by reference
+struct StructObj : Obj, ObjHasher<StructObj>
+{
+    OBJ_TYPE(Struct)
+    StructObj(ObjHandle type);
+    ~StructObj();
+    // small structs are made and dropped constantly, so their memory is recycled through a free list
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr);
+    // returns memory kept in the free list to the system
+    static void ReleaseFreeList();
+    ObjHandle Type;
+    // points either to `InlineFields` or to separate allocation for larger structs
+    Value* Fields{nullptr};
+    u32 FieldCount{0};
+    static constexpr u32 INLINE_FIELDS = 4;
+    std::array<Value, INLINE_FIELDS> InlineFields{};
+private:
+    static std::vector<void*> s_FreeList;
+    // blocks beyond that go back to the system as soon as they are deleted
+    static constexpr u32 MAX_FREE_LIST = 4096;
+};
+
+// structure-of-arrays storage for records of one struct or class type:
+// each field is a contiguous column, rows are accessed through `RowObj` proxies
+struct TableObj : Obj, ObjHasher<TableObj>
+{
+    OBJ_TYPE(Table)
+    TableObj(ObjHandle type, const std::vector<ObjHandle>& fieldNames, u32 rowCount);
+    ~TableObj();
+    // index of column in `FieldNames`, or `ClassObj::NO_FIELD`
+    u32 GetFieldIndex(ObjHandle name) const;
+    Value* GetColumn(u32 field) const { return Cells + (u64)field * Capacity; }
+    // grows every column to hold at least `capacity` rows, never shrinks, false if there is no memory for them
+    bool Reserve(u32 capacity);
+    // whether `val` is struct, class instance or row, whose fields can make a row
+    static bool IsRowSource(Value val);
+    // scatters fields of struct, class instance or another row into the columns,
+    // fields that `val` does not have become nil; false if `val` is none of those
+    bool SetRow(u32 row, Value val);
+    // false if `val` is not a row source, or the table cannot grow (no memory or u32 rows already)
+    bool PushRow(Value val);
+    ObjHandle Type;
+    std::vector<ObjHandle> FieldNames;
+    // column-major, column `i` starts at `Cells + i * Capacity`
+    Value* Cells{nullptr};
+    u32 RowCount{0};
+    u32 Capacity{0};
+    static constexpr u32 MIN_CAPACITY = 8;
+    static constexpr u32 GROWTH_FACTOR = 2;
+};
+
+// reference to a row of a `TableObj`, its properties resolve to the table cells
+struct RowObj : Obj, ObjHasher<RowObj>
+{
+    OBJ_TYPE(Row)
+    RowObj(ObjHandle table, u32 index) : Obj(ObjType::Row), Table(table), Index(index) {}
+    ObjHandle Table;
+    u32 Index{0};
+};
+
+// read-only bytes of a memory mapped file, string slices view into it without copying
+struct ByteBufferObj : Obj, ObjHasher<ByteBufferObj>
+{
+    OBJ_TYPE(ByteBuffer)
+    ByteBufferObj() : Obj(ObjType::ByteBuffer) {}
+    // bytes of another buffer (e.g. of a mapped heap image), that is kept alive by this one
+    ByteBufferObj(ObjHandle base, std::string_view view) : Obj(ObjType::ByteBuffer), Base(base), View(view) {}
+    std::string_view GetView() const { return Base == ObjHandle::NonHandle() ? File.GetView() : View; }
+    MappedFile File;
+    ObjHandle Base{ObjHandle::NonHandle()};
+    std::string_view View{};
+};
+
+// buffered line reader of a file or stdin: data is read in large chunks (`StringObj`s, that are not interned),
+// and lines are slices of them, so they are neither copied nor interned, unless the script asks for it
+struct FileObj : Obj, ObjHasher<FileObj>
+{
+    OBJ_TYPE(File)
+    FileObj() : Obj(ObjType::File) {}
+    // next line (without line break) as a slice of the current chunk, `NonHandle` once the file is over;
+    // allocates, so the file has to be reachable by the GC; `output` is flushed before waiting for stdin
+    ObjHandle ReadLine(OutputBuffer& output);
+    FileReader Reader;
+    ObjHandle Chunk{ObjHandle::NonHandle()};
+    // start of the unread part of the chunk
+    u32 Position{0};
+    bool IsEof{false};
+    // reads go here, and then are copied to an exactly sized chunk
+    std::vector<char> Buffer;
+    static constexpr u32 BUFFER_SIZE = 256 * 1024;
+};
+
+// read-only view into the bytes of a `StringObj` (or `ByteBufferObj`), that keeps its parent alive
+struct StringSliceObj : Obj, ObjHasher<StringSliceObj>
+{
+    OBJ_TYPE(StringSlice)
+    // `parent` is either `StringObj` or `ByteBufferObj`
+    StringSliceObj(ObjHandle parent, u32 offset, u32 length) : Obj(ObjType::StringSlice), Parent(parent), Offset(offset), Length(length) {}
+    std::string_view GetView() const
     {
-        if (ItemCount != 0)
-            delete[] Items;
+        std::string_view parent = Parent.HasType<StringObj>() ?
+            std::string_view{Parent.As<StringObj>().String} : Parent.As<ByteBufferObj>().GetView();
+        return parent.substr(Offset, Length);
     }
-    Value* Items{nullptr};
+    ObjHandle Parent;
+    u32 Offset{0};
+    u32 Length{0};
+};
+
+// unboxed numbers in contiguous storage, aligned for simd kernels
+struct F64ArrayObj : Obj, ObjHasher<F64ArrayObj>
+{
+    OBJ_TYPE(F64Array)
+    // `ItemCount` is 0, if the items could not be allocated
+    F64ArrayObj(u32 itemCount);
+    ~F64ArrayObj();
+    f64* Items{nullptr};
     u32 ItemCount{0};
+    static constexpr u32 ALIGNMENT = 32;
+};
+
+struct DictObj : Obj, ObjHasher<DictObj>
+{
+    OBJ_TYPE(Dict)
+    DictObj() : Obj(ObjType::Dict) {}
+    ~DictObj();
+    // wrappers, that keep gc aware of the memory, owned by the map
+    void Set(Value key, Value val);
+    bool Remove(Value key);
+    void Reserve(u32 count);
+    ValueHashMap Map;
 };
 
+// n-dimensional row-major grid of numbers, views into it share its buffer
+struct GridObj : Obj, ObjHasher<GridObj>
+{
+    OBJ_TYPE(Grid)
+    static constexpr u32 MAX_RANK = 4;
+    // strides are u32, so the element count of a grid has to fit into one
+    static constexpr u64 MAX_COUNT = std::numeric_limits<u32>::max();
+    // `shape` must be valid, the grid is left empty (all extents are 0), if its data could not be allocated
+    GridObj(const u32* shape, u32 rank);
+    // view into the buffer of `base` grid, which is never a view itself
+    GridObj(ObjHandle base, f64* data, const u32* shape, const u32* strides, u32 rank);
+    ~GridObj();
+    u64 GetCount() const;
+    // true if the element count of `shape` does not exceed `MAX_COUNT`
+    static bool IsValidShape(const u32* shape, u32 rank);
+    // the grid, that owns the buffer
+    ObjHandle GetOwner(ObjHandle self) const { return Base == ObjHandle::NonHandle() ? self : Base; }
+    // calls `fn(f64* row, u32 length)` for each innermost row (these are always contiguous)
+    template <typename Fn>
+    void ForEachRow(Fn&& fn) const;
+    ObjHandle Base{ObjHandle::NonHandle()};
+    f64* Data{nullptr};
+    std::array<u32, MAX_RANK> Shape{};
+    std::array<u32, MAX_RANK> Strides{};
+    u32 Rank{0};
+};
+
+template <typename Fn>
+void GridObj::ForEachRow(Fn&& fn) const
+{
+    u64 count = GetCount();
+    if (count == 0) return;
+    u32 rowLength = Shape[Rank - 1];
+    std::array<u32, MAX_RANK> index{};
+    for (u64 row = 0; row < count / rowLength; row++)
+    {
+        f64* data = Data;
+        for (u32 dim = 0; dim + 1 < Rank; dim++) data += (u64)index[dim] * Strides[dim];
+        fn(data, rowLength);
+        for (i32 dim = (i32)Rank - 2; dim >= 0; dim--)
+        {
+            if (++index[dim] < Shape[dim]) break;
+            index[dim] = 0;
+        }
+    }
+}
+
+namespace StringUtils
+{
+    // true for both `StringObj` and `StringSliceObj`
+    bool IsString(Value val);
+    std::string_view GetView(Value val);
+}
+
 struct ObjRecord
 {
     Obj* Obj{nullptr};
@@ -151,6 +391,8 @@ public:
     static ObjHandle Clone(ObjHandle obj);
     static void Delete(ObjHandle obj);
     static u64 PushOrReuse(ObjRecord&& record);
+    // makes room for `count` more objects, so that a bulk of allocations does not grow the registry piecemeal
+    static void Reserve(u64 count);
     static ObjType GetType(ObjHandle obj)
     {
         return s_Records[obj.m_ObjIndex].Obj->GetType();
@@ -182,8 +424,10 @@ public:
             Delete(record.Obj);
         }
         s_Records.clear();
+        StructObj::ReleaseFreeList();
     }
 private:
+    static ObjHandle CloneObj(ObjHandle obj);
     static void Delete(Obj* obj);
 private:
     static std::vector<ObjRecord> s_Records;
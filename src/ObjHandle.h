@@ -15,6 +15,15 @@ enum class ObjType
     Instance,
     BoundMethod,
     Collection,
+    StringSlice,
+    F64Array,
+    Dict,
+    Grid,
+    Struct,
+    Table,
+    Row,
+    ByteBuffer,
+    File,
     Count
 };
 
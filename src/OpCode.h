@@ -9,6 +9,9 @@ enum class OpCode : u8
     OpNegate,
     OpNot,
     OpAdd,          OpSubtract,         OpMultiply,     OpDivide,
+    OpModulo,       OpIntDivide,
+    OpBitAnd,       OpBitXor,           OpBitNot,
+    OpShiftLeft,    OpShiftRight,
     OpEqual,        OpLess,             OpLequal,
     OpPop,          OpPopN,
     OpDefineGlobal, OpDefineGlobal32,
@@ -20,16 +23,21 @@ enum class OpCode : u8
     OpSetProperty,  OpSetProperty32,
     OpReadUpvalue, 
     OpSetUpvalue,
-    OpReadSubscript,
-    OpSetSubscript,
+    OpReadSubscript, OpReadSubscriptN,
+    OpSetSubscript,  OpSetSubscriptN,
+    OpReadSubscriptProperty,
+    OpSetSubscriptProperty,
     OpJump,
     OpJumpFalse,
     OpJumpTrue,
     OpCall,
+    OpIntrinsic,
     OpInvoke,
     OpClosure,
     OpCloseUpvalue,
     OpClass,
+    OpStruct,
+    OpStructField,
     OpInherit,
     OpMethod,
     OpReadSuper,
@@ -38,3 +46,11 @@ enum class OpCode : u8
     OpColMultiply,
     OpReturn,
 };
+
+// builtin natives, whose calls compile to `OpIntrinsic` instead of global read and `OpCall`
+enum class Intrinsic : u8
+{
+    Len, Int, Float, Rand,
+    Abs, Floor, Sqrt, Sin, Cos, Pow, Min, Max,
+    Count
+};
@@ -0,0 +1,464 @@
+﻿#include "Pack.h"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <format>
+
+#include "GarbageCollector.h"
+#include "Obj.h"
+#include "ValueFormatter.h"
+#include "VirtualMachine.h"
+
+bool Packer::Pack(Value val)
+{
+    m_Bytes.assign(MAGIC);
+    m_Bytes.push_back((char)VERSION);
+    m_Error.clear();
+    return WriteValue(val, 0);
+}
+
+bool Packer::Unpack(Value source, const Value* path, u32 pathLength, VirtualMachine* vm, Value& result)
+{
+    m_Error.clear();
+    m_Vm = vm;
+    ObjHandle string = source.As<ObjHandle>();
+    if (string.HasType<ByteBufferObj>())
+    {
+        m_Source = string.As<ByteBufferObj>().GetView();
+        m_SourceString = string;
+        m_SourceOffset = 0;
+    }
+    else if (string.HasType<StringSliceObj>())
+    {
+        m_Source = string.As<StringSliceObj>().GetView();
+        m_SourceString = string.As<StringSliceObj>().Parent;
+        m_SourceOffset = string.As<StringSliceObj>().Offset;
+    }
+    else
+    {
+        m_Source = string.As<StringObj>().String;
+        m_SourceString = string;
+        m_SourceOffset = 0;
+    }
+    if (m_Source.size() > std::numeric_limits<u32>::max())
+        return UnpackError("data is too large", 0);
+    if (!(m_Source.size() > MAGIC.size() && m_Source.starts_with(MAGIC) && (u8)m_Source[MAGIC.size()] == VERSION))
+        return UnpackError("data is not packed, or packed by another version", 0);
+
+    usize position = MAGIC.size() + 1;
+    for (u32 i = 0; i < pathLength; i++)
+    {
+        if (!Find(position, path[i]))
+            return false;
+    }
+    // nothing is reachable from the roots until the value is complete
+    GarbageCollector::Suspend();
+    bool isOk = ReadValue(position, result, 0);
+    GarbageCollector::Resume();
+    if (isOk && pathLength == 0 && position != m_Source.size())
+        isOk = UnpackError("unexpected data after the value", position);
+    return isOk;
+}
+
+bool Packer::WriteValue(Value val, u32 depth)
+{
+    if (depth > MAX_DEPTH)
+    {
+        m_Error = "Value is too deeply nested (or cyclic) to be packed";
+        return false;
+    }
+    if (val.HasType<void*>())
+    {
+        m_Bytes.push_back((char)Tag::Nil);
+        return true;
+    }
+    if (val.HasType<bool>())
+    {
+        m_Bytes.push_back((char)(val.As<bool>() ? Tag::True : Tag::False));
+        return true;
+    }
+    if (val.HasType<i32>())
+    {
+        i32 integer = val.As<i32>();
+        m_Bytes.push_back((char)Tag::Int);
+        WriteVarint(((u32)integer << 1) ^ (u32)(integer >> 31));
+        return true;
+    }
+    if (val.HasType<f64>())
+    {
+        u64 bits = std::bit_cast<u64>(val.As<f64>());
+        m_Bytes.push_back((char)Tag::F64);
+        for (u32 i = 0; i < sizeof(u64); i++) m_Bytes.push_back((char)(bits >> (i * 8)));
+        return true;
+    }
+    if (StringUtils::IsString(val))
+    {
+        std::string_view string = StringUtils::GetView(val);
+        m_Bytes.push_back((char)Tag::String);
+        WriteVarint(string.size());
+        m_Bytes.append(string);
+        return true;
+    }
+    ObjHandle obj = val.As<ObjHandle>();
+    switch (obj.GetType())
+    {
+    case ObjType::Collection:
+        {
+            const CollectionObj& collection = obj.As<CollectionObj>();
+            m_Bytes.push_back((char)Tag::Collection);
+            usize sizeOffset = m_Bytes.size();
+            m_Bytes.append(sizeof(u32), '\0');
+            WriteVarint(collection.ItemCount);
+            for (u32 i = 0; i < collection.ItemCount; i++)
+            {
+                if (!WriteValue(collection.Peek(i), depth + 1))
+                    return false;
+            }
+            WriteBlockSize(sizeOffset);
+            return true;
+        }
+    case ObjType::Dict:
+        {
+            const ValueHashMap& map = obj.As<DictObj>().Map;
+            m_Bytes.push_back((char)Tag::Dict);
+            usize sizeOffset = m_Bytes.size();
+            m_Bytes.append(sizeof(u32), '\0');
+            WriteVarint(map.GetCount());
+            bool isOk = true;
+            map.ForEach([&](Value key, Value item)
+            {
+                isOk = isOk && WriteValue(key, depth + 1) && WriteValue(item, depth + 1);
+            });
+            WriteBlockSize(sizeOffset);
+            return isOk;
+        }
+    case ObjType::F64Array:
+        {
+            const F64ArrayObj& array = obj.As<F64ArrayObj>();
+            m_Bytes.push_back((char)Tag::F64Array);
+            WriteVarint(array.ItemCount);
+            for (u32 i = 0; i < array.ItemCount; i++)
+            {
+                u64 bits = std::bit_cast<u64>(array.Items[i]);
+                for (u32 byte = 0; byte < sizeof(u64); byte++) m_Bytes.push_back((char)(bits >> (byte * 8)));
+            }
+            return true;
+        }
+    default:
+        m_Error = std::format("{} cannot be packed", val);
+        return false;
+    }
+}
+
+void Packer::WriteVarint(u64 val)
+{
+    while (val >= 0x80)
+    {
+        m_Bytes.push_back((char)(val | 0x80));
+        val >>= 7;
+    }
+    m_Bytes.push_back((char)val);
+}
+
+void Packer::WriteBlockSize(usize sizeOffset)
+{
+    u32 size = (u32)(m_Bytes.size() - sizeOffset - sizeof(u32));
+    for (u32 i = 0; i < sizeof(u32); i++) m_Bytes[sizeOffset + i] = (char)(size >> (i * 8));
+}
+
+bool Packer::ReadValue(usize& position, Value& val, u32 depth)
+{
+    if (depth > MAX_DEPTH)
+        return UnpackError("too deeply nested", position);
+    if (position >= m_Source.size())
+        return UnpackError("unexpected end of data", position);
+    usize tagPosition = position;
+    switch ((Tag)m_Source[position++])
+    {
+    case Tag::Nil: val = nullptr; return true;
+    case Tag::False: val = false; return true;
+    case Tag::True: val = true; return true;
+    case Tag::Int:
+        {
+            u64 zigzag;
+            if (!ReadVarint(position, zigzag) || zigzag > std::numeric_limits<u32>::max())
+                return UnpackError("invalid integer", tagPosition);
+            val = (i32)((u32)(zigzag >> 1) ^ (0u - (u32)(zigzag & 1)));
+            return true;
+        }
+    case Tag::F64:
+        {
+            f64 number;
+            if (!ReadF64(position, number))
+                return false;
+            val = number;
+            return true;
+        }
+    case Tag::String:
+        {
+            u64 length;
+            if (!ReadVarint(position, length) || length > m_Source.size() - position)
+                return UnpackError("invalid string length", tagPosition);
+            val = ObjRegistry::Create<StringSliceObj>(m_SourceString, m_SourceOffset + (u32)position, (u32)length);
+            position += length;
+            return true;
+        }
+    case Tag::Collection: return ReadCollection(position, val, depth);
+    case Tag::Dict: return ReadDict(position, val, depth);
+    case Tag::F64Array:
+        {
+            u64 count;
+            if (!ReadVarint(position, count) || count > (m_Source.size() - position) / sizeof(f64))
+                return UnpackError("invalid array length", tagPosition);
+            ObjHandle array = ObjRegistry::Create<F64ArrayObj>((u32)count);
+            if (array.As<F64ArrayObj>().ItemCount != count)
+                return UnpackError("failed to allocate array", tagPosition);
+            if (count > 0)
+            {
+                static_assert(std::endian::native == std::endian::little, "Packed numbers are little-endian.");
+                f64* items = array.As<F64ArrayObj>().Items;
+                std::memcpy(items, m_Source.data() + position, count * sizeof(f64));
+                // items become values when read, so their nans are canonicalized as well
+                for (u64 i = 0; i < count; i++)
+                {
+                    if (std::isnan(items[i])) items[i] = std::numeric_limits<f64>::quiet_NaN();
+                }
+            }
+            position += count * sizeof(f64);
+            val = array;
+            return true;
+        }
+    default: return UnpackError("unknown tag", tagPosition);
+    }
+}
+
+bool Packer::ReadCollection(usize& position, Value& val, u32 depth)
+{
+    usize end;
+    u64 count;
+    if (!ReadBlockEnd(position, end))
+        return false;
+    // every item takes at least a byte
+    if (!ReadVarint(position, count) || count > end - position)
+        return UnpackError("invalid collection length", position);
+    ObjHandle collection = ObjRegistry::Create<CollectionObj>(0);
+    CollectionObj& collectionObj = collection.As<CollectionObj>();
+    if (!collectionObj.Reserve((u32)count))
+        return UnpackError("failed to allocate collection", position);
+    for (u32 i = 0; i < count; i++)
+    {
+        if (!ReadValue(position, collectionObj.Items[i], depth + 1))
+            return false;
+        // counted as they are read, so that a partially read collection stays consistent
+        collectionObj.ItemCount = i + 1;
+    }
+    if (position != end)
+        return UnpackError("collection size mismatch", position);
+    val = collection;
+    return true;
+}
+
+bool Packer::ReadDict(usize& position, Value& val, u32 depth)
+{
+    usize end;
+    u64 count;
+    if (!ReadBlockEnd(position, end))
+        return false;
+    if (!ReadVarint(position, count) || count > (end - position) / 2)
+        return UnpackError("invalid dict length", position);
+    ObjHandle dict = ObjRegistry::Create<DictObj>();
+    dict.As<DictObj>().Reserve((u32)count);
+    for (u32 i = 0; i < count; i++)
+    {
+        Value key;
+        Value item;
+        usize keyPosition = position;
+        if (!ReadValue(position, key, depth + 1) || !ReadValue(position, item, depth + 1))
+            return false;
+        if (!ValueHashMap::IsValidKey(key))
+            return UnpackError("invalid dict key", keyPosition);
+        dict.As<DictObj>().Set(key, item);
+    }
+    if (position != end)
+        return UnpackError("dict size mismatch", position);
+    val = dict;
+    return true;
+}
+
+bool Packer::ReadVarint(usize& position, u64& val)
+{
+    val = 0;
+    for (u32 shift = 0; shift < 64; shift += 7)
+    {
+        if (position >= m_Source.size())
+            return false;
+        u8 byte = (u8)m_Source[position++];
+        val |= (u64)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool Packer::ReadU32(usize& position, u32& val)
+{
+    if (m_Source.size() - position < sizeof(u32))
+        return UnpackError("unexpected end of data", position);
+    val = 0;
+    for (u32 i = 0; i < sizeof(u32); i++) val |= (u32)(u8)m_Source[position + i] << (i * 8);
+    position += sizeof(u32);
+    return true;
+}
+
+bool Packer::ReadF64(usize& position, f64& val)
+{
+    if (m_Source.size() - position < sizeof(u64))
+        return UnpackError("unexpected end of data", position);
+    u64 bits = 0;
+    for (u32 i = 0; i < sizeof(u64); i++) bits |= (u64)(u8)m_Source[position + i] << (i * 8);
+    position += sizeof(u64);
+    // with nan boxing other nans are tagged values, so a payload could forge one
+    val = std::bit_cast<f64>(bits);
+    if (std::isnan(val)) val = std::numeric_limits<f64>::quiet_NaN();
+    return true;
+}
+
+bool Packer::ReadBlockEnd(usize& position, usize& end)
+{
+    u32 size;
+    if (!ReadU32(position, size))
+        return false;
+    if (size > m_Source.size() - position)
+        return UnpackError("invalid block size", position);
+    end = position + size;
+    return true;
+}
+
+bool Packer::Skip(usize& position)
+{
+    if (position >= m_Source.size())
+        return UnpackError("unexpected end of data", position);
+    usize tagPosition = position;
+    u64 length;
+    switch ((Tag)m_Source[position++])
+    {
+    case Tag::Nil:
+    case Tag::False:
+    case Tag::True:
+        return true;
+    case Tag::Int:
+        return ReadVarint(position, length) || UnpackError("invalid integer", tagPosition);
+    case Tag::F64:
+        if (m_Source.size() - position < sizeof(f64))
+            return UnpackError("unexpected end of data", position);
+        position += sizeof(f64);
+        return true;
+    case Tag::String:
+        if (!ReadVarint(position, length) || length > m_Source.size() - position)
+            return UnpackError("invalid string length", tagPosition);
+        position += length;
+        return true;
+    case Tag::Collection:
+    case Tag::Dict:
+        return ReadBlockEnd(position, position);
+    case Tag::F64Array:
+        if (!ReadVarint(position, length) || length > (m_Source.size() - position) / sizeof(f64))
+            return UnpackError("invalid array length", tagPosition);
+        position += length * sizeof(f64);
+        return true;
+    default:
+        return UnpackError("unknown tag", tagPosition);
+    }
+}
+
+bool Packer::Find(usize& position, Value key)
+{
+    if (position >= m_Source.size())
+        return UnpackError("unexpected end of data", position);
+    Tag tag = (Tag)m_Source[position];
+    if (tag == Tag::Collection)
+    {
+        position++;
+        usize end;
+        u64 count;
+        if (!ReadBlockEnd(position, end) || !ReadVarint(position, count))
+            return UnpackError("invalid collection", position);
+        i32 index;
+        if (!VirtualMachine::ToInteger(key, index) || index < 0 || (u64)index >= count)
+        {
+            m_Error = std::format("Index {} is out of bounds of packed collection of {} items", key, count);
+            return false;
+        }
+        // items before are skipped, not decoded
+        for (i32 i = 0; i < index; i++)
+        {
+            if (!Skip(position))
+                return false;
+        }
+        return true;
+    }
+    if (tag == Tag::Dict)
+    {
+        position++;
+        usize end;
+        u64 count;
+        if (!ReadBlockEnd(position, end) || !ReadVarint(position, count))
+            return UnpackError("invalid dict", position);
+        for (u64 i = 0; i < count; i++)
+        {
+            bool isEqual;
+            if (!KeyEquals(position, key, isEqual))
+                return false;
+            if (isEqual)
+                return true;
+            if (!Skip(position))
+                return false;
+        }
+        m_Error = std::format("Key \"{}\" is not present in packed dictionary", key);
+        return false;
+    }
+    m_Error = std::format("Cannot look up {} in packed value, that is neither a collection nor a dict", key);
+    return false;
+}
+
+bool Packer::KeyEquals(usize& position, Value key, bool& isEqual)
+{
+    if (position >= m_Source.size())
+        return UnpackError("unexpected end of data", position);
+    usize keyPosition = position;
+    isEqual = false;
+    switch ((Tag)m_Source[position])
+    {
+    case Tag::String:
+        {
+            position++;
+            u64 length;
+            if (!ReadVarint(position, length) || length > m_Source.size() - position)
+                return UnpackError("invalid string length", keyPosition);
+            isEqual = StringUtils::IsString(key) && StringUtils::GetView(key) == m_Source.substr(position, length);
+            position += length;
+            return true;
+        }
+    case Tag::Int:
+    case Tag::F64:
+    case Tag::True:
+    case Tag::False:
+        {
+            // keys are compared, as dicts compare them
+            Value packedKey;
+            if (!ReadValue(position, packedKey, 0))
+                return false;
+            isEqual = ValueHashMap::KeysEqual(packedKey, key);
+            return true;
+        }
+    default:
+        return Skip(position);
+    }
+}
+
+bool Packer::UnpackError(std::string_view message, usize position)
+{
+    m_Error = std::format("Malformed packed data at byte {}: {}", position, message);
+    return false;
+}
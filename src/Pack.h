@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "Types.h"
+#include "Value.h"
+
+class VirtualMachine;
+
+// compact binary encoding of values (`pack` / `unpack`), owned by vm, so that its buffer is reused;
+// collections and dicts are blocks prefixed with their size, so unpacking can skip right to a nested value
+// without decoding anything on the way, and unpacked strings are slices of the packed bytes
+class Packer
+{
+public:
+    // returns false and sets error, if `val` (or anything inside of it) cannot be packed
+    bool Pack(Value val);
+    // bytes of the last successful `Pack`, valid until the next call
+    std::string_view GetBytes() const { return m_Bytes; }
+    // `source` is a string or a byte buffer; `path` is a sequence of collection indices and dict keys,
+    // that leads to the value to unpack, gc is suspended until it is built
+    bool Unpack(Value source, const Value* path, u32 pathLength, VirtualMachine* vm, Value& result);
+    const std::string& GetError() const { return m_Error; }
+private:
+    enum class Tag : u8
+    {
+        Nil = 0, False, True,
+        // zigzag varint
+        Int,
+        F64,
+        // varint length and bytes
+        String,
+        // u32 size of the rest of the block, varint item count and items
+        Collection,
+        // u32 size of the rest of the block, varint entry count and key-value pairs
+        Dict,
+        // varint count and raw numbers
+        F64Array
+    };
+    bool WriteValue(Value val, u32 depth);
+    void WriteVarint(u64 val);
+    void WriteBlockSize(usize sizeOffset);
+
+    bool ReadValue(usize& position, Value& val, u32 depth);
+    bool ReadCollection(usize& position, Value& val, u32 depth);
+    bool ReadDict(usize& position, Value& val, u32 depth);
+    bool ReadVarint(usize& position, u64& val);
+    bool ReadU32(usize& position, u32& val);
+    bool ReadF64(usize& position, f64& val);
+    // reads size of a block, and makes sure it fits
+    bool ReadBlockEnd(usize& position, usize& end);
+    bool Skip(usize& position);
+    // moves `position` from a collection or dict to its item at `key`
+    bool Find(usize& position, Value key);
+    bool KeyEquals(usize& position, Value key, bool& isEqual);
+    bool UnpackError(std::string_view message, usize position);
+private:
+    std::string m_Bytes;
+
+    std::string_view m_Source;
+    // string (or byte buffer) the slices are made of
+    ObjHandle m_SourceString{};
+    u32 m_SourceOffset{0};
+    VirtualMachine* m_Vm{nullptr};
+    std::string m_Error;
+
+    static constexpr std::string_view MAGIC = "bcvp";
+    static constexpr u8 VERSION = 1;
+    static constexpr u32 MAX_DEPTH = 1024;
+};
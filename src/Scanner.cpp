@@ -36,10 +36,14 @@ void Scanner::ScanToken()
     case ';': AddToken(TokenType::Semicolon); break;
     case '*': AddToken(TokenType::Star); break;
     case '|': AddToken(TokenType::Pipe); break;
+    case '%': AddToken(TokenType::Percent); break;
+    case '&': AddToken(TokenType::Ampersand); break;
+    case '^': AddToken(TokenType::Caret); break;
+    case '~': AddToken(Match('/') ? TokenType::TildeSlash : TokenType::Tilde); break;
     case '!': AddToken(Match('=') ? TokenType::BangEqual : TokenType::Bang); break;
     case '=': AddToken(Match('=') ? TokenType::EqualEqual : TokenType::Equal); break;
-    case '<': AddToken(Match('=') ? TokenType::LessEqual : TokenType::Less); break;
-    case '>': AddToken(Match('=') ? TokenType::GreaterEqual : TokenType::Greater); break;
+    case '<': AddToken(Match('<') ? TokenType::LessLess : Match('=') ? TokenType::LessEqual : TokenType::Less); break;
+    case '>': AddToken(Match('>') ? TokenType::GreaterGreater : Match('=') ? TokenType::GreaterEqual : TokenType::Greater); break;
     case '/':
         if (Peek() == '/') ConsumeComment();
         else if (Peek() == '*') ConsumeBlockComment();
@@ -166,7 +170,17 @@ void Scanner::Identifier()
     case 'n': CheckKeyword(lexeme, "nil", TokenType::Nil); return;
     case 'o': CheckKeyword(lexeme, "or", TokenType::Or); return;
     case 'r': CheckKeyword(lexeme, "return", TokenType::Return); return;
-    case 's': CheckKeyword(lexeme, "super", TokenType::Super); return;
+    case 's':
+        if (m_Current - m_Start > 1)
+        {
+            switch (lexeme[1])
+            {
+            case 't': CheckKeyword(lexeme, "struct", TokenType::Struct); return;
+            case 'u': CheckKeyword(lexeme, "super", TokenType::Super); return;
+            default: break;
+            }
+        }
+        break;
     case 't':
         if (m_Current - m_Start > 1)
         {
@@ -0,0 +1,190 @@
+﻿#include "ScriptCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+
+#include "BytecodeFile.h"
+#include "Common/MappedFile.h"
+#include "Log.h"
+
+void ScriptCache::SetDirectory(std::string_view directory)
+{
+    m_Directory = directory;
+    if (m_Directory.empty()) return;
+    std::error_code error;
+    bool isCreated = std::filesystem::create_directories(m_Directory, error);
+    if (error)
+    {
+        LOG_WARN("Script cache directory {} cannot be created: {}.", m_Directory, error.message());
+        m_Directory.clear();
+        return;
+    }
+    // cached code is run as is, so nobody else gets to put files there
+    if (isCreated)
+        std::filesystem::permissions(m_Directory, std::filesystem::perms::owner_all, std::filesystem::perm_options::replace, error);
+}
+
+ObjHandle ScriptCache::Find(std::string_view source, VirtualMachine* vm)
+{
+    if (m_Entries.empty() && m_Directory.empty()) return ObjHandle::NonHandle();
+    u64 hash = Hash(source);
+    for (Entry& entry : m_Entries)
+    {
+        // text is compared in full, hash alone is not enough to run someone else's script
+        if (entry.Hash == hash && entry.Source == source)
+        {
+            entry.LastUse = ++m_UseCount;
+            return entry.Script;
+        }
+    }
+    if (m_Directory.empty()) return ObjHandle::NonHandle();
+    ObjHandle script = FindFile(hash, source, vm);
+    if (script != ObjHandle::NonHandle()) AddEntry(hash, source, script);
+    return script;
+}
+
+void ScriptCache::Add(std::string_view source, ObjHandle script)
+{
+    if (source.size() > m_Capacity && m_Directory.empty()) return;
+    u64 hash = Hash(source);
+    AddEntry(hash, source, script);
+    if (!m_Directory.empty()) AddFile(hash, source, script);
+}
+
+void ScriptCache::Clear()
+{
+    m_Entries.clear();
+    m_Bytes = 0;
+    if (m_Directory.empty()) return;
+    std::error_code error;
+    for (auto& file : std::filesystem::directory_iterator(m_Directory, error))
+    {
+        if (file.path().extension() == ".bcc") std::filesystem::remove(file.path(), error);
+    }
+}
+
+u64 ScriptCache::Hash(std::string_view source)
+{
+    // FNV-1a, so that file names are the same for every build and platform
+    u64 hash = 14695981039346656037llu;
+    for (char c : source)
+    {
+        hash ^= (u8)c;
+        hash *= 1099511628211llu;
+    }
+    return hash;
+}
+
+std::string ScriptCache::GetFilePath(u64 hash, std::string_view source) const
+{
+    return std::format("{}/{:016x}-{}-{:x}.bcc", m_Directory, hash, source.size(), BytecodeFile::GetBuildId());
+}
+
+ObjHandle ScriptCache::FindFile(u64 hash, std::string_view source, VirtualMachine* vm)
+{
+    std::string path = GetFilePath(hash, source);
+    MappedFile file;
+    if (!file.Open(path)) return ObjHandle::NonHandle();
+    std::string_view data = file.GetView();
+    FileHeader header;
+    if (data.size() >= sizeof(header)) std::memcpy(&header, data.data(), sizeof(header));
+    // the source is compared in full, as hash collisions are easy to make
+    if (data.size() < sizeof(header) || std::memcmp(header.Magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.Version != VERSION || header.BuildId != BytecodeFile::GetBuildId() ||
+        header.SourceLength != source.size() || data.substr(sizeof(header), source.size()) != source)
+    {
+        LOG_WARN("Cached script {} is discarded: it was not compiled from this source by this vm.", path);
+        return ObjHandle::NonHandle();
+    }
+    BytecodeFile bytecode;
+    ObjHandle script;
+    if (!bytecode.Read(data.substr(sizeof(header) + source.size()), vm, script))
+    {
+        // stale (or broken) file is replaced, once the source is compiled again
+        LOG_WARN("Cached script {} is discarded: {}", path, bytecode.GetError());
+        return ObjHandle::NonHandle();
+    }
+    // files are evicted by the time of last use
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return script;
+}
+
+void ScriptCache::AddFile(u64 hash, std::string_view source, ObjHandle script)
+{
+    BytecodeFile bytecode;
+    if (!bytecode.Write(script)) return;
+    std::string_view bytes = bytecode.GetBytes();
+    // written aside and renamed, so that concurrent runs never map a partially written file
+    std::string path = GetFilePath(hash, source);
+    std::string temporaryPath = std::format("{}.{}.tmp", path,
+        std::chrono::steady_clock::now().time_since_epoch().count());
+    std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr) return;
+    FileHeader header = {.Version = VERSION, .BuildId = BytecodeFile::GetBuildId(), .SourceLength = source.size()};
+    std::memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+    bool isWritten =
+        std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+        std::fwrite(source.data(), 1, source.size(), file) == source.size() &&
+        std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    isWritten = std::fclose(file) == 0 && isWritten;
+    std::error_code error;
+    if (isWritten) std::filesystem::rename(temporaryPath, path, error);
+    if (!isWritten || error)
+    {
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+    EvictFiles();
+}
+
+void ScriptCache::AddEntry(u64 hash, std::string_view source, ObjHandle script)
+{
+    // it would be the first to be evicted
+    if (source.size() > m_Capacity) return;
+    m_Entries.push_back({.Hash = hash, .Source = std::string{source}, .Script = script, .LastUse = ++m_UseCount});
+    m_Bytes += source.size();
+    Evict();
+}
+
+void ScriptCache::Evict()
+{
+    while (m_Bytes > m_Capacity && !m_Entries.empty())
+    {
+        auto oldest = std::ranges::min_element(m_Entries, {}, &Entry::LastUse);
+        m_Bytes -= oldest->Source.size();
+        m_Entries.erase(oldest);
+    }
+}
+
+void ScriptCache::EvictFiles()
+{
+    struct File
+    {
+        std::filesystem::path Path;
+        std::filesystem::file_time_type Time;
+        u64 Size;
+    };
+    std::vector<File> files;
+    u64 totalSize = 0;
+    std::error_code error;
+    for (auto& entry : std::filesystem::directory_iterator(m_Directory, error))
+    {
+        if (entry.path().extension() != ".bcc") continue;
+        File file = {.Path = entry.path(), .Time = entry.last_write_time(error), .Size = entry.file_size(error)};
+        if (error) continue;
+        totalSize += file.Size;
+        files.push_back(std::move(file));
+    }
+    if (totalSize <= m_DirectoryCapacity) return;
+    std::ranges::sort(files, {}, &File::Time);
+    for (const File& file : files)
+    {
+        if (totalSize <= m_DirectoryCapacity) break;
+        if (std::filesystem::remove(file.Path, error)) totalSize -= file.Size;
+    }
+}
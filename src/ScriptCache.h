@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ObjHandle.h"
+#include "Types.h"
+
+class VirtualMachine;
+
+// compiled scripts by their source text, so that `Interpret` of the same text skips scanning and parsing;
+// scripts are kept in memory, once capacity is set (least recently used are evicted when their sources exceed it),
+// and, if a directory is set, as bytecode files named by source hash and vm build, which outlive the process;
+// a file holds its source too, and is used only if the source is the same and it is of the same vm build,
+// otherwise the script is recompiled and the file is replaced;
+// the code of a matching file is trusted, so the directory must not be writable by anyone else
+class ScriptCache
+{
+    friend class GarbageCollector;
+public:
+    // empty `directory` disables the on-disk cache
+    void SetDirectory(std::string_view directory);
+    // caps the total size of sources in memory (compiled code is roughly proportional to it),
+    // 0 (the default) keeps nothing in memory, as a script run only once is not worth a copy of its source
+    void SetCapacity(u64 bytes) { m_Capacity = bytes; Evict(); }
+    // caps the total size of bytecode files in the directory
+    void SetDirectoryCapacity(u64 bytes) { m_DirectoryCapacity = bytes; }
+    // returns `NonHandle` if `source` was not compiled before
+    ObjHandle Find(std::string_view source, VirtualMachine* vm);
+    void Add(std::string_view source, ObjHandle script);
+    void Clear();
+
+    static constexpr u64 REPL_CAPACITY = 16llu * 1024 * 1024;
+private:
+    // a cache file starts with it, followed by the source and then by bytecode
+    struct FileHeader
+    {
+        char Magic[4];
+        u32 Version;
+        u64 BuildId;
+        u64 SourceLength;
+    };
+    struct Entry
+    {
+        u64 Hash;
+        std::string Source;
+        ObjHandle Script;
+        u64 LastUse;
+    };
+    static u64 Hash(std::string_view source);
+    std::string GetFilePath(u64 hash, std::string_view source) const;
+    ObjHandle FindFile(u64 hash, std::string_view source, VirtualMachine* vm);
+    void AddFile(u64 hash, std::string_view source, ObjHandle script);
+    void AddEntry(u64 hash, std::string_view source, ObjHandle script);
+    void Evict();
+    void EvictFiles();
+private:
+    std::vector<Entry> m_Entries;
+    u64 m_Bytes{0};
+    u64 m_Capacity{0};
+    u64 m_UseCount{0};
+    std::string m_Directory;
+    u64 m_DirectoryCapacity{DEFAULT_DIRECTORY_CAPACITY};
+
+    static constexpr char MAGIC[4] = {'\x7f', 'B', 'C', 'S'};
+    static constexpr u32 VERSION = 1;
+    static constexpr u64 DEFAULT_DIRECTORY_CAPACITY = 256llu * 1024 * 1024;
+};
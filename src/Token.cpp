@@ -21,6 +21,9 @@ std::string TokenUtils::TokenTypeToString(TokenType type)
     case TokenType::Slash:          return "Slash";
     case TokenType::Star:           return "Star";
     case TokenType::Pipe:           return "Pipe";
+    case TokenType::Percent:        return "Percent";
+    case TokenType::Ampersand:      return "Ampersand";
+    case TokenType::Caret:          return "Caret";
     case TokenType::Bang:           return "Bang";
     case TokenType::BangEqual:      return "BangEqual";
     case TokenType::Equal:          return "Equal";
@@ -29,6 +32,10 @@ std::string TokenUtils::TokenTypeToString(TokenType type)
     case TokenType::GreaterEqual:   return "GreaterEqual";
     case TokenType::Less:           return "Less";
     case TokenType::LessEqual:      return "LessEqual";
+    case TokenType::LessLess:       return "LessLess";
+    case TokenType::GreaterGreater: return "GreaterGreater";
+    case TokenType::Tilde:          return "Tilde";
+    case TokenType::TildeSlash:     return "TildeSlash";
     case TokenType::Identifier:     return "Identifier";
     case TokenType::String:         return "String";
     case TokenType::Number:         return "Number";
@@ -42,6 +49,7 @@ std::string TokenUtils::TokenTypeToString(TokenType type)
     case TokenType::Nil:            return "Nil";
     case TokenType::Or:             return "Or";
     case TokenType::Return:         return "Return";
+    case TokenType::Struct:         return "Struct";
     case TokenType::Super:          return "Super";
     case TokenType::This:           return "This";
     case TokenType::True:           return "True";
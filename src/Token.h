@@ -20,6 +20,9 @@ enum class TokenType
     Slash,
     Star,
     Pipe,
+    Percent,
+    Ampersand,
+    Caret,
 
     // One or two character tokens.
     Bang,
@@ -30,6 +33,10 @@ enum class TokenType
     GreaterEqual,
     Less,
     LessEqual,
+    LessLess,
+    GreaterGreater,
+    Tilde,
+    TildeSlash,
 
     // Literals.
     Identifier,
@@ -47,6 +54,7 @@ enum class TokenType
     Nil,
     Or,
     Return,
+    Struct,
     Super,
     This,
     True,
@@ -1,13 +1,14 @@
 ﻿#pragma once
 
 #include <bit>
+#include <limits>
 #include <variant>
 
 #include "ObjHandle.h"
 #include "Types.h"
 
 #ifndef NAN_BOXING
-enum class ValueType : u8 { Bool = 1, F64 = 2, Nil = 3, Obj = 4 };
+enum class ValueType : u8 { Bool = 1, F64 = 2, Nil = 3, Obj = 4, I32 = 5 };
 #else
 using ValueType = u64;
 // 0 as sign bit, then 11 + 1 + 1 bits as qNaN mark 
@@ -16,10 +17,14 @@ constexpr ValueType SIGN_BIT  = 1llu << 63;
 constexpr ValueType TAG_NIL   = 0b01;
 constexpr ValueType TAG_FALSE = 0b10;
 constexpr ValueType TAG_TRUE  = 0b11;
+// integer payload occupies the low 32 bits
+constexpr ValueType TAG_I32   = 1llu << 32;
 constexpr ValueType OBJ_MASK  = SIGN_BIT | QNAN;
+constexpr ValueType I32_MASK  = SIGN_BIT | QNAN | TAG_I32;
 constexpr ValueType VAL_NIL   = QNAN | TAG_NIL;
 constexpr ValueType VAL_FALSE = QNAN | TAG_FALSE;
 constexpr ValueType VAL_TRUE  = QNAN | TAG_TRUE;
+constexpr ValueType VAL_I32   = QNAN | TAG_I32;
 #endif
 
 class Value
@@ -28,8 +33,11 @@ public:
     Value();
     Value(bool val);
     Value(f64 val);
+    Value(i32 val);
     Value(void* val);
     Value(ObjHandle val);
+    // integer, if `val` fits into one, and f64 otherwise
+    static Value FromI64(i64 val);
 #ifndef NAN_BOXING
     ValueType GetType() const;
 #endif
@@ -48,6 +56,7 @@ private:
     {
         bool Bool;
         f64 F64;
+        i32 I32;
         void* Nil;
         ObjHandle Obj;
     };
@@ -56,22 +65,27 @@ private:
 #endif
 };
 
+// integers are numbers too: `HasType<f64>` is true for them and `As<f64>` converts them,
+// `HasType<i32>` is true for integers only
 template <typename T>
 bool Value::HasType() const
 {
     static_assert(
         std::is_same_v<T, bool> ||
         std::is_same_v<T, f64> ||
+        std::is_same_v<T, i32> ||
         std::is_same_v<T, void*> ||
         std::is_same_v<T, ObjHandle>, "Invalid type");
 #ifdef NAN_BOXING
     if constexpr (std::is_same_v<T, bool>) return (m_Val | 1) == VAL_TRUE;
-    else if constexpr (std::is_same_v<T, f64>) return (m_Val & QNAN) != QNAN;
+    else if constexpr (std::is_same_v<T, f64>) return (m_Val & QNAN) != QNAN || (m_Val & I32_MASK) == VAL_I32;
+    else if constexpr (std::is_same_v<T, i32>) return (m_Val & I32_MASK) == VAL_I32;
     else if constexpr (std::is_same_v<T, void*>) return m_Val == VAL_NIL;
     else return (m_Val & OBJ_MASK) == OBJ_MASK;
 #else
     if constexpr (std::is_same_v<T, bool>) return m_Type == ValueType::Bool;
-    else if constexpr (std::is_same_v<T, f64>) return m_Type == ValueType::F64;
+    else if constexpr (std::is_same_v<T, f64>) return m_Type == ValueType::F64 || m_Type == ValueType::I32;
+    else if constexpr (std::is_same_v<T, i32>) return m_Type == ValueType::I32;
     else if constexpr (std::is_same_v<T, void*>) return m_Type == ValueType::Nil;
     else return m_Type == ValueType::Obj;
 #endif
@@ -83,16 +97,19 @@ T Value::As() const
     static_assert(
         std::is_same_v<T, bool> ||
         std::is_same_v<T, f64> ||
+        std::is_same_v<T, i32> ||
         std::is_same_v<T, void*> ||
         std::is_same_v<T, ObjHandle>, "Invalid type");
 #ifdef NAN_BOXING
     if constexpr (std::is_same_v<T, bool>) return m_Val & 1;
-    else if constexpr (std::is_same_v<T, f64>) return *(f64*)&m_Val;
+    else if constexpr (std::is_same_v<T, f64>) return HasType<i32>() ? (f64)(i32)(u32)m_Val : *(f64*)&m_Val;
+    else if constexpr (std::is_same_v<T, i32>) return (i32)(u32)m_Val;
     else if constexpr (std::is_same_v<T, void*>) return VAL_NIL;
     else return ObjHandle{m_Val & ~(OBJ_MASK)};
 #else
     if constexpr (std::is_same_v<T, bool>) return m_Val.Bool;
-    else if constexpr (std::is_same_v<T, f64>) return m_Val.F64;
+    else if constexpr (std::is_same_v<T, f64>) return m_Type == ValueType::I32 ? (f64)m_Val.I32 : m_Val.F64;
+    else if constexpr (std::is_same_v<T, i32>) return m_Val.I32;
     else if constexpr (std::is_same_v<T, void*>) return m_Val.Nil;
     else return m_Val.Obj;
 #endif
@@ -111,6 +128,11 @@ inline Value::Value(f64 val)
 {
 }
 
+inline Value::Value(i32 val)
+    : m_Val{VAL_I32 | (u32)val}
+{
+}
+
 inline Value::Value(void* val)
     : m_Val(VAL_NIL)
 {
@@ -132,6 +154,11 @@ inline Value::Value(f64 val)
 {
 }
 
+inline Value::Value(i32 val)
+    : m_Val{.I32 = val}, m_Type(ValueType::I32)
+{
+}
+
 inline Value::Value(void* val)
 {
 }
@@ -147,3 +174,8 @@ inline ValueType Value::GetType() const
 }
 #endif
 
+inline Value Value::FromI64(i64 val)
+{
+    if (val >= std::numeric_limits<i32>::min() && val <= std::numeric_limits<i32>::max()) return Value((i32)val);
+    return Value((f64)val);
+}
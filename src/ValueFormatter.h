@@ -1,23 +1,47 @@
 ﻿#pragma once
 #include "Value.h"
 #include "Obj.h"
+#include "Common/NumberFormat.h"
 
 template <>
-struct std::formatter<ObjHandle> : std::formatter<std::string>
+struct std::formatter<ObjHandle> : std::formatter<std::string_view>
 {
     auto format(ObjHandle obj, format_context& ctx)
     {
         switch (obj.GetType())
         {
-        case ObjType::String: return formatter<string>::format(std::format("{}", obj.As<StringObj>().String), ctx);
-        case ObjType::Fun: return formatter<string>::format(std::format("FunObj {}", obj.As<FunObj>().GetName()), ctx);
-        case ObjType::NativeFun: return formatter<string>::format(std::format("NativeFunObj {}", (void*)obj.As<NativeFunObj>().NativeFn), ctx);
-        case ObjType::Closure: return formatter<string>::format(std::format("ClosureObj {}", obj.As<ClosureObj>().Fun.As<FunObj>().GetName()), ctx);
-        case ObjType::Upvalue: return formatter<string>::format(std::format("Upvalue 0x{:016x}", (u64)obj.As<UpvalueObj>().Location), ctx);
-        case ObjType::Class: return formatter<string>::format(std::format("Class {}", obj.As<ClassObj>().Name.As<StringObj>().String), ctx);
-        case ObjType::Instance: return formatter<string>::format(std::format("Instance of {}", obj.As<InstanceObj>().Class.As<ClassObj>().Name.As<StringObj>().String), ctx);
-        case ObjType::BoundMethod: return formatter<string>::format(std::format("BoundMethod {}", obj.As<BoundMethodObj>().Method.As<ClosureObj>().Fun.As<FunObj>().GetName()), ctx);
-        case ObjType::Collection: return formatter<string>::format(std::format("Collection {}", obj.As<CollectionObj>().ItemCount), ctx);
+        case ObjType::String: return formatter<string_view>::format(obj.As<StringObj>().String, ctx);
+        case ObjType::Fun: return formatter<string_view>::format(std::format("FunObj {}", obj.As<FunObj>().GetName()), ctx);
+        case ObjType::NativeFun: return formatter<string_view>::format(std::format("NativeFunObj {}", (void*)obj.As<NativeFunObj>().NativeFn), ctx);
+        case ObjType::Closure: return formatter<string_view>::format(std::format("ClosureObj {}", obj.As<ClosureObj>().Fun.As<FunObj>().GetName()), ctx);
+        case ObjType::Upvalue: return formatter<string_view>::format(std::format("Upvalue 0x{:016x}", (u64)obj.As<UpvalueObj>().Location), ctx);
+        case ObjType::Class: return formatter<string_view>::format(std::format("Class {}", obj.As<ClassObj>().Name.As<StringObj>().String), ctx);
+        case ObjType::Instance: return formatter<string_view>::format(std::format("Instance of {}", obj.As<InstanceObj>().Class.As<ClassObj>().Name.As<StringObj>().String), ctx);
+        case ObjType::BoundMethod: return formatter<string_view>::format(std::format("BoundMethod {}", obj.As<BoundMethodObj>().Method.As<ClosureObj>().Fun.As<FunObj>().GetName()), ctx);
+        case ObjType::Collection: return formatter<string_view>::format(std::format("Collection {}", obj.As<CollectionObj>().ItemCount), ctx);
+        case ObjType::StringSlice: return formatter<string_view>::format(obj.As<StringSliceObj>().GetView(), ctx);
+        case ObjType::Dict: return formatter<string_view>::format(std::format("Dict {}", obj.As<DictObj>().Map.GetCount()), ctx);
+        case ObjType::Grid:
+            {
+                const GridObj& grid = obj.As<GridObj>();
+                std::string shape = std::to_string(grid.Shape[0]);
+                for (u32 dim = 1; dim < grid.Rank; dim++) shape += std::format("x{}", grid.Shape[dim]);
+                return formatter<string_view>::format(std::format("Grid {}", shape), ctx);
+            }
+        case ObjType::F64Array: return formatter<string_view>::format(std::format("F64Array {}", obj.As<F64ArrayObj>().ItemCount), ctx);
+        case ObjType::Struct: return formatter<string_view>::format(std::format("Struct {}", obj.As<StructObj>().Type.As<ClassObj>().Name.As<StringObj>().String), ctx);
+        case ObjType::Table:
+            {
+                const TableObj& table = obj.As<TableObj>();
+                return formatter<string_view>::format(std::format("Table {} {}", table.Type.As<ClassObj>().Name.As<StringObj>().String, table.RowCount), ctx);
+            }
+        case ObjType::Row:
+            {
+                const RowObj& row = obj.As<RowObj>();
+                return formatter<string_view>::format(std::format("Row {} of {}", row.Index, row.Table.As<TableObj>().Type.As<ClassObj>().Name.As<StringObj>().String), ctx);
+            }
+        case ObjType::ByteBuffer: return formatter<string_view>::format(std::format("ByteBuffer {}", obj.As<ByteBufferObj>().GetView().size()), ctx);
+        case ObjType::File: return formatter<string_view>::format(obj.As<FileObj>().Reader.IsOpen() ? "File" : "File (closed)", ctx);
         default: break;
         }
         BCVM_ASSERT(false, "Unrecognized Obj type.")
@@ -29,17 +53,21 @@ template <>
 struct std::formatter<Value> : std::formatter<ObjHandle>
 {
     auto format(Value v, format_context& ctx){
+        // numbers are written to a stack buffer, and go through the string formatter (for width and alike) once
+        char number[NumberFormat::BUFFER_SIZE];
 #ifdef NAN_BOXING
-        if (v.HasType<bool>())      return formatter<string>::format(std::format("{}", v.As<bool>() ? "true" : "false"), ctx);
-        if (v.HasType<f64>())       return formatter<string>::format(std::format("{}", v.As<f64>()), ctx);
-        if (v.HasType<void*>())     return formatter<string>::format(std::format("Nil"), ctx);
+        if (v.HasType<bool>())      return formatter<string_view>::format(v.As<bool>() ? "true" : "false", ctx);
+        if (v.HasType<i32>())       return formatter<string_view>::format({number, NumberFormat::Write(number, v.As<i32>())}, ctx);
+        if (v.HasType<f64>())       return formatter<string_view>::format({number, NumberFormat::Write(number, v.As<f64>())}, ctx);
+        if (v.HasType<void*>())     return formatter<string_view>::format("Nil", ctx);
         if (v.HasType<ObjHandle>()) return formatter<ObjHandle>::format(v.As<ObjHandle>(), ctx);
 #else
         switch (v.GetType())
         {
-        case ValueType::Bool: return formatter<string>::format(std::format("{}", v.As<bool>() ? "true" : "false"), ctx);
-        case ValueType::F64: return formatter<string>::format(std::format("{}", v.As<f64>()), ctx);
-        case ValueType::Nil: return formatter<string>::format(std::format("Nil"), ctx);
+        case ValueType::Bool: return formatter<string_view>::format(v.As<bool>() ? "true" : "false", ctx);
+        case ValueType::F64: return formatter<string_view>::format({number, NumberFormat::Write(number, v.As<f64>())}, ctx);
+        case ValueType::I32: return formatter<string_view>::format({number, NumberFormat::Write(number, v.As<i32>())}, ctx);
+        case ValueType::Nil: return formatter<string_view>::format("Nil", ctx);
         case ValueType::Obj: return formatter<ObjHandle>::format(v.As<ObjHandle>(), ctx);
         }
 #endif
@@ -1,27 +1,44 @@
 ﻿#include "VirtualMachine.h"
 
+#include <cstdio>
 #include <format>
 #include <iostream>
-#include <fstream>
 #include <ranges>
 
+#include "BytecodeFile.h"
 #include "Compiler.h"
 #include "Core.h"
 #include "NativeFunctions.h"
 #include "Scanner.h"
 #include "ValueFormatter.h"
 
-#define BINARY_OP(stack, op)  \
+// integers are computed in 64 bits, `intResult` turns the result into value
+#define BINARY_OP(stack, op, intResult)  \
     { \
         Value b = (stack).Top(); (stack).Pop(); \
         Value a = (stack).Top(); \
-        if (a.HasType<f64>() && b.HasType<f64>()) \
+        if (a.HasType<i32>() && b.HasType<i32>()) \
+        { \
+            (stack).EmplaceAtTop(intResult((i64)a.As<i32>() op (i64)b.As<i32>())); \
+        } \
+        else if (a.HasType<f64>() && b.HasType<f64>()) \
         { \
             (stack).EmplaceAtTop(a.As<f64>() op b.As<f64>()); \
         } \
         else { RuntimeError("Expected numbers."); return InterpretResult::RuntimeError; } \
     }
 
+#define BITWISE_OP(stack, op)  \
+    { \
+        i32 a, b; \
+        if (!(ToInteger((stack).Peek(1), a) && ToInteger((stack).Top(), b))) \
+        { \
+            RuntimeError("Expected integers."); return InterpretResult::RuntimeError; \
+        } \
+        (stack).Pop(); \
+        (stack).EmplaceAtTop((i32)(op)); \
+    }
+
 VirtualMachine::VirtualMachine()
 {
     Init();
@@ -29,6 +46,8 @@ VirtualMachine::VirtualMachine()
 
 VirtualMachine::~VirtualMachine()
 {
+    m_Output.Flush();
+    Logger::SetOutputBuffer(nullptr);
     m_InternedStrings.clear();
     ObjRegistry::Shutdown();
 }
@@ -46,17 +65,22 @@ void VirtualMachine::Init()
         }
     });
     
+    Logger::SetOutputBuffer(&m_Output);
     GCContext gcContext = {};
     gcContext.VM = this;
     GarbageCollector::InitContext(gcContext);
+    InitByteStrings();
     InitNativeFunctions();
     m_InitString = AddString("init");
 }
 
 void VirtualMachine::Repl()
 {
+    // the same prompt lines are entered again and again
+    m_ScriptCache.SetCapacity(ScriptCache::REPL_CAPACITY);
     for (;;)
     {
+        m_Output.Flush();
         std::cout << "\n> ";
         std::string promptLine{};
         std::getline(std::cin, promptLine);
@@ -66,45 +90,181 @@ void VirtualMachine::Repl()
 
 void VirtualMachine::RunFile(std::string_view path)
 {
-    std::ifstream in(path.data(), std::ios::in | std::ios::binary);
-    CHECK_RETURN(in, "Failed to read file {}.", path)
-    std::string source{(std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()};
-    InterpretResult result = Interpret(source);
+    // compiled (or loaded) straight from the mapping, the source is kept until the end of the run
+    MappedFile source;
+    CHECK_RETURN(source.Open(path), "Failed to read file {}.", path)
+    InterpretResult result;
+    if (BytecodeFile::IsBytecode(source.GetView()))
+    {
+        BytecodeFile bytecode;
+        ObjHandle script;
+        if (bytecode.Read(source.GetView(), this, script))
+        {
+            result = RunScript(script);
+        }
+        else
+        {
+            LOG_ERROR("Failed to load bytecode file {}: {}", path, bytecode.GetError());
+            result = InterpretResult::CompileError;
+        }
+    }
+    else
+    {
+        result = Interpret(source.GetView());
+    }
     if (result != InterpretResult::Ok) ClearStacks(); 
+    m_Output.Flush();
     if (result == InterpretResult::CompileError) exit(65);
     if (result == InterpretResult::RuntimeError) exit(70);
 }
 
-InterpretResult VirtualMachine::Interpret(std::string_view source)
+void VirtualMachine::CompileFile(std::string_view path, std::string_view outputPath)
 {
+    MappedFile source;
+    CHECK_RETURN(source.Open(path), "Failed to read file {}.", path)
     Compiler compiler(this);
     GarbageCollector::GetContext().Compiler = &compiler;
     compiler.Init();
+    CompilerResult compilerResult = compiler.Compile(source.GetView());
+    GarbageCollector::GetContext().Compiler = nullptr;
+    if (!compilerResult.IsOk()) exit(65);
+
+    BytecodeFile bytecode;
+    CHECK_RETURN(bytecode.Write(compilerResult.Get()), "{}", bytecode.GetError())
+    std::string_view bytes = bytecode.GetBytes();
+    std::FILE* file = std::fopen(std::string{outputPath}.c_str(), "wb");
+    CHECK_RETURN(file != nullptr, "Failed to open file {} for writing.", outputPath)
+    bool isWritten = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    isWritten = std::fclose(file) == 0 && isWritten;
+    CHECK_RETURN(isWritten, "Failed to write file {}.", outputPath)
+}
+
+InterpretResult VirtualMachine::Interpret(std::string_view source)
+{
+    ObjHandle script = m_ScriptCache.Find(source, this);
+    if (script == ObjHandle::NonHandle())
+    {
+        Compiler compiler(this);
+        GarbageCollector::GetContext().Compiler = &compiler;
+        compiler.Init();
+        
+        CompilerResult compilerResult = compiler.Compile(source);
+        GarbageCollector::GetContext().Compiler = nullptr;
+        if (!compilerResult.IsOk()) return InterpretResult::CompileError;
+        // the script is not rooted, unless the cache keeps it in memory, but nothing is allocated
+        // until `RunScript` puts it on the stack
+        script = compilerResult.Get();
+        m_ScriptCache.Add(source, script);
+    }
     
-    CompilerResult compilerResult = compiler.Compile(source);
-    if (!compilerResult.IsOk()) return InterpretResult::CompileError;
-    
-    m_ValueStack.Emplace(compilerResult.Get());
-    m_CallFrames.push_back({.Fun = compilerResult.Get(), .Ip = compilerResult.Get().As<FunObj>().Chunk.m_Code.data(), .Slot = 0});
+    return RunScript(script);
+}
+
+InterpretResult VirtualMachine::RunScript(ObjHandle script)
+{
+    m_ValueStack.Emplace(script);
+    m_CallFrames.push_back({.Fun = script, .Ip = script.As<FunObj>().Chunk.m_Code.data(), .Slot = 0});
     
     return Run();
 }
 
+void VirtualMachine::InitByteStrings()
+{
+    for (u32 i = 0; i < m_ByteStrings.size(); i++)
+    {
+        m_ByteStrings[i] = AddString(std::string(1, (char)i));
+    }
+}
+
 void VirtualMachine::InitNativeFunctions()
 {
     DefineNativeFun("print", NativeFunctions::Print);
     DefineNativeFun("println", NativeFunctions::PrintLn);
     DefineNativeFun("input", NativeFunctions::Input);
+    DefineNativeFun("map_file", NativeFunctions::MapFile);
+    DefineNativeFun("read_file", NativeFunctions::ReadFile);
+    DefineNativeFun("write_file", NativeFunctions::WriteFile);
+    DefineNativeFun("read_csv", NativeFunctions::ReadCsv);
+    DefineNativeFun("open", NativeFunctions::Open);
+    DefineNativeFun("stdin", NativeFunctions::Stdin);
+    DefineNativeFun("read_line", NativeFunctions::ReadLine);
+    DefineNativeFun("lines", NativeFunctions::Lines);
+    DefineNativeFun("close", NativeFunctions::Close);
+    DefineNativeFun("json_parse", NativeFunctions::JsonParse);
+    DefineNativeFun("json_stringify", NativeFunctions::JsonStringify);
+    DefineNativeFun("pack", NativeFunctions::Pack);
+    DefineNativeFun("unpack", NativeFunctions::Unpack);
+    DefineNativeFun("save_image", NativeFunctions::SaveImage);
+    DefineNativeFun("load_image", NativeFunctions::LoadImage);
+    DefineNativeFun("flush", NativeFunctions::Flush);
+    DefineNativeFun("output_mode", NativeFunctions::OutputMode);
     DefineNativeFun("clock", NativeFunctions::Clock);
     DefineNativeFun("sleep", NativeFunctions::Sleep);
     DefineNativeFun("str", NativeFunctions::Str);
-    DefineNativeFun("int", NativeFunctions::Int);
-    DefineNativeFun("float", NativeFunctions::Float);
-    DefineNativeFun("rand", NativeFunctions::Rand);
-    DefineNativeFun("len", NativeFunctions::Len);
+    DefineIntrinsic("int", Intrinsic::Int, NativeFunctions::Int);
+    DefineIntrinsic("float", Intrinsic::Float, NativeFunctions::Float);
+    DefineIntrinsic("rand", Intrinsic::Rand, NativeFunctions::Rand);
+    DefineNativeFun("seed", NativeFunctions::Seed);
+    DefineNativeFun("rand_int", NativeFunctions::RandInt);
+    DefineNativeFun("rand_range", NativeFunctions::RandRange);
+    DefineNativeFun("rand_fill", NativeFunctions::RandFill);
+    DefineIntrinsic("len", Intrinsic::Len, NativeFunctions::Len);
+    DefineNativeFun("ord", NativeFunctions::Ord);
+    DefineNativeFun("chr", NativeFunctions::Chr);
+    DefineNativeFun("substr", NativeFunctions::Substr);
+    DefineNativeFun("find", NativeFunctions::Find);
+    DefineNativeFun("split", NativeFunctions::Split);
+    DefineNativeFun("starts_with", NativeFunctions::StartsWith);
+    DefineNativeFun("count", NativeFunctions::Count);
+    DefineNativeFun("push", NativeFunctions::Push);
+    DefineNativeFun("pop", NativeFunctions::Pop);
+    DefineNativeFun("insert", NativeFunctions::Insert);
+    DefineNativeFun("extend", NativeFunctions::Extend);
+    DefineNativeFun("reserve", NativeFunctions::Reserve);
+    DefineNativeFun("sort", NativeFunctions::Sort);
+    DefineNativeFun("lower_bound", NativeFunctions::LowerBound);
+    DefineNativeFun("binary_search", NativeFunctions::BinarySearch);
+    DefineNativeFun("map", NativeFunctions::Map);
+    DefineNativeFun("filter", NativeFunctions::Filter);
+    DefineNativeFun("reduce", NativeFunctions::Reduce);
+    DefineNativeFun("for_each", NativeFunctions::ForEach);
+    DefineNativeFun("f64_array", NativeFunctions::F64Array);
+    DefineNativeFun("fill", NativeFunctions::Fill);
+    DefineNativeFun("sum", NativeFunctions::Sum);
+    DefineNativeFun("dot", NativeFunctions::Dot);
+    DefineNativeFun("scale", NativeFunctions::Scale);
+    DefineNativeFun("axpy", NativeFunctions::Axpy);
+    DefineIntrinsic("min", Intrinsic::Min, NativeFunctions::Min);
+    DefineIntrinsic("max", Intrinsic::Max, NativeFunctions::Max);
+    DefineNativeFun("add", NativeFunctions::Add);
+    DefineNativeFun("mul", NativeFunctions::Mul);
+    DefineNativeFun("dict", NativeFunctions::Dict);
+    DefineNativeFun("keys", NativeFunctions::Keys);
+    DefineNativeFun("values", NativeFunctions::Values);
+    DefineNativeFun("has", NativeFunctions::Has);
+    DefineNativeFun("remove", NativeFunctions::Remove);
+    DefineNativeFun("grid", NativeFunctions::Grid);
+    DefineNativeFun("grid_view", NativeFunctions::GridView);
+    DefineNativeFun("shape", NativeFunctions::Shape);
+    DefineNativeFun("neighbours", NativeFunctions::Neighbours);
+    DefineNativeFun("convolve", NativeFunctions::Convolve);
+    DefineNativeFun("table", NativeFunctions::Table);
+    DefineIntrinsic("abs", Intrinsic::Abs, NativeFunctions::Abs);
+    DefineIntrinsic("floor", Intrinsic::Floor, NativeFunctions::Floor);
+    DefineNativeFun("ceil", NativeFunctions::Ceil);
+    DefineNativeFun("round", NativeFunctions::Round);
+    DefineIntrinsic("sqrt", Intrinsic::Sqrt, NativeFunctions::Sqrt);
+    DefineIntrinsic("pow", Intrinsic::Pow, NativeFunctions::Pow);
+    DefineNativeFun("exp", NativeFunctions::Exp);
+    DefineNativeFun("log", NativeFunctions::Log);
+    DefineIntrinsic("sin", Intrinsic::Sin, NativeFunctions::Sin);
+    DefineIntrinsic("cos", Intrinsic::Cos, NativeFunctions::Cos);
+    DefineNativeFun("tan", NativeFunctions::Tan);
+    DefineNativeFun("atan", NativeFunctions::Atan);
+    DefineNativeFun("atan2", NativeFunctions::Atan2);
 }
 
-InterpretResult VirtualMachine::Run()
+InterpretResult VirtualMachine::Run(usize exitFrameCount)
 {
     CallFrame* frame = &m_CallFrames.back();
     for(;;)
@@ -135,7 +295,11 @@ InterpretResult VirtualMachine::Run()
             break;
         case OpCode::OpNegate:
             {
-                if (m_ValueStack.Top().HasType<f64>())
+                if (m_ValueStack.Top().HasType<i32>())
+                {
+                    m_ValueStack.EmplaceAtTop(Value::FromI64(-(i64)m_ValueStack.Top().As<i32>()));
+                }
+                else if (m_ValueStack.Top().HasType<f64>())
                 {
                     m_ValueStack.EmplaceAtTop(-m_ValueStack.Top().As<f64>());
                 }
@@ -153,7 +317,11 @@ InterpretResult VirtualMachine::Run()
             {
                 Value b = m_ValueStack.Top(); m_ValueStack.Pop();
                 Value a = m_ValueStack.Top();
-                if (a.HasType<f64>() && b.HasType<f64>())
+                if (a.HasType<i32>() && b.HasType<i32>())
+                {
+                    m_ValueStack.EmplaceAtTop(Value::FromI64((i64)a.As<i32>() + (i64)b.As<i32>()));
+                }
+                else if (a.HasType<f64>() && b.HasType<f64>())
                 {
                     m_ValueStack.EmplaceAtTop(a.As<f64>() + b.As<f64>());
                 }
@@ -162,6 +330,12 @@ InterpretResult VirtualMachine::Run()
                 {
                     m_ValueStack.EmplaceAtTop(AddString(a.As<ObjHandle>().As<StringObj>().String + b.As<ObjHandle>().As<StringObj>().String));
                 }
+                else if (StringUtils::IsString(a) && StringUtils::IsString(b))
+                {
+                    std::string concatenated{StringUtils::GetView(a)};
+                    concatenated.append(StringUtils::GetView(b));
+                    m_ValueStack.EmplaceAtTop(AddString(concatenated));
+                }
                 else
                 {
                     RuntimeError("Expected strings or numbers."); return InterpretResult::RuntimeError;
@@ -169,11 +343,83 @@ InterpretResult VirtualMachine::Run()
                 break;
             }
         case OpCode::OpSubtract: 
-            BINARY_OP(m_ValueStack, -) break;
+            BINARY_OP(m_ValueStack, -, Value::FromI64) break;
         case OpCode::OpMultiply: 
-            BINARY_OP(m_ValueStack, *) break;
+            BINARY_OP(m_ValueStack, *, Value::FromI64) break;
         case OpCode::OpDivide: 
-            BINARY_OP(m_ValueStack, /) break;
+            {
+                // division of integers is not an integer in general
+                Value b = m_ValueStack.Top(); m_ValueStack.Pop();
+                Value a = m_ValueStack.Top();
+                if (!(a.HasType<f64>() && b.HasType<f64>()))
+                {
+                    RuntimeError("Expected numbers."); return InterpretResult::RuntimeError;
+                }
+                m_ValueStack.EmplaceAtTop(a.As<f64>() / b.As<f64>());
+                break;
+            }
+        case OpCode::OpModulo:
+            {
+                Value b = m_ValueStack.Top(); m_ValueStack.Pop();
+                Value a = m_ValueStack.Top();
+                if (a.HasType<i32>() && b.HasType<i32>())
+                {
+                    if (b.As<i32>() == 0)
+                    {
+                        RuntimeError("Division by zero."); return InterpretResult::RuntimeError;
+                    }
+                    m_ValueStack.EmplaceAtTop(Value::FromI64((i64)a.As<i32>() % (i64)b.As<i32>()));
+                }
+                else if (a.HasType<f64>() && b.HasType<f64>())
+                {
+                    m_ValueStack.EmplaceAtTop(std::fmod(a.As<f64>(), b.As<f64>()));
+                }
+                else { RuntimeError("Expected numbers."); return InterpretResult::RuntimeError; }
+                break;
+            }
+        case OpCode::OpIntDivide:
+            {
+                // truncates, so that `a == (a ~/ b) * b + a % b`
+                Value b = m_ValueStack.Top(); m_ValueStack.Pop();
+                Value a = m_ValueStack.Top();
+                if (a.HasType<i32>() && b.HasType<i32>())
+                {
+                    if (b.As<i32>() == 0)
+                    {
+                        RuntimeError("Division by zero."); return InterpretResult::RuntimeError;
+                    }
+                    m_ValueStack.EmplaceAtTop(Value::FromI64((i64)a.As<i32>() / (i64)b.As<i32>()));
+                }
+                else if (a.HasType<f64>() && b.HasType<f64>())
+                {
+                    f64 quotient = std::trunc(a.As<f64>() / b.As<f64>());
+                    if (quotient >= std::numeric_limits<i32>::min() && quotient <= std::numeric_limits<i32>::max())
+                        m_ValueStack.EmplaceAtTop((i32)quotient);
+                    else
+                        m_ValueStack.EmplaceAtTop(quotient);
+                }
+                else { RuntimeError("Expected numbers."); return InterpretResult::RuntimeError; }
+                break;
+            }
+        // bitwise operations work on 32-bit two's complement integers and never overflow
+        case OpCode::OpBitAnd:
+            BITWISE_OP(m_ValueStack, a & b) break;
+        case OpCode::OpBitXor:
+            BITWISE_OP(m_ValueStack, a ^ b) break;
+        case OpCode::OpShiftLeft:
+            BITWISE_OP(m_ValueStack, (u32)a << (b & 31)) break;
+        case OpCode::OpShiftRight:
+            BITWISE_OP(m_ValueStack, a >> (b & 31)) break;
+        case OpCode::OpBitNot:
+            {
+                i32 a;
+                if (!ToInteger(m_ValueStack.Top(), a))
+                {
+                    RuntimeError("Expected integer."); return InterpretResult::RuntimeError;
+                }
+                m_ValueStack.EmplaceAtTop(~a);
+                break;
+            }
         case OpCode::OpEqual:
             {
                 Value a = m_ValueStack.Top(); m_ValueStack.Pop();
@@ -182,9 +428,9 @@ InterpretResult VirtualMachine::Run()
                 break;
             }
         case OpCode::OpLess:
-            BINARY_OP(m_ValueStack, <) break;
+            BINARY_OP(m_ValueStack, <, (bool)) break;
         case OpCode::OpLequal:
-            BINARY_OP(m_ValueStack, <=) break;
+            BINARY_OP(m_ValueStack, <=, (bool)) break;
         case OpCode::OpPop:
             m_ValueStack.Pop();
             break;
@@ -197,12 +443,14 @@ InterpretResult VirtualMachine::Run()
         case OpCode::OpDefineGlobal:
             {
                 ObjHandle varName = ReadConstant().As<ObjHandle>();
+                CheckIntrinsicOverride(varName);
                 m_GlobalsSparseSet.Set(varName, m_ValueStack.Top()); m_ValueStack.Pop();
                 break;
             }
         case OpCode::OpDefineGlobal32:
             {
                 ObjHandle varName = ReadLongConstant().As<ObjHandle>();
+                CheckIntrinsicOverride(varName);
                 m_GlobalsSparseSet.Set(varName, m_ValueStack.Top()); m_ValueStack.Pop();
                 break;
             }  
@@ -236,6 +484,7 @@ InterpretResult VirtualMachine::Run()
                     RuntimeError(std::format("Variable \"{}\" is not defined", varName.As<StringObj>().String));
                     return InterpretResult::RuntimeError;
                 }
+                CheckIntrinsicOverride(varName);
                 m_GlobalsSparseSet[varName] = m_ValueStack.Top();
                 break;
             }
@@ -247,6 +496,7 @@ InterpretResult VirtualMachine::Run()
                     RuntimeError(std::format("Variable \"{}\" is not defined", varName.As<StringObj>().String));
                     return InterpretResult::RuntimeError;
                 }
+                CheckIntrinsicOverride(varName);
                 m_GlobalsSparseSet[varName] = m_ValueStack.Top();
                 break;
             }
@@ -290,62 +540,22 @@ InterpretResult VirtualMachine::Run()
             }
         case OpCode::OpReadProperty:
             {
-                Value iVal = m_ValueStack.Top(); 
-                if (!(iVal.HasType<ObjHandle>() && iVal.As<ObjHandle>().HasType<InstanceObj>()))
-                {
-                    RuntimeError("Only instances have properties.");
-                    return InterpretResult::RuntimeError;
-                }
-                auto instance = iVal.As<ObjHandle>();
-                ObjHandle prop = ReadConstant().As<ObjHandle>();
-                if (ReadField(instance, prop)) break;
-                if (ReadMethod(instance.As<InstanceObj>().Class, prop)) break;
-                RuntimeError(std::format("Unknown property: {}.", prop));
-                return InterpretResult::RuntimeError;
+                if (!ReadProperty(ReadConstant().As<ObjHandle>())) return InterpretResult::RuntimeError;
+                break;
             }
         case OpCode::OpReadProperty32:
             {
-                Value iVal = m_ValueStack.Top(); m_ValueStack.Pop();
-                if (!(iVal.HasType<ObjHandle>() && iVal.As<ObjHandle>().HasType<InstanceObj>()))
-                {
-                    RuntimeError("Only instances have properties.");
-                    return InterpretResult::RuntimeError;
-                }
-                auto instance = iVal.As<ObjHandle>();
-                ObjHandle prop = ReadLongConstant().As<ObjHandle>();
-                if (ReadField(instance, prop)) break;
-                if (ReadMethod(instance.As<InstanceObj>().Class, prop)) break;
-                RuntimeError(std::format("Unknown property: {}.", prop));
-                return InterpretResult::RuntimeError;
+                if (!ReadProperty(ReadLongConstant().As<ObjHandle>())) return InterpretResult::RuntimeError;
+                break;
             }
         case OpCode::OpSetProperty:
             {
-                Value iVal = m_ValueStack.Peek(1);
-                if (!(iVal.HasType<ObjHandle>() && iVal.As<ObjHandle>().HasType<InstanceObj>()))
-                {
-                    RuntimeError("Only instances have properties.");
-                    return InterpretResult::RuntimeError;
-                }
-                auto& instance = iVal.As<ObjHandle>().As<InstanceObj>();
-                ObjHandle prop = ReadConstant().As<ObjHandle>();
-                instance.Fields.Set(prop, m_ValueStack.Top()); m_ValueStack.Pop();
-                m_ValueStack.Pop(); // pop instance
-                m_ValueStack.Push(instance.Fields[prop]); // push val back to stack for subsequent sets.
+                if (!SetProperty(ReadConstant().As<ObjHandle>())) return InterpretResult::RuntimeError;
                 break;
             }
         case OpCode::OpSetProperty32:
             {
-                Value iVal = m_ValueStack.Peek(1);
-                if (!(iVal.HasType<ObjHandle>() && iVal.As<ObjHandle>().HasType<InstanceObj>()))
-                {
-                    RuntimeError("Only instances have properties.");
-                    return InterpretResult::RuntimeError;
-                }
-                auto& instance = iVal.As<ObjHandle>().As<InstanceObj>();
-                ObjHandle prop = ReadLongConstant().As<ObjHandle>();
-                instance.Fields.Set(prop, m_ValueStack.Top()); m_ValueStack.Pop();
-                m_ValueStack.Pop(); // pop instance
-                m_ValueStack.Push(instance.Fields[prop]); // push val back to stack for subsequent sets.
+                if (!SetProperty(ReadLongConstant().As<ObjHandle>())) return InterpretResult::RuntimeError;
                 break;
             }
         case OpCode::OpJump:
@@ -377,6 +587,18 @@ InterpretResult VirtualMachine::Run()
                 frame = &m_CallFrames.back();
                 break;
             }
+        case OpCode::OpIntrinsic:
+            {
+                Intrinsic intrinsic = (Intrinsic)ReadByte();
+                u8 argc = ReadByte();
+                if (!IntrinsicCall(intrinsic, argc))
+                {
+                    RuntimeError("Error during call.");
+                    return InterpretResult::RuntimeError;
+                }
+                frame = &m_CallFrames.back();
+                break;
+            }
         case OpCode::OpInvoke:
             {
                 ObjHandle method = m_ValueStack.Top().As<ObjHandle>(); m_ValueStack.Pop();
@@ -434,6 +656,22 @@ InterpretResult VirtualMachine::Run()
                 m_ValueStack.Pop();
                 break;
             }
+        case OpCode::OpStruct:
+            {
+                ObjHandle structType = ObjRegistry::Create<ClassObj>(m_ValueStack.Top().As<ObjHandle>());
+                structType.As<ClassObj>().IsStruct = true;
+                m_ValueStack.Pop();
+                m_ValueStack.Emplace(structType);
+                break;
+            }
+        case OpCode::OpStructField:
+            {
+                ObjHandle name = m_ValueStack.Top().As<ObjHandle>();
+                ObjHandle structType = m_ValueStack.Peek(1).As<ObjHandle>();
+                structType.As<ClassObj>().FieldNames.push_back(name);
+                m_ValueStack.Pop();
+                break;
+            }
         case OpCode::OpMethod:
             {
                 ObjHandle name = m_ValueStack.Top().As<ObjHandle>();
@@ -479,56 +717,100 @@ InterpretResult VirtualMachine::Run()
             }
         case OpCode::OpReadSubscript:
             {
-                Value index = m_ValueStack.Top(); m_ValueStack.Pop();
-                Value collection = m_ValueStack.Top(); m_ValueStack.Pop();
-                if (!CheckCollectionIndex(collection, index))
+                if (!ReadSubscript()) return InterpretResult::RuntimeError;
+                break;
+            }
+        case OpCode::OpSetSubscript:
+            {
+                if (!SetSubscript()) return InterpretResult::RuntimeError;
+                break;
+            }
+        case OpCode::OpReadSubscriptProperty:
+            {
+                // `collection[index].property`, the name is on top
+                ObjHandle prop = m_ValueStack.Top().As<ObjHandle>(); m_ValueStack.Pop();
+                u32 column = GetTableColumn(m_ValueStack.Peek(1), prop);
+                if (column != ClassObj::NO_FIELD)
                 {
-                    return InterpretResult::RuntimeError;
+                    if (!ReadTableColumn(column)) return InterpretResult::RuntimeError;
+                    break;
                 }
-                Value sub = GetCollectionSubscript(collection.As<ObjHandle>(), (u32)index.As<f64>());
-                if (m_HadError)
+                if (!ReadSubscript() || !ReadProperty(prop)) return InterpretResult::RuntimeError;
+                break;
+            }
+        case OpCode::OpSetSubscriptProperty:
+            {
+                // `collection[index].property = value`, the name is below the value
+                ObjHandle prop = m_ValueStack.Peek(1).As<ObjHandle>();
+                u32 column = GetTableColumn(m_ValueStack.Peek(3), prop);
+                if (column != ClassObj::NO_FIELD)
                 {
-                    m_HadError = false;
-                    return InterpretResult::RuntimeError;
+                    if (!SetTableColumn(column)) return InterpretResult::RuntimeError;
+                    break;
                 }
-                m_ValueStack.Push(sub);
+                // the element is read on top, then it is put with the value in place of all four
+                m_ValueStack.Push(m_ValueStack.Peek(3));
+                m_ValueStack.Push(m_ValueStack.Peek(3));
+                if (!ReadSubscript()) return InterpretResult::RuntimeError;
+                Value element = m_ValueStack.Top();
+                Value val = m_ValueStack.Peek(1);
+                m_ValueStack.ShiftTop(5);
+                m_ValueStack.Push(element);
+                m_ValueStack.Push(val);
+                if (!SetProperty(prop)) return InterpretResult::RuntimeError;
                 break;
             }
-        case OpCode::OpSetSubscript:
+        case OpCode::OpReadSubscriptN:
             {
-                Value newVal = m_ValueStack.Top(); m_ValueStack.Pop();
-                Value index = m_ValueStack.Top(); m_ValueStack.Pop();
-                Value collection = m_ValueStack.Top(); m_ValueStack.Pop();
-                if (!CheckCollectionIndex(collection, index))
+                u8 count = ReadByte();
+                if (!(m_ValueStack.Peek(count).HasType<ObjHandle>() && m_ValueStack.Peek(count).As<ObjHandle>().HasType<GridObj>()))
                 {
+                    RuntimeError("Only grids accept multiple subscript indices.");
                     return InterpretResult::RuntimeError;
                 }
-                SetCollectionSubscript(collection.As<ObjHandle>(), (u32)index.As<f64>(), newVal);
-                if (m_HadError)
+                if (!ReadGridSubscript(count)) return InterpretResult::RuntimeError;
+                break;
+            }
+        case OpCode::OpSetSubscriptN:
+            {
+                u8 count = ReadByte();
+                if (!(m_ValueStack.Peek(count + 1).HasType<ObjHandle>() && m_ValueStack.Peek(count + 1).As<ObjHandle>().HasType<GridObj>()))
                 {
-                    m_HadError = false;
+                    RuntimeError("Only grids accept multiple subscript indices.");
                     return InterpretResult::RuntimeError;
                 }
-                m_ValueStack.Push(newVal);
+                if (!SetGridSubscript(count)) return InterpretResult::RuntimeError;
                 break;
             }
         case OpCode::OpColMultiply:
             {
                 Value b = m_ValueStack.Top();
                 Value a = m_ValueStack.Peek(1);
+                // `|` of two numbers is a bitwise or
+                if (a.HasType<f64>() && b.HasType<f64>())
+                {
+                    BITWISE_OP(m_ValueStack, a | b)
+                    break;
+                }
                 if (a.HasType<f64>() && b.HasType<ObjHandle>())
                     std::swap(a, b);
                 if (a.HasType<ObjHandle>() && b.HasType<f64>())
                 {
-                    if (!(b.As<f64>() >= 0 && std::floor(b.As<f64>()) == (u32)b.As<f64>()))
+                    if (!NativeFunctionsUtils::IsIndex(b))
                     {
                         RuntimeError("Expected positive integer number.");
                         return InterpretResult::RuntimeError; 
                     }
-                    u32 number = (u32)b.As<f64>();
+                    u32 number = NativeFunctionsUtils::AsIndex(b);
                     if (a.As<ObjHandle>().HasType<StringObj>())
                     {
                         const std::string& originalString = a.As<ObjHandle>().As<StringObj>().String;
+                        // slices address strings with u32 offsets
+                        if ((u64)originalString.size() * number > std::numeric_limits<u32>::max())
+                        {
+                            RuntimeError("String too large.");
+                            return InterpretResult::RuntimeError;
+                        }
                         std::string newString;
                         newString.reserve(originalString.size() * number);
                         for (u32 i = 0; i < number; i++)
@@ -543,24 +825,31 @@ InterpretResult VirtualMachine::Run()
                     else if (a.As<ObjHandle>().HasType<CollectionObj>())
                     {
                         const CollectionObj& originalCol = a.As<ObjHandle>().As<CollectionObj>();
-                        ObjHandle newColH = ObjRegistry::Create<CollectionObj>(originalCol.ItemCount * number);
-                        m_ValueStack.Emplace(newColH);
-                        CollectionObj& newCol = newColH.As<CollectionObj>();
-                        for (u32 repI = 0; repI < number; repI++)
+                        u64 itemCount = (u64)originalCol.ItemCount * number;
+                        if (itemCount > std::numeric_limits<u32>::max())
+                        {
+                            RuntimeError("Collection too large.");
+                            return InterpretResult::RuntimeError;
+                        }
+                        ObjHandle newColH;
+                        if (itemCount == 0)
+                        {
+                            newColH = ObjRegistry::Create<CollectionObj>(0);
+                        }
+                        else if (originalCol.IsReplica() && originalCol.Items == nullptr)
                         {
-                            for (u32 i = 0; i < originalCol.ItemCount; i++)
-                            {
-                                if (originalCol.Items[i].HasType<ObjHandle>())
-                                {
-                                    newCol.Items[repI * originalCol.ItemCount + i] = ObjRegistry::Clone(originalCol.Items[i].As<ObjHandle>());
-                                }
-                                else
-                                {
-                                    newCol.Items[repI * originalCol.ItemCount + i] = originalCol.Items[i];
-                                }
-                            }
+                            // replica of untouched replica is just a longer one
+                            newColH = ObjRegistry::Create<CollectionObj>(originalCol.Pattern, (u32)itemCount);
+                        }
+                        else
+                        {
+                            // replicas are made lazily from the frozen copy of original collection,
+                            // so that later changes to the original are not visible through them
+                            ObjHandle patternH = ObjRegistry::Clone(a.As<ObjHandle>());
+                            m_ValueStack.Emplace(patternH);
+                            newColH = ObjRegistry::Create<CollectionObj>(patternH, (u32)itemCount);
+                            m_ValueStack.Pop();
                         }
-                        m_ValueStack.Pop(); // pop newCollection
                         m_ValueStack.Pop();
                         m_ValueStack.Pop();
                         m_ValueStack.Emplace(newColH); // return newCollection back to stack
@@ -591,6 +880,7 @@ InterpretResult VirtualMachine::Run()
                 }
                 m_ValueStack.SetTop(frameSlot);
                 m_ValueStack.Push(funRes);
+                if (m_CallFrames.size() == exitFrameCount) return InterpretResult::Ok;
                 frame = &m_CallFrames.back();
                 break;
             }
@@ -600,12 +890,42 @@ InterpretResult VirtualMachine::Run()
 
 bool VirtualMachine::Invoke(ObjHandle method, u8 argc)
 {
-    ObjHandle instanceHandle = m_ValueStack.Peek(argc).As<ObjHandle>();
-    if (!instanceHandle.HasType<InstanceObj>())
+    if (!IsInstance(m_ValueStack.Peek(argc)))
     {
         RuntimeError("Only classes have methods.");
         return false;
     }
+    ObjHandle instanceHandle = m_ValueStack.Peek(argc).As<ObjHandle>();
+    if (instanceHandle.HasType<StructObj>())
+    {
+        StructObj& structObj = instanceHandle.As<StructObj>();
+        u32 fieldIndex = structObj.Type.As<ClassObj>().GetFieldIndex(method);
+        if (fieldIndex != ClassObj::NO_FIELD)
+        {
+            Value field = structObj.Fields[fieldIndex];
+            m_ValueStack.Peek(argc) = field;
+            return CallValue(field, argc);
+        }
+        return InvokeFromClass(structObj.Type, method, argc);
+    }
+    if (instanceHandle.HasType<RowObj>())
+    {
+        const RowObj& row = instanceHandle.As<RowObj>();
+        const TableObj& table = row.Table.As<TableObj>();
+        u32 fieldIndex = table.GetFieldIndex(method);
+        if (fieldIndex != ClassObj::NO_FIELD)
+        {
+            Value field = table.GetColumn(fieldIndex)[row.Index];
+            m_ValueStack.Peek(argc) = field;
+            return CallValue(field, argc);
+        }
+        if (!InvokeFromClass(table.Type, method, argc))
+        {
+            RuntimeError(std::format("Unknown property: {}.", method));
+            return false;
+        }
+        return true;
+    }
     const InstanceObj& instance = instanceHandle.As<InstanceObj>();
     if (instance.Fields.Has(method))
     {
@@ -682,8 +1002,71 @@ bool VirtualMachine::NativeCall(ObjHandle fun, u8 argc)
     return true;
 }
 
+bool VirtualMachine::IntrinsicCall(Intrinsic intrinsic, u8 argc)
+{
+    const IntrinsicInfo& info = m_Intrinsics[(u32)intrinsic];
+    if (info.IsOverridden)
+    {
+        // global was redefined, so it is called as usual, with callee slot under the arguments
+        Value callee = m_GlobalsSparseSet[info.Name];
+        m_ValueStack.Push(callee);
+        for (u32 i = 0; i < argc; i++) std::swap(m_ValueStack.Peek(i), m_ValueStack.Peek(i + 1));
+        return CallValue(callee, argc);
+    }
+    // the most common cases are handled in place, everything else goes to the native
+    Value* argv = &m_ValueStack.Top() + 1 - argc;
+    Value result;
+    bool isHandled = false;
+    if (argc == 1 && argv[0].HasType<f64>())
+    {
+        isHandled = true;
+        switch (intrinsic)
+        {
+        case Intrinsic::Int:
+            result = argv[0].HasType<i32>() ? argv[0] : NativeFunctionsUtils::Integral(std::floor(argv[0].As<f64>()));
+            break;
+        case Intrinsic::Float:  result = argv[0].As<f64>(); break;
+        case Intrinsic::Abs:
+            result = argv[0].HasType<i32>() ? Value::FromI64(std::abs((i64)argv[0].As<i32>())) : Value(std::abs(argv[0].As<f64>()));
+            break;
+        case Intrinsic::Floor:
+            result = argv[0].HasType<i32>() ? argv[0] : NativeFunctionsUtils::Integral(std::floor(argv[0].As<f64>()));
+            break;
+        case Intrinsic::Sqrt:   result = std::sqrt(argv[0].As<f64>()); break;
+        case Intrinsic::Sin:    result = std::sin(argv[0].As<f64>()); break;
+        case Intrinsic::Cos:    result = std::cos(argv[0].As<f64>()); break;
+        default: isHandled = false; break;
+        }
+    }
+    else if (argc == 0 && intrinsic == Intrinsic::Rand)
+    {
+        isHandled = true;
+        result = m_Random.F64();
+    }
+    else if (argc == 1 && intrinsic == Intrinsic::Len && argv[0].HasType<ObjHandle>() && argv[0].As<ObjHandle>().HasType<CollectionObj>())
+    {
+        isHandled = true;
+        result = Value::FromI64((i64)argv[0].As<ObjHandle>().As<CollectionObj>().ItemCount);
+    }
+    else if (argc == 2 && argv[0].HasType<i32>() && argv[1].HasType<i32>() && (intrinsic == Intrinsic::Min || intrinsic == Intrinsic::Max))
+    {
+        isHandled = true;
+        result = intrinsic == Intrinsic::Min ? std::min(argv[0].As<i32>(), argv[1].As<i32>()) : std::max(argv[0].As<i32>(), argv[1].As<i32>());
+    }
+    if (!isHandled)
+    {
+        NativeFnCallResult res = info.Fn(argc, argv, this);
+        if (!res.IsOk) return false;
+        result = res.Result;
+    }
+    m_ValueStack.ShiftTop(argc);
+    m_ValueStack.Push(result);
+    return true;
+}
+
 bool VirtualMachine::ClassCall(ObjHandle classObj, u8 argc)
 {
+    if (classObj.As<ClassObj>().IsStruct) return StructCall(classObj, argc);
     m_ValueStack.Peek(argc) = ObjRegistry::Create<InstanceObj>(classObj);
     if (classObj.As<ClassObj>().Methods.Has(m_InitString))
     {
@@ -700,14 +1083,84 @@ bool VirtualMachine::ClassCall(ObjHandle classObj, u8 argc)
     return true;
 }
 
+bool VirtualMachine::StructCall(ObjHandle structType, u8 argc)
+{
+    const ClassObj& type = structType.As<ClassObj>();
+    if (type.Methods.Has(m_InitString))
+    {
+        m_ValueStack.Peek(argc) = ObjRegistry::Create<StructObj>(structType);
+        return ClosureCall(type.Methods.Get(m_InitString).As<ObjHandle>(), argc);
+    }
+    // without initializer fields are set positionally, or left nil
+    if (argc != 0 && (usize)argc != type.FieldNames.size())
+    {
+        RuntimeError(std::format("Expected {} arguments, but got {}", type.FieldNames.size(), argc));
+        return false;
+    }
+    ObjHandle structObj = ObjRegistry::Create<StructObj>(structType);
+    StructObj& fields = structObj.As<StructObj>();
+    for (u32 i = 0; i < argc; i++)
+    {
+        fields.Fields[i] = m_ValueStack.Peek(argc - 1 - i);
+    }
+    m_ValueStack.ShiftTop(1 + argc);
+    m_ValueStack.Push(structObj);
+    return true;
+}
+
 bool VirtualMachine::MethodCall(ObjHandle method, u8 argc)
 {
     m_ValueStack.Peek(argc) = method.As<BoundMethodObj>().Receiver;
     return ClosureCall(method.As<BoundMethodObj>().Method, argc);
 }
 
+bool VirtualMachine::ReadProperty(ObjHandle prop)
+{
+    Value iVal = m_ValueStack.Top();
+    if (!IsInstance(iVal))
+    {
+        RuntimeError("Only instances have properties.");
+        return false;
+    }
+    ObjHandle instance = iVal.As<ObjHandle>();
+    if (ReadField(instance, prop)) return true;
+    if (ReadMethod(GetClass(instance), prop)) return true;
+    RuntimeError(std::format("Unknown property: {}.", prop));
+    return false;
+}
+
+bool VirtualMachine::SetProperty(ObjHandle prop)
+{
+    Value iVal = m_ValueStack.Peek(1);
+    if (!IsInstance(iVal))
+    {
+        RuntimeError("Only instances have properties.");
+        return false;
+    }
+    return SetField(iVal.As<ObjHandle>(), prop);
+}
+
 bool VirtualMachine::ReadField(ObjHandle instance, ObjHandle prop)
 {
+    if (instance.HasType<StructObj>())
+    {
+        const StructObj& structObj = instance.As<StructObj>();
+        u32 fieldIndex = structObj.Type.As<ClassObj>().GetFieldIndex(prop);
+        if (fieldIndex == ClassObj::NO_FIELD) return false;
+        m_ValueStack.Pop();
+        m_ValueStack.Push(structObj.Fields[fieldIndex]);
+        return true;
+    }
+    if (instance.HasType<RowObj>())
+    {
+        const RowObj& row = instance.As<RowObj>();
+        const TableObj& table = row.Table.As<TableObj>();
+        u32 fieldIndex = table.GetFieldIndex(prop);
+        if (fieldIndex == ClassObj::NO_FIELD) return false;
+        m_ValueStack.Pop();
+        m_ValueStack.Push(table.GetColumn(fieldIndex)[row.Index]);
+        return true;
+    }
     if (instance.As<InstanceObj>().Fields.Has(prop))
     {
         m_ValueStack.Pop();
@@ -717,6 +1170,42 @@ bool VirtualMachine::ReadField(ObjHandle instance, ObjHandle prop)
     return false;
 }
 
+bool VirtualMachine::SetField(ObjHandle instance, ObjHandle prop)
+{
+    Value val = m_ValueStack.Top();
+    if (instance.HasType<StructObj>())
+    {
+        StructObj& structObj = instance.As<StructObj>();
+        u32 fieldIndex = structObj.Type.As<ClassObj>().GetFieldIndex(prop);
+        if (fieldIndex == ClassObj::NO_FIELD)
+        {
+            RuntimeError(std::format("Struct {} has no field {}.", structObj.Type.As<ClassObj>().Name, prop));
+            return false;
+        }
+        structObj.Fields[fieldIndex] = val;
+    }
+    else if (instance.HasType<RowObj>())
+    {
+        const RowObj& row = instance.As<RowObj>();
+        const TableObj& table = row.Table.As<TableObj>();
+        u32 fieldIndex = table.GetFieldIndex(prop);
+        if (fieldIndex == ClassObj::NO_FIELD)
+        {
+            RuntimeError(std::format("Table of {} has no column {}.", table.Type.As<ClassObj>().Name, prop));
+            return false;
+        }
+        table.GetColumn(fieldIndex)[row.Index] = val;
+    }
+    else
+    {
+        instance.As<InstanceObj>().Fields.Set(prop, val);
+    }
+    m_ValueStack.Pop();
+    m_ValueStack.Pop(); // pop instance
+    m_ValueStack.Push(val); // push val back to stack for subsequent sets.
+    return true;
+}
+
 bool VirtualMachine::ReadMethod(ObjHandle classObj, ObjHandle prop)
 {
     if (classObj.As<ClassObj>().Methods.Has(prop))
@@ -731,14 +1220,17 @@ bool VirtualMachine::ReadMethod(ObjHandle classObj, ObjHandle prop)
 
 bool VirtualMachine::CheckCollectionIndex(const Value& collection, const Value& index)
 {
-    if (!(index.HasType<f64>() && index.As<f64>() >= 0 && std::floor(index.As<f64>()) == (u32)index.As<f64>()))
+    if (!NativeFunctionsUtils::IsIndex(index))
     {
         RuntimeError("Only numbers can be used as indices.");
         return false;
     }
     if (!(collection.HasType<ObjHandle>() &&
          (collection.As<ObjHandle>().HasType<StringObj>() ||
-          collection.As<ObjHandle>().HasType<CollectionObj>())))
+          collection.As<ObjHandle>().HasType<StringSliceObj>() ||
+          collection.As<ObjHandle>().HasType<CollectionObj>() ||
+          collection.As<ObjHandle>().HasType<F64ArrayObj>() ||
+          collection.As<ObjHandle>().HasType<ByteBufferObj>())))
     {
         RuntimeError("Only collections and strings are subscriptable.");
         return false;
@@ -756,20 +1248,254 @@ Value VirtualMachine::GetCollectionSubscript(ObjHandle collection, u32 index)
             RuntimeError("Subscript index out of range.");
             return nullptr;
         }
-        return collectionObj.Items[index];
+        return collectionObj.Get(index);
+    }
+    else if (collection.HasType<F64ArrayObj>())
+    {
+        F64ArrayObj& array = collection.As<F64ArrayObj>();
+        if (index >= array.ItemCount)
+        {
+            RuntimeError("Subscript index out of range.");
+            return nullptr;
+        }
+        return array.Items[index];
+    }
+    else if (collection.HasType<ByteBufferObj>())
+    {
+        std::string_view bytes = collection.As<ByteBufferObj>().GetView();
+        if (index >= bytes.size())
+        {
+            RuntimeError("Subscript index out of range.");
+            return nullptr;
+        }
+        return (i32)(u8)bytes[index];
     }
     else
     {
-        // else it is string
-        const std::string& string = collection.As<StringObj>().String;
+        // else it is string or string slice
+        std::string_view string = StringUtils::GetView(collection);
         if (string.size() <= index)
         {
             RuntimeError("Subscript index out of range.");
             return nullptr;
         }
-        AddString(std::string{string[index]});
-        return m_InternedStrings.at(std::string{string[index]});
+        return m_ByteStrings[(u8)string[index]];
+    }
+}
+
+bool VirtualMachine::ReadGridSubscript(u32 count)
+{
+    ObjHandle gridH = m_ValueStack.Peek(count).As<ObjHandle>();
+    const GridObj& grid = gridH.As<GridObj>();
+    f64* item = GetGridItem(grid, &m_ValueStack.Peek(count - 1), count);
+    if (item == nullptr) return false;
+    Value result;
+    if (count == grid.Rank)
+    {
+        result = *item;
+    }
+    else
+    {
+        // fewer indices than dimensions give a view, grid stays on the stack meanwhile
+        result = ObjRegistry::Create<GridObj>(grid.GetOwner(gridH), item,
+            grid.Shape.data() + count, grid.Strides.data() + count, grid.Rank - count);
+    }
+    m_ValueStack.ShiftTop(count + 1);
+    m_ValueStack.Push(result);
+    return true;
+}
+
+bool VirtualMachine::SetGridSubscript(u32 count)
+{
+    Value val = m_ValueStack.Top();
+    const GridObj& grid = m_ValueStack.Peek(count + 1).As<ObjHandle>().As<GridObj>();
+    if (count != grid.Rank)
+    {
+        RuntimeError(std::format("Grid assignment expects {} indices, but {} given.", grid.Rank, count));
+        return false;
     }
+    if (!val.HasType<f64>())
+    {
+        RuntimeError("Can assign numbers only to grid subscript.");
+        return false;
+    }
+    f64* item = GetGridItem(grid, &m_ValueStack.Peek(count), count);
+    if (item == nullptr) return false;
+    *item = val.As<f64>();
+    m_ValueStack.ShiftTop(count + 2);
+    m_ValueStack.Push(val);
+    return true;
+}
+
+bool VirtualMachine::ReadSubscript()
+{
+    if (m_ValueStack.Peek(1).HasType<ObjHandle>() && m_ValueStack.Peek(1).As<ObjHandle>().HasType<GridObj>())
+    {
+        return ReadGridSubscript(1);
+    }
+    if (m_ValueStack.Peek(1).HasType<ObjHandle>() && m_ValueStack.Peek(1).As<ObjHandle>().HasType<TableObj>())
+    {
+        return ReadTableSubscript();
+    }
+    Value index = m_ValueStack.Top(); m_ValueStack.Pop();
+    Value collection = m_ValueStack.Top(); m_ValueStack.Pop();
+    if (collection.HasType<ObjHandle>() && collection.As<ObjHandle>().HasType<DictObj>())
+    {
+        const Value* val = collection.As<ObjHandle>().As<DictObj>().Map.Find(index);
+        if (val == nullptr)
+        {
+            RuntimeError(std::format("Key \"{}\" is not present in dictionary.", index));
+            return false;
+        }
+        m_ValueStack.Push(*val);
+        return true;
+    }
+    if (!CheckCollectionIndex(collection, index))
+    {
+        return false;
+    }
+    Value sub = GetCollectionSubscript(collection.As<ObjHandle>(), NativeFunctionsUtils::AsIndex(index));
+    if (m_HadError)
+    {
+        m_HadError = false;
+        return false;
+    }
+    m_ValueStack.Push(sub);
+    return true;
+}
+
+bool VirtualMachine::SetSubscript()
+{
+    if (m_ValueStack.Peek(2).HasType<ObjHandle>() && m_ValueStack.Peek(2).As<ObjHandle>().HasType<GridObj>())
+    {
+        return SetGridSubscript(1);
+    }
+    if (m_ValueStack.Peek(2).HasType<ObjHandle>() && m_ValueStack.Peek(2).As<ObjHandle>().HasType<TableObj>())
+    {
+        return SetTableSubscript();
+    }
+    Value newVal = m_ValueStack.Top(); m_ValueStack.Pop();
+    Value index = m_ValueStack.Top(); m_ValueStack.Pop();
+    Value collection = m_ValueStack.Top(); m_ValueStack.Pop();
+    if (collection.HasType<ObjHandle>() && collection.As<ObjHandle>().HasType<DictObj>())
+    {
+        if (!ValueHashMap::IsValidKey(index))
+        {
+            RuntimeError("Nil cannot be used as a dictionary key.");
+            return false;
+        }
+        collection.As<ObjHandle>().As<DictObj>().Set(index, newVal);
+        m_ValueStack.Push(newVal);
+        return true;
+    }
+    if (!CheckCollectionIndex(collection, index))
+    {
+        return false;
+    }
+    SetCollectionSubscript(collection.As<ObjHandle>(), NativeFunctionsUtils::AsIndex(index), newVal);
+    if (m_HadError)
+    {
+        m_HadError = false;
+        return false;
+    }
+    m_ValueStack.Push(newVal);
+    return true;
+}
+
+bool VirtualMachine::ReadTableSubscript()
+{
+    Value index = m_ValueStack.Top();
+    ObjHandle table = m_ValueStack.Peek(1).As<ObjHandle>();
+    if (!CheckTableIndex(table, index)) return false;
+    // table stays on the stack while the row is allocated
+    ObjHandle row = ObjRegistry::Create<RowObj>(table, NativeFunctionsUtils::AsIndex(index));
+    m_ValueStack.ShiftTop(2);
+    m_ValueStack.Push(row);
+    return true;
+}
+
+bool VirtualMachine::SetTableSubscript()
+{
+    Value val = m_ValueStack.Top();
+    ObjHandle table = m_ValueStack.Peek(2).As<ObjHandle>();
+    if (!CheckTableIndex(table, m_ValueStack.Peek(1))) return false;
+    if (!table.As<TableObj>().SetRow(NativeFunctionsUtils::AsIndex(m_ValueStack.Peek(1)), val))
+    {
+        RuntimeError("Can assign only structs, instances and rows to table subscript.");
+        return false;
+    }
+    m_ValueStack.ShiftTop(3);
+    m_ValueStack.Push(val);
+    return true;
+}
+
+u32 VirtualMachine::GetTableColumn(const Value& table, ObjHandle prop) const
+{
+    if (!(table.HasType<ObjHandle>() && table.As<ObjHandle>().HasType<TableObj>())) return ClassObj::NO_FIELD;
+    return table.As<ObjHandle>().As<TableObj>().GetFieldIndex(prop);
+}
+
+bool VirtualMachine::ReadTableColumn(u32 column)
+{
+    Value index = m_ValueStack.Top();
+    ObjHandle table = m_ValueStack.Peek(1).As<ObjHandle>();
+    if (!CheckTableIndex(table, index)) return false;
+    Value val = table.As<TableObj>().GetColumn(column)[NativeFunctionsUtils::AsIndex(index)];
+    m_ValueStack.ShiftTop(2);
+    m_ValueStack.Push(val);
+    return true;
+}
+
+bool VirtualMachine::SetTableColumn(u32 column)
+{
+    ObjHandle table = m_ValueStack.Peek(3).As<ObjHandle>();
+    if (!CheckTableIndex(table, m_ValueStack.Peek(2))) return false;
+    Value val = m_ValueStack.Top();
+    table.As<TableObj>().GetColumn(column)[NativeFunctionsUtils::AsIndex(m_ValueStack.Peek(2))] = val;
+    m_ValueStack.ShiftTop(4);
+    m_ValueStack.Push(val);
+    return true;
+}
+
+bool VirtualMachine::CheckTableIndex(ObjHandle table, const Value& index)
+{
+    if (!NativeFunctionsUtils::IsIndex(index))
+    {
+        RuntimeError("Only numbers can be used as indices.");
+        return false;
+    }
+    if (NativeFunctionsUtils::AsIndex(index) >= table.As<TableObj>().RowCount)
+    {
+        RuntimeError("Subscript index out of range.");
+        return false;
+    }
+    return true;
+}
+
+f64* VirtualMachine::GetGridItem(const GridObj& grid, const Value* indices, u32 count)
+{
+    if (count > grid.Rank)
+    {
+        RuntimeError(std::format("Grid has {} dimensions, but {} indices given.", grid.Rank, count));
+        return nullptr;
+    }
+    f64* item = grid.Data;
+    for (u32 dim = 0; dim < count; dim++)
+    {
+        const Value& index = indices[dim];
+        if (!NativeFunctionsUtils::IsIndex(index))
+        {
+            RuntimeError("Only numbers can be used as indices.");
+            return nullptr;
+        }
+        if (NativeFunctionsUtils::AsIndex(index) >= grid.Shape[dim])
+        {
+            RuntimeError("Subscript index out of range.");
+            return nullptr;
+        }
+        item += (u64)NativeFunctionsUtils::AsIndex(index) * grid.Strides[dim];
+    }
+    return item;
 }
 
 void VirtualMachine::SetCollectionSubscript(ObjHandle collection, u32 index, const Value& val)
@@ -782,7 +1508,33 @@ void VirtualMachine::SetCollectionSubscript(ObjHandle collection, u32 index, con
             RuntimeError("Subscript index out of range.");
             return;
         }
-        collectionObj.Items[index] = val;
+        collectionObj.Set(index, val);
+        return;
+    }
+    else if (collection.HasType<F64ArrayObj>())
+    {
+        F64ArrayObj& array = collection.As<F64ArrayObj>();
+        if (index >= array.ItemCount)
+        {
+            RuntimeError("Subscript index out of range.");
+            return;
+        }
+        if (!val.HasType<f64>())
+        {
+            RuntimeError("Can assign numbers only to F64Array subscript.");
+            return;
+        }
+        array.Items[index] = val.As<f64>();
+        return;
+    }
+    else if (collection.HasType<StringSliceObj>())
+    {
+        RuntimeError("String slices are read-only.");
+        return;
+    }
+    else if (collection.HasType<ByteBufferObj>())
+    {
+        RuntimeError("Byte buffers are read-only.");
         return;
     }
     else
@@ -802,6 +1554,8 @@ void VirtualMachine::SetCollectionSubscript(ObjHandle collection, u32 index, con
             return;
         }
         string[index] = val.As<ObjHandle>().As<StringObj>().String[0];
+        // the cached format plan described the old text
+        collection.As<StringObj>().Format.reset();
         return;
     }
 }
@@ -848,7 +1602,7 @@ u32 VirtualMachine::ReadU32()
 
 void VirtualMachine::PrintValue(Value val)
 {
-    std::cout << std::format("{}\n", val);
+    m_Output.VFormat("{}\n", std::make_format_args(val));
 }
 
 ObjHandle VirtualMachine::CaptureUpvalue(Value* loc)
@@ -891,6 +1645,72 @@ ObjHandle VirtualMachine::AddString(const std::string& val)
     return newString;
 }
 
+Random& VirtualMachine::GetRandom()
+{
+    return m_Random;
+}
+
+OutputBuffer& VirtualMachine::GetOutput()
+{
+    return m_Output;
+}
+
+Json& VirtualMachine::GetJson()
+{
+    return m_Json;
+}
+
+Packer& VirtualMachine::GetPacker()
+{
+    return m_Packer;
+}
+
+ScriptCache& VirtualMachine::GetScriptCache()
+{
+    return m_ScriptCache;
+}
+
+ObjHandle VirtualMachine::GetByteString(u8 byte) const
+{
+    return m_ByteStrings[byte];
+}
+
+bool VirtualMachine::CallFromNative(Value callee, u8 argc, const Value* args, Value& result)
+{
+    usize frameCount = m_CallFrames.size();
+    m_ValueStack.Push(callee);
+    for (u32 i = 0; i < argc; i++)
+        m_ValueStack.Push(args[i]);
+    if (!CallValue(callee, argc)) return false;
+    // natives are done already, script functions have pushed a frame, that has to be run
+    if (m_CallFrames.size() > frameCount && Run(frameCount) != InterpretResult::Ok) return false;
+    result = m_ValueStack.Top(); m_ValueStack.Pop();
+    return true;
+}
+
+void VirtualMachine::PushTemporary(Value val)
+{
+    m_ValueStack.Push(val);
+}
+
+void VirtualMachine::PopTemporary()
+{
+    m_ValueStack.Pop();
+}
+
+void VirtualMachine::DefineIntrinsic(const std::string& name, Intrinsic intrinsic, NativeFn nativeFn)
+{
+    DefineNativeFun(name, nativeFn);
+    ObjHandle funName = AddString(name);
+    m_Intrinsics[(u32)intrinsic] = IntrinsicInfo{.Name = funName, .Fn = nativeFn};
+    m_IntrinsicNames.Set(funName, (i32)intrinsic);
+}
+
+void VirtualMachine::CheckIntrinsicOverride(ObjHandle varName)
+{
+    if (m_IntrinsicNames.Has(varName)) m_Intrinsics[m_IntrinsicNames[varName].As<i32>()].IsOverridden = true;
+}
+
 void VirtualMachine::DefineNativeFun(const std::string& name, NativeFn nativeFn)
 {
     m_ValueStack.Push(AddString(std::string{name}));
@@ -898,6 +1718,7 @@ void VirtualMachine::DefineNativeFun(const std::string& name, NativeFn nativeFn)
     m_ValueStack.Push(ObjRegistry::Create<NativeFunObj>(nativeFn));
     ObjHandle fun = m_ValueStack.Top().As<ObjHandle>();
     m_GlobalsSparseSet.Set(funName, fun);
+    m_NativeFuns.Set(funName, fun);
     m_ValueStack.Pop();
     m_ValueStack.Pop();
 }
@@ -929,10 +1750,35 @@ bool VirtualMachine::IsFalsey(Value val) const
     return false;
 }
 
+bool VirtualMachine::IsInstance(Value val) const
+{
+    if (!val.HasType<ObjHandle>()) return false;
+    ObjType type = val.As<ObjHandle>().GetType();
+    return type == ObjType::Instance || type == ObjType::Struct || type == ObjType::Row;
+}
+
+ObjHandle VirtualMachine::GetClass(ObjHandle instance) const
+{
+    if (instance.HasType<StructObj>()) return instance.As<StructObj>().Type;
+    if (instance.HasType<RowObj>()) return instance.As<RowObj>().Table.As<TableObj>().Type;
+    return instance.As<InstanceObj>().Class;
+}
+
 bool VirtualMachine::AreEqual(Value a, Value b) const
 {
 #ifdef NAN_BOXING
-    return a == b;
+    if (a == b) return true;
+    // integer and float with the same value are equal
+    if (a.HasType<f64>() && b.HasType<f64>()) return a.As<f64>() == b.As<f64>();
+    if (IsStruct(a) && IsStruct(b)) return AreStructsEqual(a.As<ObjHandle>(), b.As<ObjHandle>());
+    if (IsRow(a) && IsRow(b)) return AreRowsEqual(a.As<ObjHandle>(), b.As<ObjHandle>());
+    // slices are not interned, so they have to be compared by content
+    if (StringUtils::IsString(a) && StringUtils::IsString(b) &&
+        (a.As<ObjHandle>().HasType<StringSliceObj>() || b.As<ObjHandle>().HasType<StringSliceObj>()))
+    {
+        return StringUtils::GetView(a) == StringUtils::GetView(b);
+    }
+    return false;
 #else
     using objCompFn = bool (*)(ObjHandle, ObjHandle);
     objCompFn objComparisons[(u32)ObjType::Count][(u32)ObjType::Count] = {{nullptr}};
@@ -940,11 +1786,20 @@ bool VirtualMachine::AreEqual(Value a, Value b) const
     {
         return strA == strB;
     };
+    // slices are not interned, so they have to be compared by content
+    objCompFn sliceComparison = [](ObjHandle strA, ObjHandle strB)
+    {
+        return StringUtils::GetView(strA) == StringUtils::GetView(strB);
+    };
+    objComparisons[(u32)ObjType::String][(u32)ObjType::StringSlice] = sliceComparison;
+    objComparisons[(u32)ObjType::StringSlice][(u32)ObjType::String] = sliceComparison;
+    objComparisons[(u32)ObjType::StringSlice][(u32)ObjType::StringSlice] = sliceComparison;
     if (a.HasType<bool>())
     {
         if (b.HasType<bool>()) return a.As<bool>() == b.As<bool>();
         return false;
     }
+    if (a.HasType<i32>() && b.HasType<i32>()) return a.As<i32>() == b.As<i32>();
     if (a.HasType<f64>())
     {
         if (b.HasType<f64>()) return a.As<f64>() == b.As<f64>();
@@ -958,6 +1813,8 @@ bool VirtualMachine::AreEqual(Value a, Value b) const
     {
         if (b.HasType<ObjHandle>())
         {
+            if (IsStruct(a) && IsStruct(b)) return AreStructsEqual(a.As<ObjHandle>(), b.As<ObjHandle>());
+            if (IsRow(a) && IsRow(b)) return AreRowsEqual(a.As<ObjHandle>(), b.As<ObjHandle>());
             objCompFn fn = objComparisons[(u32)a.As<ObjHandle>().GetType()][(u32)b.As<ObjHandle>().GetType()];
             if (fn == nullptr) return false;
             return fn(a.As<ObjHandle>(), b.As<ObjHandle>());
@@ -967,4 +1824,50 @@ bool VirtualMachine::AreEqual(Value a, Value b) const
 #endif
 }
 
+bool VirtualMachine::IsStruct(Value val) const
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<StructObj>();
+}
+
+bool VirtualMachine::AreStructsEqual(ObjHandle a, ObjHandle b) const
+{
+    // structs compare by their fields, like rows
+    const StructObj& structA = a.As<StructObj>();
+    const StructObj& structB = b.As<StructObj>();
+    if (structA.Type != structB.Type) return false;
+    for (u32 i = 0; i < structA.FieldCount; i++)
+    {
+        if (!AreEqual(structA.Fields[i], structB.Fields[i])) return false;
+    }
+    return true;
+}
+
+bool VirtualMachine::ToInteger(Value val, i32& integer)
+{
+    if (val.HasType<i32>())
+    {
+        integer = val.As<i32>();
+        return true;
+    }
+    if (!val.HasType<f64>()) return false;
+    f64 number = val.As<f64>();
+    if (!(number >= std::numeric_limits<i32>::min() && number <= std::numeric_limits<i32>::max() && std::floor(number) == number))
+        return false;
+    integer = (i32)number;
+    return true;
+}
+
+
+bool VirtualMachine::IsRow(Value val) const
+{
+    return val.HasType<ObjHandle>() && val.As<ObjHandle>().HasType<RowObj>();
+}
+
+bool VirtualMachine::AreRowsEqual(ObjHandle a, ObjHandle b) const
+{
+    // each subscript makes a new proxy, so rows are equal when they refer to the same cells
+    return a.As<RowObj>().Table == b.As<RowObj>().Table && a.As<RowObj>().Index == b.As<RowObj>().Index;
+}
+
 #undef BINARY_OP
+#undef BITWISE_OP
@@ -1,17 +1,31 @@
 ﻿#pragma once
 
 #include "Chunk.h"
+#include "Json.h"
 #include "Obj.h"
+#include "Pack.h"
+#include "ScriptCache.h"
 #include "Value.h"
 #include "Common/ValueStack.h"
 #include "Common/ObjSparseSet.h"
+#include "Common/OutputBuffer.h"
+#include "Common/Random.h"
 
+#include <array>
 #include <unordered_map>
 
 class Chunk;
 
 enum class InterpretResult { Ok, CompileError, RuntimeError };
 
+struct IntrinsicInfo
+{
+    ObjHandle Name{};
+    NativeFn Fn{nullptr};
+    // set once the global is redefined, calls go through the global afterwards
+    bool IsOverridden{false};
+};
+
 struct CallFrame
 {
     ObjHandle Fun{ObjHandle::NonHandle()};
@@ -24,32 +38,87 @@ class VirtualMachine
 {
     friend class Compiler;
     friend class GarbageCollector;
+    friend class HeapImage;
 public:
     VirtualMachine();
     ~VirtualMachine();
     void Init();
     void Repl();
+    // runs either source or bytecode, written by `CompileFile`
     void RunFile(std::string_view path);
+    // compiles the script at `path` into bytecode file at `outputPath`, without running it
+    void CompileFile(std::string_view path, std::string_view outputPath);
+    // reuses compiled script from the cache, if the same `source` was compiled before and the cache kept it
     InterpretResult Interpret(std::string_view source);
     ObjHandle AddString(const std::string& val);
+    ObjHandle GetByteString(u8 byte) const;
+    // keeps `val` reachable by the GC, while native function allocates new objects,
+    // note that it may reallocate the value stack, invalidating native's `argv`
+    void PushTemporary(Value val);
+    void PopTemporary();
+    Random& GetRandom();
+    OutputBuffer& GetOutput();
+    Json& GetJson();
+    Packer& GetPacker();
+    ScriptCache& GetScriptCache();
+    // calls `callee` with `argc` arguments from native code and runs it until it returns,
+    // the outer `Run` picks up its frame afresh once the native is done;
+    // `args` must not point into the value stack, which (as well as native's `argv`) may be reallocated,
+    // on error the stacks are cleared, and native function shall fail right away
+    bool CallFromNative(Value callee, u8 argc, const Value* args, Value& result);
+    // integers, and floats with integral value in integer range
+    static bool ToInteger(Value val, i32& integer);
+    bool IsFalsey(Value val) const;
 private:
+    void InitByteStrings();
     void InitNativeFunctions();
-    InterpretResult Run();
+    // calls compiled top-level function `script`
+    InterpretResult RunScript(ObjHandle script);
+    // returns once the number of call frames drops to `exitFrameCount` (used by `CallFromNative`)
+    InterpretResult Run(usize exitFrameCount = 0);
     bool Invoke(ObjHandle method, u8 argc);
     bool InvokeFromClass(ObjHandle classObj, ObjHandle method, u8 argc);
     bool CallValue(Value callee, u8 argc);
     bool Call(ObjHandle fun, u8 argc);
     bool ClosureCall(ObjHandle closure, u8 argc);
     bool NativeCall(ObjHandle fun, u8 argc);
+    // arguments are on the stack, they are replaced with the result
+    bool IntrinsicCall(Intrinsic intrinsic, u8 argc);
     bool ClassCall(ObjHandle classObj, u8 argc);
+    bool StructCall(ObjHandle structType, u8 argc);
     bool MethodCall(ObjHandle method, u8 argc);
 
+    // `instance` is either class instance, struct or table row
+    // instance (and a new value) are on the stack, they are replaced with the result
+    bool ReadProperty(ObjHandle prop);
+    bool SetProperty(ObjHandle prop);
     bool ReadField(ObjHandle instance, ObjHandle prop);
+    // new value and instance are on the stack, they are replaced with the value
+    bool SetField(ObjHandle instance, ObjHandle prop);
     bool ReadMethod(ObjHandle classObj, ObjHandle prop);
+    bool IsInstance(Value val) const;
+    ObjHandle GetClass(ObjHandle instance) const;
 
+    // collection and index (and a new value) are on the stack, they are replaced with the result
+    bool ReadSubscript();
+    bool SetSubscript();
     bool CheckCollectionIndex(const Value& collection, const Value& index);
     Value GetCollectionSubscript(ObjHandle collection, u32 index);
     void SetCollectionSubscript(ObjHandle collection, u32 index, const Value& val);
+    // grid and `count` indices (and a new value) are on the stack, they are replaced with the result
+    bool ReadGridSubscript(u32 count);
+    bool SetGridSubscript(u32 count);
+    f64* GetGridItem(const GridObj& grid, const Value* indices, u32 count);
+    // table and index (and a new row value) are on the stack, they are replaced with the result
+    bool ReadTableSubscript();
+    bool SetTableSubscript();
+    // column of `prop`, if `table` is a table that has it, and `ClassObj::NO_FIELD` otherwise
+    u32 GetTableColumn(const Value& table, ObjHandle prop) const;
+    // `table[index].property` straight from the column, without making a row:
+    // table and index (and the name and a new value) are on the stack, they are replaced with the result
+    bool ReadTableColumn(u32 column);
+    bool SetTableColumn(u32 column);
+    bool CheckTableIndex(ObjHandle table, const Value& index);
     
     OpCode ReadInstruction();
     Value ReadConstant();
@@ -63,20 +132,38 @@ private:
     void CloseUpvalues(Value* last);
     
     void DefineNativeFun(const std::string& name, NativeFn nativeFn);
+    void DefineIntrinsic(const std::string& name, Intrinsic intrinsic, NativeFn nativeFn);
+    void CheckIntrinsicOverride(ObjHandle varName);
     
     void ClearStacks();
 
     void RuntimeError(const std::string& message);
     
-    bool IsFalsey(Value val) const;
     bool AreEqual(Value a, Value b) const;
+    bool IsStruct(Value val) const;
+    bool AreStructsEqual(ObjHandle a, ObjHandle b) const;
+    bool IsRow(Value val) const;
+    bool AreRowsEqual(ObjHandle a, ObjHandle b) const;
 private:
     ObjHandle m_InitString{};
+    // permanent single-byte strings, used by string subscripts and `chr()`
+    std::array<ObjHandle, 256> m_ByteStrings{};
     std::vector<CallFrame> m_CallFrames;
     ValueStack m_ValueStack;
     std::unordered_map<std::string, ObjHandle> m_InternedStrings;
     ObjSparseSet m_GlobalsSparseSet;
+    // global name to `Intrinsic`
+    ObjSparseSet m_IntrinsicNames;
+    // global name to the native function it was defined with, even if the global is redefined since
+    ObjSparseSet m_NativeFuns;
+    std::array<IntrinsicInfo, (u32)Intrinsic::Count> m_Intrinsics{};
     ObjHandle m_OpenUpvalues{};
 
+    Random m_Random;
+    OutputBuffer m_Output;
+    Json m_Json;
+    Packer m_Packer;
+    ScriptCache m_ScriptCache;
+
     bool m_HadError{false};
 };
@@ -1,13 +1,27 @@
 #include "Chunk.h"
 #include "Log.h"
 #include "VirtualMachine.h"
+
+#include <string_view>
+
 int main(i32 argc, char** argv)
 {
     VirtualMachine virtualMachine{};
-    if (argc > 2)
+    if (argc == 4 && std::string_view{argv[1]} == "--compile")
+    {
+        LOG_INFO("Compiling file {} to {}.", argv[2], argv[3]);
+        virtualMachine.CompileFile(argv[2], argv[3]);
+    }
+    else if (argc == 4 && std::string_view{argv[1]} == "--cache-dir")
+    {
+        LOG_INFO("Running in file mode. File: {}. Script cache: {}.", argv[3], argv[2]);
+        virtualMachine.GetScriptCache().SetDirectory(argv[2]);
+        virtualMachine.RunFile(argv[3]);
+    }
+    else if (argc > 2)
     {
         LOG_ERROR("Incorrect number of arguments.");
-        LOG_INFO("Usage: BytecodeVM [script_file].");
+        LOG_INFO("Usage: BytecodeVM [[--cache-dir directory] script_file] | --compile script_file bytecode_file.");
     }
     else if (argc == 2)
     {